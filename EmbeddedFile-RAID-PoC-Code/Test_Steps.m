@@ -7,4 +7,7 @@ Test case 4:  Delete Chunk4 -- Execute to show it will be restored and new image
 Test case 5:  Delete Chunk5 -- Execute to show it will be restored and new image will be same as input image
 
 Test case 6:  Delete Chunk1 + Corrupt chunk 2 (copy chunk 3 to chunk 2)
-			-- Execute to show new image will be distorted
\ No newline at end of file
+			-- Execute to show new image will be distorted
+
+Test case 7:  RAID-6 (File-RAID-PoC-Code: stripetest -6 <in> <out> 1 2)
+			Delete Chunk1 + Chunk2 -- Execute to show both are rebuilt from P and Q and new image will be same as input image
\ No newline at end of file
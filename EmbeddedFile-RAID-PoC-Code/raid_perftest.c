@@ -1,11 +1,23 @@
 #include "raidtest.h"
-#include <omp.h> // Include OpenMP for parallel processing
+#include "raidsimd.h" // Kernel table for per-kernel timing
+#include "raidpool.h" // Worker pool size for the batch test
 #include <time.h> // Include for high-precision timing
 
+#define REGION_SIZE (4 * 1024 * 1024)  // Bytes per data unit for the N-way test
+#define REGION_REPS (16)
+
 int main(int argc, char *argv[])
 {
     int idx, LBAidx, numTestIterations;
-    double rate = 0.0;
+    double rate = 0.0, gbps = 0.0;
+    int kernelIdx, kernelCount;
+    const raidkernel_t *kernel;
+    const char *bestKernel = raidActiveKernel();
+    unsigned char *region[12], *regionParity;
+    int nsrc, rep;
+    struct timespec RegionStart, RegionStop;
+    double regionSecs;
+    unsigned char *batchStripes;
     struct timespec StartTime, StopTime; // Structure to store start and stop times
     long microsecs; // Variable to store elapsed time in microseconds
 
@@ -33,43 +45,165 @@ int main(int argc, char *argv[])
     }
 
     // TEST CASE #1: RAID Operations Performance Test
-    printf("\nRAID Operations Performance Test\n");
+    // Repeated for every XOR kernel this CPU supports
+    printf("\nRAID Operations Performance Test (active kernel = %s)\n", raidActiveKernel());
 
-    clock_gettime(CLOCK_MONOTONIC, &StartTime); // Record the start time
+#ifdef RAID64
+    // The word-wide API does not go through the SIMD dispatch, so time it once
+    kernelCount = 1;
+#else
+    kernelCount = raidKernelCount();
+#endif
 
-    // Perform the RAID operations in parallel using OpenMP
-    #pragma omp parallel for private(LBAidx) 
-    for(idx = 0; idx < numTestIterations; idx++)
+    for(kernelIdx = 0; kernelIdx < kernelCount; kernelIdx++)
     {
-        LBAidx = idx % MAX_LBAS;
+        kernel = raidKernelInfo(kernelIdx);
+
+        if(!kernel->supported())
+        {
+            printf("\nkernel %s: not supported on this CPU\n", kernel->name);
+            continue;
+        }
+
+        raidSelectKernel(kernel->name);
+#ifdef RAID64
+        printf("\nkernel word64:\n");
+#else
+        printf("\nkernel %s:\n", kernel->name);
+#endif
 
-        // Compute XOR from 4 LBAs for RAID-5 encoding
-        xorLBA(PTR_CAST &testLBA1[LBAidx],
-               PTR_CAST &testLBA2[LBAidx],
-               PTR_CAST &testLBA3[LBAidx],
-               PTR_CAST &testLBA4[LBAidx],
-               PTR_CAST &testPLBA[LBAidx]);
+        clock_gettime(CLOCK_MONOTONIC, &StartTime); // Record the start time
 
-        // Rebuild the LBA to verify the correctness of the RAID operation
-        rebuildLBA(PTR_CAST &testLBA1[LBAidx],
+        // Per-sector calls stay on one thread; multi-core scaling is measured by TEST CASE #3
+        for(idx = 0; idx < numTestIterations; idx++)
+        {
+            LBAidx = idx % MAX_LBAS;
+
+            // Compute XOR from 4 LBAs for RAID-5 encoding
+            xorLBA(PTR_CAST &testLBA1[LBAidx],
                    PTR_CAST &testLBA2[LBAidx],
                    PTR_CAST &testLBA3[LBAidx],
-                   PTR_CAST &testPLBA[LBAidx],
-                   PTR_CAST &testRebuild[LBAidx]);
+                   PTR_CAST &testLBA4[LBAidx],
+                   PTR_CAST &testPLBA[LBAidx]);
+
+            // Rebuild the LBA to verify the correctness of the RAID operation
+            rebuildLBA(PTR_CAST &testLBA1[LBAidx],
+                       PTR_CAST &testLBA2[LBAidx],
+                       PTR_CAST &testLBA3[LBAidx],
+                       PTR_CAST &testPLBA[LBAidx],
+                       PTR_CAST &testRebuild[LBAidx]);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &StopTime); // Record the stop time
+
+        // Calculate the elapsed time in microseconds
+        microsecs = (StopTime.tv_sec - StartTime.tv_sec) * 1000000L + 
+                    (StopTime.tv_nsec - StartTime.tv_nsec) / 1000;
+        if(microsecs == 0)
+            microsecs = 1;
+
+        // Display the elapsed time and performance metrics
+        printf("Test Done in %ld microsecs for %d iterations\n", microsecs, numTestIterations);
+
+        rate = ((double)numTestIterations) / (((double)microsecs) / 1000000.0); // Calculate the RAID operations per second
+        printf("%lf RAID ops computed per second\n", rate);
+        printf("Average time per RAID operation: %lf microsecs\n", (double)microsecs / numTestIterations);
+
+        // Each iteration reads 4 sectors for the encode and 4 for the rebuild
+        gbps = (rate * 8.0 * SECTOR_SIZE) / 1.0e9;
+        printf("%lf GB/s parity input bandwidth\n", gbps);
     }
 
-    clock_gettime(CLOCK_MONOTONIC, &StopTime); // Record the stop time
+    raidSelectKernel(bestKernel); // Restore the load-time selection
+
+    // END TEST CASE #1
+
+    // TEST CASE #2: Wide-layout N-way parity over multi-megabyte regions
+    //
+    // One xorBlocks() call per region for 4+1, 8+1 and 12+1 layouts, compared with encoding
+    // the same 4+1 region one sector at a time through xorLBA().
+    //
+    printf("\nN-way Region Parity Performance Test (%d MiB per unit, kernel = %s)\n",
+           REGION_SIZE / (1024 * 1024), raidActiveKernel());
+
+    for(idx = 0; idx < 12; idx++)
+    {
+        region[idx] = malloc(REGION_SIZE);
+        memset(region[idx], idx + 1, REGION_SIZE);
+    }
+    regionParity = malloc(REGION_SIZE);
+
+    for(nsrc = 4; nsrc <= 12; nsrc += 4)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+        for(rep = 0; rep < REGION_REPS; rep++)
+            xorBlocks(region, nsrc, regionParity, REGION_SIZE);
+        clock_gettime(CLOCK_MONOTONIC, &RegionStop);
 
-    // Calculate the elapsed time in microseconds
-    microsecs = (StopTime.tv_sec - StartTime.tv_sec) * 1000000L + 
+        regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+        printf("%d+1 xorBlocks: %lf GB/s\n", nsrc,
+               ((double)nsrc * REGION_SIZE * REGION_REPS) / regionSecs / 1.0e9);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+    for(rep = 0; rep < REGION_REPS; rep++)
+        for(LBAidx = 0; LBAidx < (REGION_SIZE / SECTOR_SIZE); LBAidx++)
+            xorLBA(PTR_CAST (region[0] + (LBAidx * SECTOR_SIZE)),
+                   PTR_CAST (region[1] + (LBAidx * SECTOR_SIZE)),
+                   PTR_CAST (region[2] + (LBAidx * SECTOR_SIZE)),
+                   PTR_CAST (region[3] + (LBAidx * SECTOR_SIZE)),
+                   PTR_CAST (regionParity + (LBAidx * SECTOR_SIZE)));
+    clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+
+    regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+    printf("4+1 per-sector xorLBA: %lf GB/s\n", (4.0 * REGION_SIZE * REGION_REPS) / regionSecs / 1.0e9);
+
+    for(idx = 0; idx < 12; idx++)
+        free(region[idx]);
+    free(regionParity);
+
+    // END TEST CASE #2
+
+    // TEST CASE #3: Stripe-batch parity across the persistent worker pool
+    //
+    // Each repetition encodes and then rebuilds chunk 4 of MAX_LBAS whole stripes with one
+    // xorStripeBatch() and one rebuildStripeBatch() call.
+    //
+    printf("\nStripe-Batch Parity Performance Test (%d threads, %d stripes per batch)\n",
+           raidPoolThreads(), MAX_LBAS);
+
+    batchStripes = malloc((size_t)MAX_LBAS * STRIPE_BYTES);
+    for(idx = 0; idx < MAX_LBAS; idx++)
+    {
+        memcpy(batchStripes + ((size_t)idx * STRIPE_BYTES), &testLBA1[idx], SECTOR_SIZE);
+        memcpy(batchStripes + ((size_t)idx * STRIPE_BYTES) + SECTOR_SIZE, &testLBA2[idx], SECTOR_SIZE);
+        memcpy(batchStripes + ((size_t)idx * STRIPE_BYTES) + (2 * SECTOR_SIZE), &testLBA3[idx], SECTOR_SIZE);
+        memcpy(batchStripes + ((size_t)idx * STRIPE_BYTES) + (3 * SECTOR_SIZE), &testLBA4[idx], SECTOR_SIZE);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &StartTime);
+    for(rep = 0; rep < numTestIterations; rep++)
+    {
+        xorStripeBatch(batchStripes, MAX_LBAS);
+        rebuildStripeBatch(batchStripes, MAX_LBAS, 4);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &StopTime);
+
+    // The rebuilt chunk 4 must still be the original data
+    for(idx = 0; idx < MAX_LBAS; idx++)
+        assert(memcmp(batchStripes + ((size_t)idx * STRIPE_BYTES) + (3 * SECTOR_SIZE), &testLBA4[idx], SECTOR_SIZE) == 0);
+
+    microsecs = (StopTime.tv_sec - StartTime.tv_sec) * 1000000L +
                 (StopTime.tv_nsec - StartTime.tv_nsec) / 1000;
+    if(microsecs == 0)
+        microsecs = 1;
 
-    // Display the elapsed time and performance metrics
-    printf("Test Done in %ld microsecs for %d iterations\n", microsecs, numTestIterations);
+    rate = ((double)numTestIterations * MAX_LBAS) / (((double)microsecs) / 1000000.0);
+    printf("Test Done in %ld microsecs for %d batches\n", microsecs, numTestIterations);
+    printf("%lf stripe encode+rebuild ops per second\n", rate);
+    printf("%lf GB/s parity input bandwidth\n", (rate * 8.0 * SECTOR_SIZE) / 1.0e9);
 
-    rate = ((double)numTestIterations) / (((double)microsecs) / 1000000.0); // Calculate the RAID operations per second
-    printf("%lf RAID ops computed per second\n", rate);
-    printf("Average time per RAID operation: %lf microsecs\n", (double)microsecs / numTestIterations);
+    free(batchStripes);
 
-    // END TEST CASE #1
+    // END TEST CASE #3
 }
@@ -68,6 +68,18 @@ fi
 log "TEST SET 4: RAID performance test"
 ./raid_perftest 1000 >> testresults.log 2>&1 || error_log "raid_perftest failed."
 
+log "TEST SET 5: RAID64 word-wide build and rebuild test"
+make -j$(nproc) raid64 >> testresults.log 2>&1 || error_log "make raid64 failed."
+./raidtest64 1000 >> testresults.log 2>&1 || error_log "raidtest64 failed."
+
+log "TEST SET 6: Direct I/O stripe and restore of partial stripes and batches"
+for size in 1 2049 131073 524289; do
+    head -c $size Baby-Musk-Ox.ppm > directtest.bin
+    echo | ./stripetest directtest.bin directtest.out 3 >> testresults.log 2>&1 || error_log "stripetest failed for $size bytes."
+    cmp directtest.bin directtest.out >> testresults.log 2>&1 || error_log "Direct I/O restore failed for $size bytes."
+done
+rm -f directtest.bin directtest.out
+
 # Re-run cleanup after tests
 cleanup_raid
 
@@ -1,14 +1,21 @@
+#define _GNU_SOURCE // O_DIRECT and statx
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/stat.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 #include <assert.h>
-#include <omp.h> // Include OpenMP for parallel processing
 
 #include "raidlib.h"
+#include "raidsimd.h" // Runtime-dispatched XOR kernels
+#include "raidpool.h" // Persistent worker pool for stripe batches
 
 #ifdef RAID64
 #include "raidlib64.h"
@@ -23,6 +30,8 @@
 #define O_DIRECT 0 // Fallback to normal file I/O if O_DIRECT is unavailable
 #endif
 
+#ifndef RAID64 // The word-wide kernels live in raidlib64.c
+
 // RAID-5 encoding function
 // This function takes in four logical block addresses (LBAs) and computes their XOR to produce parity (PLBA)
 void xorLBA(unsigned char *LBA1,
@@ -31,19 +40,8 @@ void xorLBA(unsigned char *LBA1,
             unsigned char *LBA4,
             unsigned char *PLBA)
 {
-    int idx;
-
-    #pragma omp parallel for // Parallelize loop for better performance
-    for(idx=0; idx<SECTOR_SIZE; idx++)
-    {
-        // Prefetch data to improve cache performance
-        __builtin_prefetch(&LBA1[idx + 16], 0, 1);
-        __builtin_prefetch(&LBA2[idx + 16], 0, 1);
-        __builtin_prefetch(&LBA3[idx + 16], 0, 1);
-        __builtin_prefetch(&LBA4[idx + 16], 0, 1);
-        // Compute XOR across the four LBAs to generate parity
-        *(PLBA+idx) = (*(LBA1+idx))^(*(LBA2+idx))^(*(LBA3+idx))^(*(LBA4+idx));
-    }
+    // Compute XOR across the four LBAs with the widest kernel this CPU supports
+    raidXor4(LBA1, LBA2, LBA3, LBA4, PLBA, SECTOR_SIZE);
 }
 
 // RAID-5 Rebuild function
@@ -53,23 +51,209 @@ void rebuildLBA(unsigned char *LBA1,
                 unsigned char *LBA3,
                 unsigned char *PLBA,
                 unsigned char *RLBA)
+{
+    // Rebuild RLBA by XORing the parity LBA with the available LBAs
+    raidXor4(LBA1, LBA2, LBA3, PLBA, RLBA, SECTOR_SIZE);
+}
+
+#endif
+
+// Stripe-batch parity
+//
+// Each per-sector kernel stays single-threaded and vectorized; parallelism comes from
+// handing whole stripes to the persistent worker pool, so there is one wakeup per batch
+// rather than one OpenMP fork/join per 512-byte sector.
+typedef struct stripe_batch
+{
+    unsigned char *stripes;
+    int missingChunk;
+} stripebatch_t;
+
+static void encodeStripeRange(void *arg, int first, int last)
+{
+    stripebatch_t *batch = (stripebatch_t *)arg;
+    unsigned char *stripe;
+    int idx;
+
+    for(idx = first; idx < last; idx++)
+    {
+        stripe = batch->stripes + ((size_t)idx * STRIPE_BYTES);
+        xorLBA(PTR_CAST &stripe[0],
+               PTR_CAST &stripe[SECTOR_SIZE],
+               PTR_CAST &stripe[2 * SECTOR_SIZE],
+               PTR_CAST &stripe[3 * SECTOR_SIZE],
+               PTR_CAST &stripe[4 * SECTOR_SIZE]);
+    }
+}
+
+static void rebuildStripeRange(void *arg, int first, int last)
+{
+    stripebatch_t *batch = (stripebatch_t *)arg;
+    unsigned char *stripe, *survivor[4];
+    int idx, chunk, cnt;
+
+    for(idx = first; idx < last; idx++)
+    {
+        stripe = batch->stripes + ((size_t)idx * STRIPE_BYTES);
+
+        // The four surviving units in chunk order; parity, when present, is always last
+        for(chunk = 0, cnt = 0; chunk < 5; chunk++)
+            if(chunk + 1 != batch->missingChunk)
+                survivor[cnt++] = &stripe[chunk * SECTOR_SIZE];
+
+        rebuildLBA(PTR_CAST survivor[0],
+                   PTR_CAST survivor[1],
+                   PTR_CAST survivor[2],
+                   PTR_CAST survivor[3],
+                   PTR_CAST &stripe[(batch->missingChunk - 1) * SECTOR_SIZE]);
+    }
+}
+
+int xorStripeBatch(unsigned char *stripes, int stripeCnt)
+{
+    stripebatch_t batch = { stripes, 0 };
+
+    return raidPoolRun(encodeStripeRange, &batch, stripeCnt, BATCH_MIN_STRIPES);
+}
+
+int rebuildStripeBatch(unsigned char *stripes, int stripeCnt, int missingChunk)
+{
+    stripebatch_t batch = { stripes, missingChunk };
+
+    if(missingChunk == 0)
+        return OK;
+    if((missingChunk < 1) || (missingChunk > 5))
+        return ERROR;
+
+    return raidPoolRun(rebuildStripeRange, &batch, stripeCnt, BATCH_MIN_STRIPES);
+}
+
+// Direct I/O
+//
+// The chunk files are opened with O_DIRECT so stripe and rebuild traffic bypasses the
+// page cache. Direct I/O needs the buffer address, file offset and length aligned to
+// the logical block size, so each chunk is moved in batches of at least
+// DIRECT_BATCH_STRIPES sectors from posix_memalign-ed buffers, one buffer per chunk. The
+// last batch is zero-padded to a whole block and the chunk files are then cut back to
+// whole stripes; the byte count stripeFile returns records how much of the last stripe
+// is file data. Where the file system refuses O_DIRECT the same path runs buffered.
+#define DIRECT_BATCH_STRIPES (256)
+#define DIRECT_DEFAULT_ALIGN (4096) // When the file system does not report an alignment
+
+static char *chunkName[5] =
+{
+    "StripeChunk1.bin", "StripeChunk2.bin", "StripeChunk3.bin", "StripeChunk4.bin", "StripeChunkXOR.bin"
+};
+
+// Direct I/O alignment for fd: what the file system reports through statx, the logical
+// block size of a block device, or DIRECT_DEFAULT_ALIGN
+static size_t directAlign(int fd)
+{
+    size_t align = 0;
+    struct stat st;
+    int blockSize;
+#ifdef STATX_DIOALIGN
+    struct statx stx;
+
+    if((statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0) && (stx.stx_mask & STATX_DIOALIGN))
+        align = (stx.stx_dio_mem_align > stx.stx_dio_offset_align) ? stx.stx_dio_mem_align : stx.stx_dio_offset_align;
+#endif
+
+    if((align == 0) && (fstat(fd, &st) == 0) && S_ISBLK(st.st_mode) && (ioctl(fd, BLKSSZGET, &blockSize) == 0))
+        align = blockSize;
+
+    if((align == 0) || (align & (align - 1)))
+        align = DIRECT_DEFAULT_ALIGN;
+
+    return ((align < SECTOR_SIZE) ? SECTOR_SIZE : align);
+}
+
+// Open the chunk files in openMask (bit i for chunk i + 1) with O_DIRECT, or without it
+// where the file system does not support it. Unopened entries are set to -1.
+static int openChunks(int *fd, int openMask, int flags)
 {
     int idx;
-    unsigned char checkParity;
 
-    #pragma omp parallel for // Parallelize loop for better performance
-    for(idx=0; idx<SECTOR_SIZE; idx++)
+    for(idx = 0; idx < 5; idx++)
     {
-        // Prefetch data to improve cache performance
-        __builtin_prefetch(&LBA1[idx + 16], 0, 1);
-        __builtin_prefetch(&LBA2[idx + 16], 0, 1);
-        __builtin_prefetch(&LBA3[idx + 16], 0, 1);
-        // Compute checkParity by XORing the available LBAs
-        checkParity = (*(LBA1+idx))^(*(LBA2+idx))^(*(LBA3+idx));
-
-        // Rebuild RLBA by XORing the parity LBA with the computed checkParity
-        *(RLBA+idx) = (*(PLBA+idx))^(checkParity);
+        fd[idx] = -1;
+        if(!(openMask & (1 << idx)))
+            continue;
+
+        if(((fd[idx] = open(chunkName[idx], flags | O_DIRECT, 00644)) < 0) && (errno == EINVAL))
+            fd[idx] = open(chunkName[idx], flags, 00644);
+
+        if(fd[idx] < 0)
+        {
+            perror(chunkName[idx]);
+            while(--idx >= 0)
+                if(fd[idx] >= 0) close(fd[idx]);
+            return ERROR;
+        }
     }
+
+    return OK;
+}
+
+// Write or read len bytes at pos, retrying short transfers. A read stops early at the
+// end of the file, which is an error only before need bytes have been read.
+static int writeChunk(int fd, unsigned char *buf, size_t len, off_t pos)
+{
+    ssize_t done;
+
+    while(len > 0)
+    {
+        if((done = pwrite(fd, buf, len, pos)) < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return ERROR;
+        }
+        buf += done;
+        pos += done;
+        len -= done;
+    }
+
+    return OK;
+}
+
+static int readChunk(int fd, unsigned char *buf, size_t len, size_t need, off_t pos)
+{
+    size_t got = 0;
+    ssize_t done;
+
+    while(got < len)
+    {
+        if((done = pread(fd, buf + got, len - got, pos + got)) < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return ERROR;
+        }
+        if(done == 0)
+            break;
+        got += done;
+    }
+
+    return ((got < need) ? ERROR : OK);
+}
+
+// Allocate batchBytes for each of the five chunks plus four times that to stage the
+// file's stripe-ordered data, all aligned for direct I/O with align
+static unsigned char *allocBatch(size_t align, size_t *batchBytes, unsigned char **unit, unsigned char **staging)
+{
+    void *buf;
+    int idx;
+
+    *batchBytes = ((DIRECT_BATCH_STRIPES * SECTOR_SIZE + align - 1) / align) * align;
+    if(posix_memalign(&buf, align, 9 * *batchBytes) != 0)
+        return NULL;
+
+    for(idx = 0; idx < 5; idx++)
+        unit[idx] = (unsigned char *)buf + idx * *batchBytes;
+    *staging = (unsigned char *)buf + 5 * *batchBytes;
+
+    return (unsigned char *)buf;
 }
 
 // Function to stripe a file across multiple RAID chunks
@@ -77,74 +261,88 @@ void rebuildLBA(unsigned char *LBA1,
 // Returns the number of bytes written or an error code
 int stripeFile(char *inputFileName, int offsetSectors)
 {
-    int fd[5], idx;
+    int fd[5], idx, chunk, stripeCnt = 0, batchCnt, rc = OK;
     FILE *fdin;
-    unsigned char stripe[5*512];
-    int offset=0, bread=0, btoread=(4*512), bwritten=0, btowrite=(512), sectorCnt=0, byteCnt=0;
+    unsigned char *buf, *unit[5], *staging;
+    size_t align, batchBytes, offset, bread, len, ioLen, byteCnt = 0;
 
     // Open the input file and create/open the RAID chunks for writing
-    fdin = fopen(inputFileName, "r");
-    fd[0] = open("StripeChunk1.bin", O_RDWR | O_CREAT | O_DIRECT, 00644);
-    fd[1] = open("StripeChunk2.bin", O_RDWR | O_CREAT | O_DIRECT, 00644);
-    fd[2] = open("StripeChunk3.bin", O_RDWR | O_CREAT | O_DIRECT, 00644);
-    fd[3] = open("StripeChunk4.bin", O_RDWR | O_CREAT | O_DIRECT, 00644);
-    fd[4] = open("StripeChunkXOR.bin", O_RDWR | O_CREAT | O_DIRECT, 00644);
-
-    do
+    if((fdin = fopen(inputFileName, "r")) == NULL)
+    {
+        perror(inputFileName);
+        return ERROR;
+    }
+
+    if(openChunks(fd, 0x1f, O_RDWR | O_CREAT | O_TRUNC) != OK)
     {
-        // Read a stripe (four chunks) or until the end of file
-        offset=0, bread=0, btoread=(4*512);
+        fclose(fdin);
+        return ERROR;
+    }
+
+    align = directAlign(fd[0]);
+    if((buf = allocBatch(align, &batchBytes, unit, &staging)) == NULL)
+        rc = ERROR;
+
+    while((rc == OK) && !feof(fdin))
+    {
+        // Read a batch of stripes (four sectors each) or until the end of file
+        offset = 0;
         do
         {
-            bread=fread(&stripe[offset], 1, btoread, fdin); 
-            offset+=bread;
-            btoread=(4*512)-bread;
+            bread = fread(&staging[offset], 1, 4 * batchBytes - offset, fdin);
+            offset += bread;
         }
-        while (!(feof(fdin)) && (btoread > 0));
+        while (!(feof(fdin)) && !(ferror(fdin)) && (offset < 4 * batchBytes));
 
-        // Zero-fill the remaining space if we reach the end of file with a partial stripe
-        if((offset < (4*512)) && (feof(fdin)))
+        if(ferror(fdin))
         {
-            bzero(&stripe[offset], btoread);
-            byteCnt+=offset;
+            perror(inputFileName);
+            rc = ERROR;
+            break;
         }
-        else
-        {
-            assert(offset == (4*512));
-            byteCnt+=(4*512);
-        };
+        if(offset == 0)
+            break;
 
-        // Compute XOR parity for the stripe
-        xorLBA(PTR_CAST &stripe[0],
-               PTR_CAST &stripe[512],
-               PTR_CAST &stripe[1024],
-               PTR_CAST &stripe[1536],
-               PTR_CAST &stripe[2048]);
+        // Zero-fill the remaining space of a partial stripe
+        byteCnt += offset;
+        batchCnt = (int)((offset + 4 * SECTOR_SIZE - 1) / (4 * SECTOR_SIZE));
+        bzero(&staging[offset], (size_t)batchCnt * 4 * SECTOR_SIZE - offset);
 
-        // Write out the stripe and its XOR parity chunk to the respective files
-        for (int i = 0; i < 5; i++)
+        // Split the stripes between the chunk buffers
+        len = (size_t)batchCnt * SECTOR_SIZE;
+        ioLen = ((len + align - 1) / align) * align;
+        for(idx = 0; idx < batchCnt; idx++)
+            for(chunk = 0; chunk < 4; chunk++)
+                memcpy(&unit[chunk][idx * SECTOR_SIZE], &staging[(idx * 4 + chunk) * SECTOR_SIZE], SECTOR_SIZE);
+
+        // Compute the XOR parity chunk of the whole batch in one pass
+        xorBlocks(unit, 4, unit[4], len);
+
+        // Write out the batch of each chunk, a short one padded to a whole block
+        for(chunk = 0; (chunk < 5) && (rc == OK); chunk++)
         {
-            offset = i * 512;
-            bwritten = 0;
-            btowrite = 512;
-            do
+            bzero(&unit[chunk][len], ioLen - len);
+            if(writeChunk(fd[chunk], unit[chunk], ioLen, (off_t)stripeCnt * SECTOR_SIZE) != OK)
             {
-                bwritten=write(fd[i], &stripe[offset], 512); 
-                offset+=bwritten;
-                btowrite=(512)-bwritten;
+                perror(chunkName[chunk]);
+                rc = ERROR;
             }
-            while (btowrite > 0);
         }
 
-        sectorCnt+=4;
+        stripeCnt += batchCnt;
+    }
 
-    } while (!(feof(fdin)));
+    // Cut the padding of the last batch back off
+    for(chunk = 0; (chunk < 5) && (rc == OK); chunk++)
+        if(ftruncate(fd[chunk], (off_t)stripeCnt * SECTOR_SIZE) != 0)
+            rc = ERROR;
 
     // Close all file descriptors
     fclose(fdin);
-    for(idx=0; idx < 5; idx++) close(fd[idx]);
+    for(idx = 0; idx < 5; idx++) close(fd[idx]);
+    free(buf);
 
-    return(byteCnt); // Return the total number of bytes written
+    return((rc == OK) ? (int)byteCnt : ERROR); // Return the total number of bytes written
 }
 
 // Function to restore a file from RAID chunks
@@ -153,171 +351,84 @@ int stripeFile(char *inputFileName, int offsetSectors)
 // Returns the number of bytes read or an error code
 int restoreFile(char *outputFileName, int offsetSectors, int fileLength, int missingChunk)
 {
-    int fd[5], idx;
+    int fd[5], idx, chunk, stripeIdx, batchCnt, rc = OK;
+    int stripeCnt = (fileLength + 4 * SECTOR_SIZE - 1) / (4 * SECTOR_SIZE);
     FILE *fdout;
-    unsigned char stripe[5*512];
-    int offset=0, bread=0, btoread=(4*512), bwritten=0, btowrite=(512), sectorCnt=fileLength/512;
-    int stripeCnt=fileLength/(4*512);
-    int lastStripeBytes = fileLength % (4*512);
-
-    // Open the output file for writing and the RAID chunks for reading
-    fdout = fopen(outputFileName, "w");
+    unsigned char *buf, *unit[5], *staging, *survivor[4];
+    size_t align, batchBytes, len, ioLen, remain = fileLength;
 
-    fd[0] = open("StripeChunk1.bin", O_RDWR | O_CREAT | O_DIRECT, 00644);
-    fd[1] = open("StripeChunk2.bin", O_RDWR | O_CREAT | O_DIRECT, 00644);
-    fd[2] = open("StripeChunk3.bin", O_RDWR | O_CREAT | O_DIRECT, 00644);
-    fd[3] = open("StripeChunk4.bin", O_RDWR | O_CREAT | O_DIRECT, 00644);
-    fd[4] = open("StripeChunkXOR.bin", O_RDWR | O_CREAT | O_DIRECT, 00644);
-
-    for(idx=0; idx < stripeCnt; idx++)
+    if((missingChunk < 0) || (missingChunk > 5))
     {
-        // Read in the stripe and its XOR parity chunk
-        for (int i = 0; i < 5; i++)
-        {
-            if (i+1 == missingChunk)
-            {
-                continue; // Skip reading if this chunk is missing
-            }
-
-            offset = i * 512;
-            bread = 0;
-            btoread = 512;
-            do
-            {
-                bread = read(fd[i], &stripe[offset], 512); 
-                offset += bread;
-                btoread = 512 - bread;
-            }
-            while (btoread > 0);
-        }
+        printf("restoreFile: cannot rebuild chunk %d\n", missingChunk);
+        return ERROR;
+    }
 
-        // Rebuild the missing chunk using the remaining chunks and the XOR parity
-        switch(missingChunk)
-        {
-            case 1:
-                rebuildLBA(PTR_CAST &stripe[512], 
-                           PTR_CAST &stripe[1024], 
-                           PTR_CAST &stripe[1536], 
-                           PTR_CAST &stripe[2048], 
-                           PTR_CAST &stripe[0]);
-                break;
-            case 2:
-                rebuildLBA(PTR_CAST &stripe[0], 
-                           PTR_CAST &stripe[1024], 
-                           PTR_CAST &stripe[1536], 
-                           PTR_CAST &stripe[2048], 
-                           PTR_CAST &stripe[512]);
-                break;
-            case 3:
-                rebuildLBA(PTR_CAST &stripe[0],
-                           PTR_CAST &stripe[512],
-                           PTR_CAST &stripe[1536],
-                           PTR_CAST &stripe[2048],
-                           PTR_CAST &stripe[1024]);
-                break;
-            case 4:
-                rebuildLBA(PTR_CAST &stripe[0],
-                           PTR_CAST &stripe[512],
-                           PTR_CAST &stripe[1024],
-                           PTR_CAST &stripe[2048],
-                           PTR_CAST &stripe[1536]);
-                break;
-            case 5:
-                rebuildLBA(PTR_CAST &stripe[0],
-                           PTR_CAST &stripe[512],
-                           PTR_CAST &stripe[1024],
-                           PTR_CAST &stripe[1536],
-                           PTR_CAST &stripe[2048]);
-                break;
-        }
+    // Open the output file for writing and the surviving RAID chunks for reading
+    if((fdout = fopen(outputFileName, "w")) == NULL)
+    {
+        perror(outputFileName);
+        return ERROR;
+    }
 
-        // Write the restored stripe to the output file
-        offset=0, bwritten=0, btowrite=(4*512);
-        do
-        {
-            bwritten=fwrite(&stripe[offset], 1, btowrite, fdout); 
-            offset+=bwritten;
-            btowrite=(4*512)-bwritten;
-        }
-        while ((btowrite > 0));
+    if(openChunks(fd, 0x1f & ~((missingChunk != 0) ? (1 << (missingChunk - 1)) : 0), O_RDONLY) != OK)
+    {
+        fclose(fdout);
+        return ERROR;
     }
 
-    if(lastStripeBytes)
+    align = directAlign(fd[(missingChunk == 1) ? 1 : 0]);
+    if((buf = allocBatch(align, &batchBytes, unit, &staging)) == NULL)
+        rc = ERROR;
+
+    for(stripeIdx = 0; (stripeIdx < stripeCnt) && (rc == OK); stripeIdx += batchCnt)
     {
-        // Read in the partial stripe and its XOR parity chunk
-        for (int i = 0; i < 5; i++)
-        {
-            if (i+1 == missingChunk)
-            {
-                continue; // Skip reading if this chunk is missing
-            }
+        batchCnt = (int)(batchBytes / SECTOR_SIZE);
+        if(batchCnt > stripeCnt - stripeIdx)
+            batchCnt = stripeCnt - stripeIdx;
 
-            offset = i * 512;
-            bread = 0;
-            btoread = 512;
-            do
+        // Read in the batch of each surviving chunk; the last one ends at the end of file
+        len = (size_t)batchCnt * SECTOR_SIZE;
+        ioLen = ((len + align - 1) / align) * align;
+        for(chunk = 0; (chunk < 5) && (rc == OK); chunk++)
+        {
+            if((fd[chunk] >= 0) && (readChunk(fd[chunk], unit[chunk], ioLen, len, (off_t)stripeIdx * SECTOR_SIZE) != OK))
             {
-                bread = read(fd[i], &stripe[offset], 512); 
-                offset += bread;
-                btoread = 512 - bread;
+                printf("restoreFile: read of %s failed at stripe %d\n", chunkName[chunk], stripeIdx);
+                rc = ERROR;
             }
-            while (btoread > 0);
         }
+        if(rc != OK)
+            break;
 
-        // Rebuild the missing chunk for the partial stripe
-        switch(missingChunk)
+        // Rebuild a missing data chunk from the other three and the XOR parity
+        if((missingChunk >= 1) && (missingChunk <= 4))
         {
-            case 1:
-                rebuildLBA(PTR_CAST &stripe[512], 
-                           PTR_CAST &stripe[1024], 
-                           PTR_CAST &stripe[1536], 
-                           PTR_CAST &stripe[2048], 
-                           PTR_CAST &stripe[0]);
-                break;
-            case 2:
-                rebuildLBA(PTR_CAST &stripe[0], 
-                           PTR_CAST &stripe[1024], 
-                           PTR_CAST &stripe[1536], 
-                           PTR_CAST &stripe[2048], 
-                           PTR_CAST &stripe[512]);
-                break;
-            case 3:
-                rebuildLBA(PTR_CAST &stripe[0],
-                           PTR_CAST &stripe[512],
-                           PTR_CAST &stripe[1536],
-                           PTR_CAST &stripe[2048],
-                           PTR_CAST &stripe[1024]);
-                break;
-            case 4:
-                rebuildLBA(PTR_CAST &stripe[0],
-                           PTR_CAST &stripe[512],
-                           PTR_CAST &stripe[1024],
-                           PTR_CAST &stripe[2048],
-                           PTR_CAST &stripe[1536]);
-                break;
-            case 5:
-                rebuildLBA(PTR_CAST &stripe[0],
-                           PTR_CAST &stripe[512],
-                           PTR_CAST &stripe[1024],
-                           PTR_CAST &stripe[1536],
-                           PTR_CAST &stripe[2048]);
-                break;
+            for(chunk = 0, idx = 0; chunk < 5; chunk++)
+                if(chunk + 1 != missingChunk)
+                    survivor[idx++] = unit[chunk];
+            xorBlocks(survivor, 4, unit[missingChunk - 1], len);
         }
 
-        // Write the restored partial stripe to the output file
-        offset=0, bwritten=0, btowrite=(lastStripeBytes);
-        do
+        // Put the data back in stripe order and write it to the output file
+        for(idx = 0; idx < batchCnt; idx++)
+            for(chunk = 0; chunk < 4; chunk++)
+                memcpy(&staging[(idx * 4 + chunk) * SECTOR_SIZE], &unit[chunk][idx * SECTOR_SIZE], SECTOR_SIZE);
+
+        len = ((size_t)batchCnt * 4 * SECTOR_SIZE < remain) ? (size_t)batchCnt * 4 * SECTOR_SIZE : remain;
+        if(fwrite(staging, 1, len, fdout) != len)
         {
-            bwritten=fwrite(&stripe[offset], 1, btowrite, fdout); 
-            offset+=bwritten;
-            btowrite=lastStripeBytes-bwritten;
+            perror(outputFileName);
+            rc = ERROR;
         }
-        while ((btowrite > 0));
+        remain -= len;
     }
 
     // Close all file descriptors
-    fclose(fdout);
-    for(idx=0; idx < 5; idx++) close(fd[idx]);
+    if(fclose(fdout) != 0)
+        rc = ERROR;
+    for(idx = 0; idx < 5; idx++)
+        if(fd[idx] >= 0) close(fd[idx]);
+    free(buf);
 
-    return(fileLength); // Return the total number of bytes read
+    return((rc == OK) ? fileLength : ERROR); // Return the total number of bytes read
 }
@@ -2,7 +2,6 @@
 #define RAIDLIB_H
 
 #include <unistd.h>
-#include <omp.h>  // Include OpenMP for parallelization if needed
 
 #define OK (0)
 #define ERROR (-1)
@@ -11,6 +10,8 @@
 
 #define SECTOR_SIZE (512)
 
+// Byte-wide LBA API, replaced by the word-wide API in raidlib64.h for RAID64 builds
+#ifndef RAID64
 // Function to compute XOR for RAID-5 encoding
 void xorLBA(unsigned char *LBA1,
             unsigned char *LBA2,
@@ -28,6 +29,29 @@ void rebuildLBA(unsigned char *LBA1,
 // Function to check if two LBAs are equivalent
 int checkEquivLBA(unsigned char *LBA1,
                   unsigned char *LBA2);
+#endif
+
+// N-way XOR parity over arbitrary-length regions
+//
+// xorBlocks computes dst = src[0] ^ ... ^ src[nsrc-1] over len bytes in one call, so an
+// 8+1 or 12+1 layout costs one pass over memory instead of one call per sector.
+// rebuildBlocks recovers a lost unit from the surviving data units and the parity unit.
+// dst may alias src[0]. Both use the runtime-dispatched kernels in raidsimd.c.
+void xorBlocks(unsigned char *const *src, int nsrc, unsigned char *dst, size_t len);
+void rebuildBlocks(unsigned char *const *survivors, int nsurvivors, unsigned char *parity,
+                   unsigned char *rebuilt, size_t len);
+
+// Stripe-batch parity across the persistent worker pool (raidpool.c)
+//
+// stripes points at stripeCnt consecutive stripes of STRIPE_BYTES each, laid out as in
+// stripeFile: 4 data sectors followed by the parity sector. xorStripeBatch fills in the
+// parity sector of every stripe; rebuildStripeBatch regenerates chunk missingChunk
+// (1 ... 4 data, 5 parity) of every stripe from the other four.
+#define STRIPE_BYTES (5 * SECTOR_SIZE)
+#define BATCH_MIN_STRIPES (64) // Smallest slice worth handing to another thread
+
+int xorStripeBatch(unsigned char *stripes, int stripeCnt);
+int rebuildStripeBatch(unsigned char *stripes, int stripeCnt, int missingChunk);
 
 // Function to stripe a file across multiple chunks
 int stripeFile(char *inputFileName, int offsetSectors);
@@ -0,0 +1,32 @@
+#ifndef RAIDLIB64_H
+#define RAIDLIB64_H
+
+// Word-wide RAID API, selected by building with -DRAID64 (make raid64)
+//
+// Same operations as the byte API in raidlib.h, but LBAs are passed as 64-bit words and
+// parity is computed 8 bytes at a time. This is the portable baseline for compilers or
+// architectures where the SIMD kernels in raidsimd.c are not available.
+
+#include "raidlib.h"
+
+#define WORD_SIZE (sizeof(unsigned long long))
+#define SECTOR_WORDS (SECTOR_SIZE / 8)
+
+// RAID-5 encoding, PLBA = LBA1 ^ LBA2 ^ LBA3 ^ LBA4
+void xorLBA(unsigned long long *LBA1,
+            unsigned long long *LBA2,
+            unsigned long long *LBA3,
+            unsigned long long *LBA4,
+            unsigned long long *PLBA);
+
+// RAID-5 rebuild of RLBA from any 3 of the original LBAs and the parity LBA
+void rebuildLBA(unsigned long long *LBA1,
+                unsigned long long *LBA2,
+                unsigned long long *LBA3,
+                unsigned long long *PLBA,
+                unsigned long long *RLBA);
+
+int checkEquivLBA(unsigned long long *LBA1,
+                  unsigned long long *LBA2);
+
+#endif
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "raidlib.h"
+#include "raidpool.h"
+
+#define MAX_POOL_THREADS (64)
+
+// Pool state, created once by poolStart()
+static pthread_once_t poolOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t runLock = PTHREAD_MUTEX_INITIALIZER;   // One batch in flight at a time
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;  // Protects the job fields below
+static pthread_cond_t workCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t doneCond = PTHREAD_COND_INITIALIZER;
+static int poolSize = 1; // Threads available to a batch, including the caller
+
+// Current batch, published under poolLock by bumping generation
+static unsigned long generation = 0;
+static raidPoolFn_t jobFn;
+static void *jobArg;
+static int jobCount, jobWorkers, pending;
+
+// Contiguous range of the batch owned by one worker
+static void sliceOf(int worker, int workers, int count, int *first, int *last)
+{
+    *first = (int)(((long long)count * worker) / workers);
+    *last = (int)(((long long)count * (worker + 1)) / workers);
+}
+
+static void *poolWorker(void *param)
+{
+    int worker = (int)(intptr_t)param;
+    unsigned long seen = 0;
+    raidPoolFn_t fn;
+    void *arg;
+    int count, workers, first, last;
+
+    for(;;)
+    {
+        pthread_mutex_lock(&poolLock);
+        while(generation == seen)
+            pthread_cond_wait(&workCond, &poolLock);
+        seen = generation;
+        fn = jobFn, arg = jobArg, count = jobCount, workers = jobWorkers;
+        pthread_mutex_unlock(&poolLock);
+
+        // Workers beyond this batch's width just go back to sleep
+        if(worker >= workers)
+            continue;
+
+        sliceOf(worker, workers, count, &first, &last);
+        fn(arg, first, last);
+
+        pthread_mutex_lock(&poolLock);
+        if(--pending == 0)
+            pthread_cond_signal(&doneCond);
+        pthread_mutex_unlock(&poolLock);
+    }
+
+    return NULL;
+}
+
+static void poolStart(void)
+{
+    pthread_t tid;
+    char *override = getenv("RAID_THREADS");
+    long want = sysconf(_SC_NPROCESSORS_ONLN);
+    int idx;
+
+    if(override != NULL)
+        want = atol(override);
+    if(want < 1)
+        want = 1;
+    if(want > MAX_POOL_THREADS)
+        want = MAX_POOL_THREADS;
+
+    // The caller works slice 0, so only want-1 threads are created
+    for(idx = 1; idx < want; idx++)
+    {
+        if(pthread_create(&tid, NULL, poolWorker, (void *)(intptr_t)idx) != 0)
+        {
+            perror("raidpool: pthread_create");
+            break;
+        }
+        pthread_detach(tid);
+    }
+
+    poolSize = idx;
+}
+
+int raidPoolThreads(void)
+{
+    pthread_once(&poolOnce, poolStart);
+    return poolSize;
+}
+
+int raidPoolRun(raidPoolFn_t fn, void *arg, int count, int minPerThread)
+{
+    int workers, first, last;
+
+    if(count <= 0)
+        return OK;
+
+    workers = raidPoolThreads();
+    if((minPerThread > 0) && ((count / minPerThread) < workers))
+        workers = count / minPerThread;
+
+    // Too little work to be worth a wakeup
+    if(workers <= 1)
+    {
+        fn(arg, 0, count);
+        return OK;
+    }
+
+    pthread_mutex_lock(&runLock);
+
+    pthread_mutex_lock(&poolLock);
+    jobFn = fn, jobArg = arg, jobCount = count, jobWorkers = workers;
+    pending = workers - 1;
+    generation++;
+    pthread_cond_broadcast(&workCond);
+    pthread_mutex_unlock(&poolLock);
+
+    sliceOf(0, workers, count, &first, &last);
+    fn(arg, first, last);
+
+    pthread_mutex_lock(&poolLock);
+    while(pending > 0)
+        pthread_cond_wait(&doneCond, &poolLock);
+    pthread_mutex_unlock(&poolLock);
+
+    pthread_mutex_unlock(&runLock);
+
+    return OK;
+}
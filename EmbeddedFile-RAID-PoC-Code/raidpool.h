@@ -0,0 +1,22 @@
+#ifndef RAIDPOOL_H
+#define RAIDPOOL_H
+
+// Persistent worker pool for stripe-batch parity
+//
+// Threads are created once, on first use, and then parked on a condition variable between
+// batches, so a batch costs one wakeup per worker instead of a fork/join of a new team.
+
+// Work function: process items [first, last) of the batch
+typedef void (*raidPoolFn_t)(void *arg, int first, int last);
+
+// Split count items into contiguous ranges across the pool and wait for all of them.
+// Batches smaller than minPerThread items per worker use fewer workers, down to running
+// inline on the caller. Always returns OK: when no workers could be started, the whole
+// batch runs inline.
+int raidPoolRun(raidPoolFn_t fn, void *arg, int count, int minPerThread);
+
+// Number of threads a batch can be spread across, including the caller.
+// Defaults to the number of online CPUs; RAID_THREADS=<n> overrides it.
+int raidPoolThreads(void);
+
+#endif
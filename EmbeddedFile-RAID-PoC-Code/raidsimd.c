@@ -0,0 +1,429 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "raidlib.h"
+#include "raidsimd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RAID_X86 (1)
+#include <immintrin.h>
+#endif
+
+// Runtime-dispatched XOR parity kernels
+//
+// Every kernel is compiled for its own instruction set with a target attribute, so the
+// library itself is built for the baseline architecture and one binary runs on every host.
+// The best kernel the CPU supports is selected once at load time.
+
+// Portable kernel, 64 bits at a time with a byte tail
+static void xor4Scalar(const unsigned char *LBA1,
+                       const unsigned char *LBA2,
+                       const unsigned char *LBA3,
+                       const unsigned char *LBA4,
+                       unsigned char *PLBA,
+                       size_t len)
+{
+    size_t idx = 0;
+    uint64_t w1, w2, w3, w4;
+
+    for(; idx + 8 <= len; idx += 8)
+    {
+        // memcpy keeps unaligned access legal and compiles to a single load
+        memcpy(&w1, LBA1 + idx, 8);
+        memcpy(&w2, LBA2 + idx, 8);
+        memcpy(&w3, LBA3 + idx, 8);
+        memcpy(&w4, LBA4 + idx, 8);
+        w1 ^= w2 ^ w3 ^ w4;
+        memcpy(PLBA + idx, &w1, 8);
+    }
+
+    for(; idx < len; idx++)
+        PLBA[idx] = LBA1[idx] ^ LBA2[idx] ^ LBA3[idx] ^ LBA4[idx];
+}
+
+// Portable N-way kernel, four 64-bit accumulators per iteration
+static void xorNScalar(const unsigned char *const *src,
+                       int nsrc,
+                       unsigned char *dst,
+                       size_t len,
+                       int accumulate)
+{
+    size_t idx = 0;
+    int sidx, first;
+    uint64_t a0, a1, a2, a3, w[4];
+    unsigned char b;
+
+    for(; idx + 32 <= len; idx += 32)
+    {
+        memcpy(w, (accumulate ? dst : src[0]) + idx, 32);
+        a0 = w[0]; a1 = w[1]; a2 = w[2]; a3 = w[3];
+
+        for(sidx = (accumulate ? 0 : 1); sidx < nsrc; sidx++)
+        {
+            memcpy(w, src[sidx] + idx, 32);
+            a0 ^= w[0]; a1 ^= w[1]; a2 ^= w[2]; a3 ^= w[3];
+        }
+
+        w[0] = a0; w[1] = a1; w[2] = a2; w[3] = a3;
+        memcpy(dst + idx, w, 32);
+    }
+
+    first = accumulate ? 0 : 1;
+    for(; idx < len; idx++)
+    {
+        b = accumulate ? dst[idx] : src[0][idx];
+        for(sidx = first; sidx < nsrc; sidx++)
+            b ^= src[sidx][idx];
+        dst[idx] = b;
+    }
+}
+
+// Advance every source pointer past the part a wide kernel has already handled
+static void offsetSources(const unsigned char *const *src, int nsrc, size_t offset,
+                          const unsigned char **tail)
+{
+    int sidx;
+
+    for(sidx = 0; sidx < nsrc; sidx++)
+        tail[sidx] = src[sidx] + offset;
+}
+
+static int alwaysSupported(void)
+{
+    return TRUE;
+}
+
+#ifdef RAID_X86
+
+__attribute__((target("sse2")))
+static void xor4SSE2(const unsigned char *LBA1,
+                     const unsigned char *LBA2,
+                     const unsigned char *LBA3,
+                     const unsigned char *LBA4,
+                     unsigned char *PLBA,
+                     size_t len)
+{
+    size_t idx = 0;
+    __m128i v;
+
+    for(; idx + 16 <= len; idx += 16)
+    {
+        v = _mm_loadu_si128((const __m128i *)(LBA1 + idx));
+        v = _mm_xor_si128(v, _mm_loadu_si128((const __m128i *)(LBA2 + idx)));
+        v = _mm_xor_si128(v, _mm_loadu_si128((const __m128i *)(LBA3 + idx)));
+        v = _mm_xor_si128(v, _mm_loadu_si128((const __m128i *)(LBA4 + idx)));
+        _mm_storeu_si128((__m128i *)(PLBA + idx), v);
+    }
+
+    xor4Scalar(LBA1 + idx, LBA2 + idx, LBA3 + idx, LBA4 + idx, PLBA + idx, len - idx);
+}
+
+__attribute__((target("avx2")))
+static void xor4AVX2(const unsigned char *LBA1,
+                     const unsigned char *LBA2,
+                     const unsigned char *LBA3,
+                     const unsigned char *LBA4,
+                     unsigned char *PLBA,
+                     size_t len)
+{
+    size_t idx = 0;
+    __m256i v;
+
+    for(; idx + 32 <= len; idx += 32)
+    {
+        v = _mm256_loadu_si256((const __m256i *)(LBA1 + idx));
+        v = _mm256_xor_si256(v, _mm256_loadu_si256((const __m256i *)(LBA2 + idx)));
+        v = _mm256_xor_si256(v, _mm256_loadu_si256((const __m256i *)(LBA3 + idx)));
+        v = _mm256_xor_si256(v, _mm256_loadu_si256((const __m256i *)(LBA4 + idx)));
+        _mm256_storeu_si256((__m256i *)(PLBA + idx), v);
+    }
+
+    // vzeroupper before handing back to SSE/scalar code
+    _mm256_zeroupper();
+    xor4SSE2(LBA1 + idx, LBA2 + idx, LBA3 + idx, LBA4 + idx, PLBA + idx, len - idx);
+}
+
+__attribute__((target("avx512f")))
+static void xor4AVX512(const unsigned char *LBA1,
+                       const unsigned char *LBA2,
+                       const unsigned char *LBA3,
+                       const unsigned char *LBA4,
+                       unsigned char *PLBA,
+                       size_t len)
+{
+    size_t idx = 0;
+    __m512i v;
+
+    for(; idx + 64 <= len; idx += 64)
+    {
+        v = _mm512_loadu_si512((const void *)(LBA1 + idx));
+        v = _mm512_xor_si512(v, _mm512_loadu_si512((const void *)(LBA2 + idx)));
+        v = _mm512_xor_si512(v, _mm512_loadu_si512((const void *)(LBA3 + idx)));
+        v = _mm512_xor_si512(v, _mm512_loadu_si512((const void *)(LBA4 + idx)));
+        _mm512_storeu_si512((void *)(PLBA + idx), v);
+    }
+
+    _mm256_zeroupper();
+    xor4SSE2(LBA1 + idx, LBA2 + idx, LBA3 + idx, LBA4 + idx, PLBA + idx, len - idx);
+}
+
+__attribute__((target("sse2")))
+static void xorNSSE2(const unsigned char *const *src,
+                     int nsrc,
+                     unsigned char *dst,
+                     size_t len,
+                     int accumulate)
+{
+    size_t idx = 0;
+    int sidx;
+    const unsigned char *first, *tail[XOR_GROUP];
+    __m128i a0, a1, a2, a3;
+
+    for(; idx + 64 <= len; idx += 64)
+    {
+        first = (accumulate ? dst : src[0]) + idx;
+        a0 = _mm_loadu_si128((const __m128i *)(first));
+        a1 = _mm_loadu_si128((const __m128i *)(first + 16));
+        a2 = _mm_loadu_si128((const __m128i *)(first + 32));
+        a3 = _mm_loadu_si128((const __m128i *)(first + 48));
+
+        for(sidx = (accumulate ? 0 : 1); sidx < nsrc; sidx++)
+        {
+            a0 = _mm_xor_si128(a0, _mm_loadu_si128((const __m128i *)(src[sidx] + idx)));
+            a1 = _mm_xor_si128(a1, _mm_loadu_si128((const __m128i *)(src[sidx] + idx + 16)));
+            a2 = _mm_xor_si128(a2, _mm_loadu_si128((const __m128i *)(src[sidx] + idx + 32)));
+            a3 = _mm_xor_si128(a3, _mm_loadu_si128((const __m128i *)(src[sidx] + idx + 48)));
+        }
+
+        _mm_storeu_si128((__m128i *)(dst + idx), a0);
+        _mm_storeu_si128((__m128i *)(dst + idx + 16), a1);
+        _mm_storeu_si128((__m128i *)(dst + idx + 32), a2);
+        _mm_storeu_si128((__m128i *)(dst + idx + 48), a3);
+    }
+
+    offsetSources(src, nsrc, idx, tail);
+    xorNScalar(tail, nsrc, dst + idx, len - idx, accumulate);
+}
+
+__attribute__((target("avx2")))
+static void xorNAVX2(const unsigned char *const *src,
+                     int nsrc,
+                     unsigned char *dst,
+                     size_t len,
+                     int accumulate)
+{
+    size_t idx = 0;
+    int sidx;
+    const unsigned char *first, *tail[XOR_GROUP];
+    __m256i a0, a1, a2, a3;
+
+    for(; idx + 128 <= len; idx += 128)
+    {
+        first = (accumulate ? dst : src[0]) + idx;
+        a0 = _mm256_loadu_si256((const __m256i *)(first));
+        a1 = _mm256_loadu_si256((const __m256i *)(first + 32));
+        a2 = _mm256_loadu_si256((const __m256i *)(first + 64));
+        a3 = _mm256_loadu_si256((const __m256i *)(first + 96));
+
+        for(sidx = (accumulate ? 0 : 1); sidx < nsrc; sidx++)
+        {
+            a0 = _mm256_xor_si256(a0, _mm256_loadu_si256((const __m256i *)(src[sidx] + idx)));
+            a1 = _mm256_xor_si256(a1, _mm256_loadu_si256((const __m256i *)(src[sidx] + idx + 32)));
+            a2 = _mm256_xor_si256(a2, _mm256_loadu_si256((const __m256i *)(src[sidx] + idx + 64)));
+            a3 = _mm256_xor_si256(a3, _mm256_loadu_si256((const __m256i *)(src[sidx] + idx + 96)));
+        }
+
+        _mm256_storeu_si256((__m256i *)(dst + idx), a0);
+        _mm256_storeu_si256((__m256i *)(dst + idx + 32), a1);
+        _mm256_storeu_si256((__m256i *)(dst + idx + 64), a2);
+        _mm256_storeu_si256((__m256i *)(dst + idx + 96), a3);
+    }
+
+    _mm256_zeroupper();
+    offsetSources(src, nsrc, idx, tail);
+    xorNSSE2(tail, nsrc, dst + idx, len - idx, accumulate);
+}
+
+__attribute__((target("avx512f")))
+static void xorNAVX512(const unsigned char *const *src,
+                       int nsrc,
+                       unsigned char *dst,
+                       size_t len,
+                       int accumulate)
+{
+    size_t idx = 0;
+    int sidx;
+    const unsigned char *first, *tail[XOR_GROUP];
+    __m512i a0, a1, a2, a3;
+
+    for(; idx + 256 <= len; idx += 256)
+    {
+        first = (accumulate ? dst : src[0]) + idx;
+        a0 = _mm512_loadu_si512((const void *)(first));
+        a1 = _mm512_loadu_si512((const void *)(first + 64));
+        a2 = _mm512_loadu_si512((const void *)(first + 128));
+        a3 = _mm512_loadu_si512((const void *)(first + 192));
+
+        for(sidx = (accumulate ? 0 : 1); sidx < nsrc; sidx++)
+        {
+            a0 = _mm512_xor_si512(a0, _mm512_loadu_si512((const void *)(src[sidx] + idx)));
+            a1 = _mm512_xor_si512(a1, _mm512_loadu_si512((const void *)(src[sidx] + idx + 64)));
+            a2 = _mm512_xor_si512(a2, _mm512_loadu_si512((const void *)(src[sidx] + idx + 128)));
+            a3 = _mm512_xor_si512(a3, _mm512_loadu_si512((const void *)(src[sidx] + idx + 192)));
+        }
+
+        _mm512_storeu_si512((void *)(dst + idx), a0);
+        _mm512_storeu_si512((void *)(dst + idx + 64), a1);
+        _mm512_storeu_si512((void *)(dst + idx + 128), a2);
+        _mm512_storeu_si512((void *)(dst + idx + 192), a3);
+    }
+
+    _mm256_zeroupper();
+    offsetSources(src, nsrc, idx, tail);
+    xorNSSE2(tail, nsrc, dst + idx, len - idx, accumulate);
+}
+
+static int sse2Supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2") ? TRUE : FALSE;
+}
+
+static int avx2Supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? TRUE : FALSE;
+}
+
+static int avx512Supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") ? TRUE : FALSE;
+}
+
+#endif
+
+// Kernel table, ordered from least to most preferred
+static const raidkernel_t kernelTable[] =
+{
+    { "scalar", xor4Scalar, xorNScalar, alwaysSupported },
+#ifdef RAID_X86
+    { "sse2",   xor4SSE2,   xorNSSE2,   sse2Supported },
+    { "avx2",   xor4AVX2,   xorNAVX2,   avx2Supported },
+    { "avx512", xor4AVX512, xorNAVX512, avx512Supported },
+#endif
+};
+
+#define KERNEL_COUNT ((int)(sizeof(kernelTable) / sizeof(kernelTable[0])))
+
+static int activeKernel = 0;
+
+xorKernel_t raidXor4 = xor4Scalar;
+xorNKernel_t raidXorN = xorNScalar;
+
+int raidKernelCount(void)
+{
+    return KERNEL_COUNT;
+}
+
+const raidkernel_t *raidKernelInfo(int kernelIdx)
+{
+    if((kernelIdx < 0) || (kernelIdx >= KERNEL_COUNT))
+        return NULL;
+
+    return &kernelTable[kernelIdx];
+}
+
+const char *raidActiveKernel(void)
+{
+    return kernelTable[activeKernel].name;
+}
+
+int raidSelectKernel(const char *name)
+{
+    int idx;
+
+    for(idx = 0; idx < KERNEL_COUNT; idx++)
+    {
+        if((strcmp(kernelTable[idx].name, name) == 0) && kernelTable[idx].supported())
+        {
+            activeKernel = idx;
+            raidXor4 = kernelTable[idx].xor4;
+            raidXorN = kernelTable[idx].xorN;
+            return OK;
+        }
+    }
+
+    return ERROR;
+}
+
+// Pick the widest supported kernel before main() runs
+__attribute__((constructor))
+static void raidKernelInit(void)
+{
+    int idx;
+    char *override = getenv("RAID_KERNEL");
+
+    for(idx = KERNEL_COUNT - 1; idx >= 0; idx--)
+    {
+        if(kernelTable[idx].supported())
+        {
+            activeKernel = idx;
+            raidXor4 = kernelTable[idx].xor4;
+            raidXorN = kernelTable[idx].xorN;
+            break;
+        }
+    }
+
+    // Allow a host to be pinned to a narrower kernel, e.g. RAID_KERNEL=sse2
+    if((override != NULL) && (raidSelectKernel(override) == ERROR))
+        fprintf(stderr, "RAID_KERNEL=%s not supported, using %s\n", override, raidActiveKernel());
+}
+
+// N-way XOR driver
+//
+// Walks the buffers one XOR_BLOCK at a time. Within a block, sources are consumed in groups
+// of XOR_GROUP streams: the first group stores into dst and later groups accumulate into it
+// while it is still cache resident. extra, if not NULL, is XORed in as one more source.
+static void xorBlocksExtra(unsigned char *const *src, int nsrc, unsigned char *extra,
+                           unsigned char *dst, size_t len)
+{
+    const unsigned char *group[XOR_GROUP];
+    size_t offset, blockLen;
+    int total = nsrc + ((extra != NULL) ? 1 : 0);
+    int first, cnt, sidx;
+
+    if(total == 0)
+    {
+        memset(dst, 0, len);
+        return;
+    }
+
+    for(offset = 0; offset < len; offset += blockLen)
+    {
+        blockLen = ((len - offset) < XOR_BLOCK) ? (len - offset) : XOR_BLOCK;
+
+        for(first = 0; first < total; first += cnt)
+        {
+            cnt = ((total - first) < XOR_GROUP) ? (total - first) : XOR_GROUP;
+
+            for(sidx = 0; sidx < cnt; sidx++)
+                group[sidx] = ((first + sidx) < nsrc ? src[first + sidx] : extra) + offset;
+
+            raidXorN(group, cnt, dst + offset, blockLen, (first > 0) ? TRUE : FALSE);
+        }
+    }
+}
+
+void xorBlocks(unsigned char *const *src, int nsrc, unsigned char *dst, size_t len)
+{
+    xorBlocksExtra(src, nsrc, NULL, dst, len);
+}
+
+void rebuildBlocks(unsigned char *const *survivors, int nsurvivors, unsigned char *parity,
+                   unsigned char *rebuilt, size_t len)
+{
+    xorBlocksExtra(survivors, nsurvivors, parity, rebuilt, len);
+}
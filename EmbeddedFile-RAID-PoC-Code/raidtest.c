@@ -1,4 +1,9 @@
 #include "raidtest.h"
+#include "raidsimd.h"
+#include "raidpool.h"
+
+// Multi-block length for the N-way test, not a multiple of any vector width
+#define WIDE_LEN ((3 * XOR_BLOCK) + 77)
 
 // Function to modify the contents of a buffer by adding an offset to each byte
 void modifyBuffer(unsigned char *bufferToModify, int offset)
@@ -34,6 +39,12 @@ void dumpBuffer(unsigned char *bufferToDump)
 int main(int argc, char *argv[])
 {
     int idx, LBAidx, numTestIterations, rc;
+    int kernelIdx;
+    size_t len;
+    const raidkernel_t *kernel;
+    int nsrc;
+    unsigned char *wide[13], *parity, *rebuilt, check;
+    unsigned char *batch, *expected;
     int written=0, fd[5];
     int fdrebuild;
     double rate=0.0;
@@ -156,5 +167,94 @@ int main(int argc, char *argv[])
     }
     printf("\n");
 
+    // TEST CASE #3: Every dispatched XOR kernel must match the scalar kernel
+    // on unaligned buffers and lengths that are not a multiple of the vector width
+    printf("TEST CASE 3 (XOR kernel cross-check, active kernel = %s):\n", raidActiveKernel());
+    for(kernelIdx = 1; kernelIdx < raidKernelCount(); kernelIdx++)
+    {
+        kernel = raidKernelInfo(kernelIdx);
+        if(!kernel->supported())
+            continue;
+
+        printf("%s ", kernel->name);
+        for(len = 0; len < (3 * SECTOR_SIZE); len += 37)
+        {
+            raidKernelInfo(0)->xor4(&testLBA1[0][1], &testLBA2[0][3], &testLBA3[0][5], &testLBA4[0][7],
+                                    (unsigned char *)&testPLBA[0][0], len);
+            kernel->xor4(&testLBA1[0][1], &testLBA2[0][3], &testLBA3[0][5], &testLBA4[0][7],
+                         &testRebuild[0][1], len);
+            assert(memcmp(&testPLBA[0][0], &testRebuild[0][1], len) == 0);
+        }
+    }
+    printf("\n");
+
+
+    // TEST CASE #4: N-way XOR over multi-block regions against a byte-at-a-time reference,
+    // including rebuild of each unit from the survivors and parity
+    printf("TEST CASE 4 (N-way xorBlocks/rebuildBlocks):\n");
+    for(nsrc = 1; nsrc <= 13; nsrc++)
+    {
+        printf("%d ", nsrc);
+        for(idx = 0; idx < nsrc; idx++)
+        {
+            wide[idx] = (unsigned char *)malloc(WIDE_LEN + 1) + 1;   // deliberately misaligned
+            for(len = 0; len < WIDE_LEN; len++)
+                wide[idx][len] = (unsigned char)((len * 31) + (idx * 7) + (len >> 9));
+        }
+        parity = malloc(WIDE_LEN);
+        rebuilt = malloc(WIDE_LEN);
+
+        xorBlocks(wide, nsrc, parity, WIDE_LEN);
+        for(len = 0; len < WIDE_LEN; len++)
+        {
+            check = 0;
+            for(idx = 0; idx < nsrc; idx++)
+                check ^= wide[idx][len];
+            assert(parity[len] == check);
+        }
+
+        // Rebuild the last unit from the first nsrc-1 and the parity
+        rebuildBlocks(wide, nsrc - 1, parity, rebuilt, WIDE_LEN);
+        assert(memcmp(rebuilt, wide[nsrc - 1], WIDE_LEN) == 0);
+
+        for(idx = 0; idx < nsrc; idx++)
+            free(wide[idx] - 1);
+        free(parity);
+        free(rebuilt);
+    }
+    printf("\n");
+
+    // TEST CASE #5: Stripe-batch encode and rebuild of every chunk position
+    printf("TEST CASE 5 (stripe-batch parity, %d threads):\n", raidPoolThreads());
+    batch = malloc((size_t)MAX_LBAS * STRIPE_BYTES);
+    for(idx = 0; idx < MAX_LBAS; idx++)
+    {
+        memcpy(batch + ((size_t)idx * STRIPE_BYTES), &testLBA1[idx], SECTOR_SIZE);
+        memcpy(batch + ((size_t)idx * STRIPE_BYTES) + SECTOR_SIZE, &testLBA2[idx], SECTOR_SIZE);
+        memcpy(batch + ((size_t)idx * STRIPE_BYTES) + (2 * SECTOR_SIZE), &testLBA3[idx], SECTOR_SIZE);
+        memcpy(batch + ((size_t)idx * STRIPE_BYTES) + (3 * SECTOR_SIZE), &testLBA4[idx], SECTOR_SIZE);
+    }
+    xorStripeBatch(batch, MAX_LBAS);
+    for(idx = 0; idx < MAX_LBAS; idx++)
+    {
+        xorLBA(PTR_CAST &testLBA1[idx], PTR_CAST &testLBA2[idx], PTR_CAST &testLBA3[idx],
+               PTR_CAST &testLBA4[idx], PTR_CAST &testPLBA[idx]);
+        assert(memcmp(batch + ((size_t)idx * STRIPE_BYTES) + (4 * SECTOR_SIZE), &testPLBA[idx], SECTOR_SIZE) == 0);
+    }
+
+    expected = malloc((size_t)MAX_LBAS * STRIPE_BYTES);
+    memcpy(expected, batch, (size_t)MAX_LBAS * STRIPE_BYTES);
+    for(nsrc = 1; nsrc <= 5; nsrc++)
+    {
+        printf("%d ", nsrc);
+        for(idx = 0; idx < MAX_LBAS; idx++)
+            memset(batch + ((size_t)idx * STRIPE_BYTES) + ((nsrc - 1) * SECTOR_SIZE), 0xFF, SECTOR_SIZE);
+        rebuildStripeBatch(batch, MAX_LBAS, nsrc);
+        assert(memcmp(batch, expected, (size_t)MAX_LBAS * STRIPE_BYTES) == 0);
+    }
+    free(batch);
+    free(expected);
+    printf("\n");
+
     printf("FINISHED\n");
 }
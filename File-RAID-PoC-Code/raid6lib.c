@@ -0,0 +1,495 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "raidlib.h"
+#include "raidsimd.h"
+#include "raid6lib.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RAID_X86 (1)
+#include <immintrin.h>
+#endif
+
+#define GF_POLY (0x11d)
+
+// Log/antilog tables; gfExp is doubled so gfExp[log a + log b] needs no modulo
+static unsigned char gfExp[512];
+static unsigned char gfLog[256];
+
+// Per-coefficient nibble tables: [c][0..15] = c * x, [c][16..31] = c * (x << 4)
+static unsigned char gfNibble[256][32];
+
+unsigned char gfMul(unsigned char a, unsigned char b)
+{
+    if((a == 0) || (b == 0))
+        return 0;
+
+    return gfExp[gfLog[a] + gfLog[b]];
+}
+
+unsigned char gfInv(unsigned char a)
+{
+    // 0 has no inverse; callers never ask for it
+    return gfExp[255 - gfLog[a]];
+}
+
+unsigned char gfPow2(int power)
+{
+    power %= 255;
+    if(power < 0)
+        power += 255;
+
+    return gfExp[power];
+}
+
+// GF dot-product kernel
+//
+// dst = c0*src[0] ^ c1*src[1] ^ ... over len bytes, where tbl[i] is the nibble table of ci.
+// If xorDst is not NULL it also receives the plain XOR of the sources, so P and Q come
+// out of a single pass over the data. With accumulate set, both outputs are XORed into
+// instead of overwritten. nsrc is at most XOR_GROUP.
+typedef void (*gfDotKernel_t)(const unsigned char *const *src,
+                              const unsigned char *const *tbl,
+                              int nsrc,
+                              unsigned char *dst,
+                              unsigned char *xorDst,
+                              size_t len,
+                              int accumulate);
+
+static void gfDotScalar(const unsigned char *const *src,
+                        const unsigned char *const *tbl,
+                        int nsrc,
+                        unsigned char *dst,
+                        unsigned char *xorDst,
+                        size_t len,
+                        int accumulate)
+{
+    size_t idx;
+    int sidx;
+    unsigned char d, q, p;
+
+    for(idx = 0; idx < len; idx++)
+    {
+        q = accumulate ? dst[idx] : 0;
+        p = (accumulate && xorDst) ? xorDst[idx] : 0;
+
+        for(sidx = 0; sidx < nsrc; sidx++)
+        {
+            d = src[sidx][idx];
+            q ^= tbl[sidx][d & 0x0f] ^ tbl[sidx][16 + (d >> 4)];
+            p ^= d;
+        }
+
+        dst[idx] = q;
+        if(xorDst)
+            xorDst[idx] = p;
+    }
+}
+
+#ifdef RAID_X86
+
+// Hand the sub-vector tail of a SIMD kernel to the scalar kernel
+static void gfDotTail(const unsigned char *const *src, const unsigned char *const *tbl, int nsrc,
+                      unsigned char *dst, unsigned char *xorDst, size_t idx, size_t len, int accumulate)
+{
+    const unsigned char *tail[XOR_GROUP];
+    int sidx;
+
+    if(idx >= len)
+        return;
+
+    for(sidx = 0; sidx < nsrc; sidx++)
+        tail[sidx] = src[sidx] + idx;
+
+    gfDotScalar(tail, tbl, nsrc, dst + idx, xorDst ? xorDst + idx : NULL, len - idx, accumulate);
+}
+
+__attribute__((target("ssse3")))
+static void gfDotSSSE3(const unsigned char *const *src,
+                       const unsigned char *const *tbl,
+                       int nsrc,
+                       unsigned char *dst,
+                       unsigned char *xorDst,
+                       size_t len,
+                       int accumulate)
+{
+    size_t idx = 0;
+    int sidx;
+    __m128i mask = _mm_set1_epi8(0x0f);
+    __m128i d, q, p, lo, hi;
+
+    for(; idx + 16 <= len; idx += 16)
+    {
+        q = accumulate ? _mm_loadu_si128((const __m128i *)(dst + idx)) : _mm_setzero_si128();
+        p = (accumulate && xorDst) ? _mm_loadu_si128((const __m128i *)(xorDst + idx)) : _mm_setzero_si128();
+
+        for(sidx = 0; sidx < nsrc; sidx++)
+        {
+            d = _mm_loadu_si128((const __m128i *)(src[sidx] + idx));
+            lo = _mm_and_si128(d, mask);
+            hi = _mm_and_si128(_mm_srli_epi64(d, 4), mask);
+            lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)tbl[sidx]), lo);
+            hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(tbl[sidx] + 16)), hi);
+            q = _mm_xor_si128(q, _mm_xor_si128(lo, hi));
+            p = _mm_xor_si128(p, d);
+        }
+
+        _mm_storeu_si128((__m128i *)(dst + idx), q);
+        if(xorDst)
+            _mm_storeu_si128((__m128i *)(xorDst + idx), p);
+    }
+
+    gfDotTail(src, tbl, nsrc, dst, xorDst, idx, len, accumulate);
+}
+
+__attribute__((target("avx2")))
+static void gfDotAVX2(const unsigned char *const *src,
+                      const unsigned char *const *tbl,
+                      int nsrc,
+                      unsigned char *dst,
+                      unsigned char *xorDst,
+                      size_t len,
+                      int accumulate)
+{
+    size_t idx = 0;
+    int sidx;
+    __m256i mask = _mm256_set1_epi8(0x0f);
+    __m256i tlo[XOR_GROUP], thi[XOR_GROUP];
+    __m256i d, q, p, lo, hi;
+
+    // Broadcast each 16-byte nibble table into both 128-bit lanes once per call
+    for(sidx = 0; sidx < nsrc; sidx++)
+    {
+        tlo[sidx] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)tbl[sidx]));
+        thi[sidx] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(tbl[sidx] + 16)));
+    }
+
+    for(; idx + 32 <= len; idx += 32)
+    {
+        q = accumulate ? _mm256_loadu_si256((const __m256i *)(dst + idx)) : _mm256_setzero_si256();
+        p = (accumulate && xorDst) ? _mm256_loadu_si256((const __m256i *)(xorDst + idx)) : _mm256_setzero_si256();
+
+        for(sidx = 0; sidx < nsrc; sidx++)
+        {
+            d = _mm256_loadu_si256((const __m256i *)(src[sidx] + idx));
+            lo = _mm256_shuffle_epi8(tlo[sidx], _mm256_and_si256(d, mask));
+            hi = _mm256_shuffle_epi8(thi[sidx], _mm256_and_si256(_mm256_srli_epi64(d, 4), mask));
+            q = _mm256_xor_si256(q, _mm256_xor_si256(lo, hi));
+            p = _mm256_xor_si256(p, d);
+        }
+
+        _mm256_storeu_si256((__m256i *)(dst + idx), q);
+        if(xorDst)
+            _mm256_storeu_si256((__m256i *)(xorDst + idx), p);
+    }
+
+    _mm256_zeroupper();
+    gfDotTail(src, tbl, nsrc, dst, xorDst, idx, len, accumulate);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void gfDotAVX512(const unsigned char *const *src,
+                        const unsigned char *const *tbl,
+                        int nsrc,
+                        unsigned char *dst,
+                        unsigned char *xorDst,
+                        size_t len,
+                        int accumulate)
+{
+    size_t idx = 0;
+    int sidx;
+    __m512i mask = _mm512_set1_epi8(0x0f);
+    __m512i tlo[XOR_GROUP], thi[XOR_GROUP];
+    __m512i d, q, p, lo, hi;
+
+    for(sidx = 0; sidx < nsrc; sidx++)
+    {
+        tlo[sidx] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)tbl[sidx]));
+        thi[sidx] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(tbl[sidx] + 16)));
+    }
+
+    for(; idx + 64 <= len; idx += 64)
+    {
+        q = accumulate ? _mm512_loadu_si512((const void *)(dst + idx)) : _mm512_setzero_si512();
+        p = (accumulate && xorDst) ? _mm512_loadu_si512((const void *)(xorDst + idx)) : _mm512_setzero_si512();
+
+        for(sidx = 0; sidx < nsrc; sidx++)
+        {
+            d = _mm512_loadu_si512((const void *)(src[sidx] + idx));
+            lo = _mm512_shuffle_epi8(tlo[sidx], _mm512_and_si512(d, mask));
+            hi = _mm512_shuffle_epi8(thi[sidx], _mm512_and_si512(_mm512_srli_epi64(d, 4), mask));
+            q = _mm512_xor_si512(q, _mm512_xor_si512(lo, hi));
+            p = _mm512_xor_si512(p, d);
+        }
+
+        _mm512_storeu_si512((void *)(dst + idx), q);
+        if(xorDst)
+            _mm512_storeu_si512((void *)(xorDst + idx), p);
+    }
+
+    _mm256_zeroupper();
+    gfDotTail(src, tbl, nsrc, dst, xorDst, idx, len, accumulate);
+}
+
+static int ssse3Supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3") ? TRUE : FALSE;
+}
+
+static int avx2Supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? TRUE : FALSE;
+}
+
+static int avx512bwSupported(void)
+{
+    __builtin_cpu_init();
+    return (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) ? TRUE : FALSE;
+}
+
+#endif
+
+static int alwaysSupported(void)
+{
+    return TRUE;
+}
+
+typedef struct raid6_kernel
+{
+    const char *name;
+    gfDotKernel_t gfDot;
+    int (*supported)(void);
+} raid6kernel_t;
+
+// Kernel table, ordered from least to most preferred
+static const raid6kernel_t gfKernelTable[] =
+{
+    { "scalar",   gfDotScalar, alwaysSupported },
+#ifdef RAID_X86
+    { "ssse3",    gfDotSSSE3,  ssse3Supported },
+    { "avx2",     gfDotAVX2,   avx2Supported },
+    { "avx512bw", gfDotAVX512, avx512bwSupported },
+#endif
+};
+
+#define GF_KERNEL_COUNT ((int)(sizeof(gfKernelTable) / sizeof(gfKernelTable[0])))
+
+static int activeGfKernel = 0;
+static gfDotKernel_t raidGfDot = gfDotScalar;
+
+const char *raid6ActiveKernel(void)
+{
+    return gfKernelTable[activeGfKernel].name;
+}
+
+int raid6SelectKernel(const char *name)
+{
+    int idx;
+
+    for(idx = 0; idx < GF_KERNEL_COUNT; idx++)
+    {
+        if((strcmp(gfKernelTable[idx].name, name) == 0) && gfKernelTable[idx].supported())
+        {
+            activeGfKernel = idx;
+            raidGfDot = gfKernelTable[idx].gfDot;
+            return OK;
+        }
+    }
+
+    return ERROR;
+}
+
+// Build the field tables and pick the widest supported kernel before main() runs
+__attribute__((constructor))
+static void raid6Init(void)
+{
+    int idx, x, c;
+
+    for(idx = 0, x = 1; idx < 255; idx++)
+    {
+        gfExp[idx] = (unsigned char)x;
+        gfExp[idx + 255] = (unsigned char)x;
+        gfLog[x] = (unsigned char)idx;
+
+        x <<= 1;
+        if(x & 0x100)
+            x ^= GF_POLY;
+    }
+    gfExp[510] = gfExp[0];
+    gfExp[511] = gfExp[1];
+
+    for(c = 0; c < 256; c++)
+    {
+        for(x = 0; x < 16; x++)
+        {
+            gfNibble[c][x] = gfMul((unsigned char)c, (unsigned char)x);
+            gfNibble[c][16 + x] = gfMul((unsigned char)c, (unsigned char)(x << 4));
+        }
+    }
+
+    for(idx = GF_KERNEL_COUNT - 1; idx >= 0; idx--)
+    {
+        if(gfKernelTable[idx].supported())
+        {
+            activeGfKernel = idx;
+            raidGfDot = gfKernelTable[idx].gfDot;
+            break;
+        }
+    }
+}
+
+// GF dot-product driver, blocked the same way as xorBlocks(): one XOR_BLOCK of every
+// source at a time, sources consumed in groups of XOR_GROUP streams
+static void gfDotBlocks(unsigned char *const *src, const unsigned char *coef, int nsrc,
+                        unsigned char *dst, unsigned char *xorDst, size_t len)
+{
+    const unsigned char *group[XOR_GROUP], *tbl[XOR_GROUP];
+    size_t offset, blockLen;
+    int first, cnt, sidx;
+
+    if(nsrc == 0)
+    {
+        memset(dst, 0, len);
+        if(xorDst)
+            memset(xorDst, 0, len);
+        return;
+    }
+
+    for(offset = 0; offset < len; offset += blockLen)
+    {
+        blockLen = ((len - offset) < XOR_BLOCK) ? (len - offset) : XOR_BLOCK;
+
+        for(first = 0; first < nsrc; first += cnt)
+        {
+            cnt = ((nsrc - first) < XOR_GROUP) ? (nsrc - first) : XOR_GROUP;
+
+            for(sidx = 0; sidx < cnt; sidx++)
+            {
+                group[sidx] = src[first + sidx] + offset;
+                tbl[sidx] = gfNibble[coef[first + sidx]];
+            }
+
+            raidGfDot(group, tbl, cnt, dst + offset, xorDst ? xorDst + offset : NULL, blockLen,
+                      (first > 0) ? TRUE : FALSE);
+        }
+    }
+}
+
+void pqGenBlocks(unsigned char *const *data, int ndata,
+                 unsigned char *P, unsigned char *Q, size_t len)
+{
+    unsigned char coef[RAID6_MAX_DATA];
+    int idx;
+
+    for(idx = 0; idx < ndata; idx++)
+        coef[idx] = gfPow2(idx);
+
+    gfDotBlocks(data, coef, ndata, Q, P, len);
+}
+
+int pqRecoverBlocks(unsigned char **units, int ndata, int lost1, int lost2, size_t len)
+{
+    unsigned char *src[RAID6_MAX_DATA + 2], coef[RAID6_MAX_DATA + 2];
+    unsigned char A, B, gx;
+    int pIdx = ndata, qIdx = ndata + 1;
+    int idx, cnt, tmp;
+
+    if((ndata < 1) || (ndata > RAID6_MAX_DATA))
+        return ERROR;
+    if((lost1 < -1) || (lost1 > qIdx) || (lost2 < -1) || (lost2 > qIdx) || ((lost1 == lost2) && (lost1 != -1)))
+        return ERROR;
+
+    // Order so that lost1 < lost2, with -1 meaning "nothing lost"
+    if((lost1 == -1) || ((lost2 != -1) && (lost2 < lost1)))
+    {
+        tmp = lost1, lost1 = lost2, lost2 = tmp;
+    }
+    if(lost1 == -1)
+        return OK;
+
+    // Only parity lost: re-encode what is missing
+    if(lost1 >= pIdx)
+    {
+        if((lost1 == pIdx) && (lost2 == qIdx))
+            pqGenBlocks(units, ndata, units[pIdx], units[qIdx], len);
+        else if(lost1 == pIdx)
+            xorBlocks(units, ndata, units[pIdx], len);
+        else
+        {
+            for(idx = 0; idx < ndata; idx++)
+                coef[idx] = gfPow2(idx);
+            gfDotBlocks(units, coef, ndata, units[qIdx], NULL, len);
+        }
+        return OK;
+    }
+
+    // One data unit lost, P available: plain RAID-5 rebuild, then regenerate Q if it is also lost
+    if((lost2 == -1) || (lost2 == qIdx))
+    {
+        for(idx = 0, cnt = 0; idx < ndata; idx++)
+            if(idx != lost1)
+                src[cnt++] = units[idx];
+
+        rebuildBlocks(src, cnt, units[pIdx], units[lost1], len);
+
+        if(lost2 == qIdx)
+            return pqRecoverBlocks(units, ndata, qIdx, -1, len);
+        return OK;
+    }
+
+    // Data unit x and P lost: Dx = g^-x * (Q ^ sum g^i Di), then regenerate P
+    if(lost2 == pIdx)
+    {
+        gx = gfInv(gfPow2(lost1));
+        for(idx = 0, cnt = 0; idx < ndata; idx++)
+        {
+            if(idx != lost1)
+            {
+                src[cnt] = units[idx];
+                coef[cnt++] = gfMul(gx, gfPow2(idx));
+            }
+        }
+        src[cnt] = units[qIdx];
+        coef[cnt++] = gx;
+
+        gfDotBlocks(src, coef, cnt, units[lost1], NULL, len);
+        xorBlocks(units, ndata, units[pIdx], len);
+        return OK;
+    }
+
+    // Two data units x < y lost:
+    //   Dx = A*(P ^ Pxy) ^ B*(Q ^ Qxy), A = g^(y-x) / (g^(y-x) ^ 1), B = g^-x / (g^(y-x) ^ 1)
+    //   Dy = P ^ Pxy ^ Dx
+    // where Pxy and Qxy are P and Q computed over the surviving data units only. Folding the
+    // syndromes in gives Dx as one dot product over the survivors, P and Q.
+    gx = gfPow2(lost2 - lost1);
+    A = gfMul(gx, gfInv(gx ^ 1));
+    B = gfMul(gfInv(gfPow2(lost1)), gfInv(gx ^ 1));
+
+    for(idx = 0, cnt = 0; idx < ndata; idx++)
+    {
+        if((idx != lost1) && (idx != lost2))
+        {
+            src[cnt] = units[idx];
+            coef[cnt++] = A ^ gfMul(B, gfPow2(idx));
+        }
+    }
+    src[cnt] = units[pIdx];
+    coef[cnt++] = A;
+    src[cnt] = units[qIdx];
+    coef[cnt++] = B;
+
+    gfDotBlocks(src, coef, cnt, units[lost1], NULL, len);
+
+    for(idx = 0, cnt = 0; idx < ndata; idx++)
+        if(idx != lost2)
+            src[cnt++] = units[idx];
+
+    rebuildBlocks(src, cnt, units[pIdx], units[lost2], len);
+
+    return OK;
+}
@@ -0,0 +1,38 @@
+#ifndef RAID6LIB_H
+#define RAID6LIB_H
+
+#include <stddef.h>
+
+// RAID-6 (P+Q) dual parity over GF(2^8)
+//
+// P is the plain XOR of the data units, as in RAID-5. Q is the Reed-Solomon syndrome
+// Q = g^0*D0 ^ g^1*D1 ^ ... ^ g^(n-1)*D(n-1) with generator g = 2 over the field
+// polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11d), so any two lost units can be rebuilt.
+//
+// Multiplication by a constant is done with two 16-entry nibble tables per coefficient
+// (pshufb on SSSE3/AVX2/AVX-512BW), selected at load time like the XOR kernels.
+
+#define RAID6_MAX_DATA (32) // Largest data width supported by the recovery paths
+
+// Field arithmetic
+unsigned char gfMul(unsigned char a, unsigned char b);
+unsigned char gfInv(unsigned char a);
+unsigned char gfPow2(int power);
+
+// Compute P and Q for ndata data units of len bytes
+void pqGenBlocks(unsigned char *const *data, int ndata,
+                 unsigned char *P, unsigned char *Q, size_t len);
+
+// Rebuild up to two lost units in place
+//
+// units[0 ... ndata-1] are the data units, units[ndata] is P and units[ndata+1] is Q.
+// lost1 and lost2 index into units; pass -1 for lost2 to rebuild a single unit.
+// Returns OK, or ERROR if the indices are out of range.
+int pqRecoverBlocks(unsigned char **units, int ndata, int lost1, int lost2, size_t len);
+
+// GF multiply kernel selected for this CPU: "scalar", "ssse3", "avx2" or "avx512bw".
+// raid6SelectKernel returns ERROR if the name is unknown or not supported here.
+const char *raid6ActiveKernel(void);
+int raid6SelectKernel(const char *name);
+
+#endif
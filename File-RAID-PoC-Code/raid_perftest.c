@@ -1,11 +1,44 @@
 #include "raidtest.h"
+#include "raidsimd.h"
+#include "raid6lib.h"
+#include "raidcrc.h"
+#include <time.h>
+
+#define REGION_SIZE (4 * 1024 * 1024)  // Bytes per data unit for the N-way test
+#define REGION_REPS (16)
+#define FILE_TEST_SIZE (64 * 1024 * 1024)  // Input file for the stripe unit test
+#define FILE_TEST_NAME "perftest.bin"
+#define READ_TEST_SIZE (4096)  // Bytes per random read
+#define READ_TEST_COUNT (20000)
+#define OBJECT_TEST_SIZE (16 * 1024)  // Bytes per small object
+#define OBJECT_TEST_COUNT (2000)
+#define HEDGE_TEST_US (200)  // Hedge deadline for the hedged read test
 
 int main(int argc, char *argv[])
 {
     int idx, LBAidx, numTestIterations, rc;
     double rate = 0.0;
-    double totalRate = 0.0, aveRate = 0.0;
+    double totalRate = 0.0, aveRate = 0.0, gbps = 0.0;
+    int kernelIdx, kernelCount;
+    const raidkernel_t *kernel;
+    const char *bestKernel = raidActiveKernel();
+    const char *bestGfKernel = raid6ActiveKernel();
+    const char *gfKernelNames[4] = { "scalar", "ssse3", "avx2", "avx512bw" };
+    const char *bestCrcKernel = crc32cActiveKernel();
+    const char *crcKernelNames[2] = { "slice8", "sse42" };
+    uint32_t crc = 0;
+    unsigned char *region[12], *regionParity;
+    int nsrc, rep;
+    struct timespec RegionStart, RegionStop;
+    double regionSecs, stripeSecs;
     struct timeval StartTime, StopTime;
+    raidcfg_t fileCfg = { RAID_CODE_XOR, RAID_LAYOUT_FIXED };
+    int fileUnits[4] = { 512, 4096, 64 * 1024, 1024 * 1024 };
+    unsigned char *fileBuf, readBuf[READ_TEST_SIZE];
+    raidset_t *set;
+    off_t readOffset;
+    int degraded, streamFd;
+    FILE *fdTest;
     unsigned int microsecs;
 
     // Check if the number of test iterations is provided as a command-line argument
@@ -36,46 +69,615 @@ int main(int argc, char *argv[])
     // rebuilds a missing buffer (buffer 4 in the test case). The time taken for these operations
     // is measured to evaluate the performance.
     //
-    printf("\nRAID Operations Performance Test\n");
+    // The test is repeated for every XOR kernel this CPU supports, so the runtime dispatch
+    // can be compared against the portable scalar kernel.
+    //
+    printf("\nRAID Operations Performance Test (active kernel = %s)\n", raidActiveKernel());
 
-    // Start timing the RAID operations
-    gettimeofday(&StartTime, 0);
+#ifdef RAID64
+    // The word-wide API does not go through the SIMD dispatch, so time it once
+    kernelCount = 1;
+#else
+    kernelCount = raidKernelCount();
+#endif
 
-    for(idx = 0; idx < numTestIterations; idx++)
+    for(kernelIdx = 0; kernelIdx < kernelCount; kernelIdx++)
     {
-        LBAidx = idx % MAX_LBAS;  // Use modulo to cycle through LBAs
+        kernel = raidKernelInfo(kernelIdx);
+
+        if(!kernel->supported())
+        {
+            printf("\nkernel %s: not supported on this CPU\n", kernel->name);
+            continue;
+        }
+
+        raidSelectKernel(kernel->name);
+#ifdef RAID64
+        printf("\nkernel word64:\n");
+#else
+        printf("\nkernel %s:\n", kernel->name);
+#endif
+
+        // Start timing the RAID operations
+        gettimeofday(&StartTime, 0);
 
-        // Compute XOR parity for RAID-5 from 4 LBAs
-        xorLBA(PTR_CAST &testLBA1[LBAidx],
-               PTR_CAST &testLBA2[LBAidx],
-               PTR_CAST &testLBA3[LBAidx],
-               PTR_CAST &testLBA4[LBAidx],
-               PTR_CAST &testPLBA[LBAidx]);
+        for(idx = 0; idx < numTestIterations; idx++)
+        {
+            LBAidx = idx % MAX_LBAS;  // Use modulo to cycle through LBAs
 
-        // Rebuild one of the LBAs using the remaining LBAs and the parity
-        rebuildLBA(PTR_CAST &testLBA1[LBAidx],
+            // Compute XOR parity for RAID-5 from 4 LBAs
+            xorLBA(PTR_CAST &testLBA1[LBAidx],
                    PTR_CAST &testLBA2[LBAidx],
                    PTR_CAST &testLBA3[LBAidx],
-                   PTR_CAST &testPLBA[LBAidx],
-                   PTR_CAST &testRebuild[LBAidx]);
-    }
+                   PTR_CAST &testLBA4[LBAidx],
+                   PTR_CAST &testPLBA[LBAidx]);
 
-    // Stop timing the RAID operations
-    gettimeofday(&StopTime, 0);
+            // Rebuild one of the LBAs using the remaining LBAs and the parity
+            rebuildLBA(PTR_CAST &testLBA1[LBAidx],
+                       PTR_CAST &testLBA2[LBAidx],
+                       PTR_CAST &testLBA3[LBAidx],
+                       PTR_CAST &testPLBA[LBAidx],
+                       PTR_CAST &testRebuild[LBAidx]);
+        }
 
-    // Calculate the total time taken in microseconds
-    microsecs = ((StopTime.tv_sec - StartTime.tv_sec) * 1000000);
+        // Stop timing the RAID operations
+        gettimeofday(&StopTime, 0);
 
-    if(StopTime.tv_usec > StartTime.tv_usec)
-        microsecs += (StopTime.tv_usec - StartTime.tv_usec);
-    else
-        microsecs -= (StartTime.tv_usec - StopTime.tv_usec);
+        // Calculate the total time taken in microseconds
+        microsecs = ((StopTime.tv_sec - StartTime.tv_sec) * 1000000);
+
+        if(StopTime.tv_usec > StartTime.tv_usec)
+            microsecs += (StopTime.tv_usec - StartTime.tv_usec);
+        else
+            microsecs -= (StartTime.tv_usec - StopTime.tv_usec);
+
+        if(microsecs == 0)
+            microsecs = 1;
+
+        // Output the total time taken and the rate of RAID operations per second
+        printf("Test Done in %u microsecs for %d iterations\n", microsecs, numTestIterations);
 
-    // Output the total time taken and the rate of RAID operations per second
-    printf("Test Done in %u microsecs for %d iterations\n", microsecs, numTestIterations);
+        rate = ((double)numTestIterations) / (((double)microsecs) / 1000000.0);
+        printf("%lf RAID ops computed per second\n", rate);
 
-    rate = ((double)numTestIterations) / (((double)microsecs) / 1000000.0);
-    printf("%lf RAID ops computed per second\n", rate);
+        // Each iteration reads 4 sectors for the encode and 4 for the rebuild
+        gbps = (rate * 8.0 * SECTOR_SIZE) / 1.0e9;
+        printf("%lf GB/s parity input bandwidth\n", gbps);
+    }
+
+    // Restore the load-time selection
+    raidSelectKernel(bestKernel);
 
     // END TEST CASE #1
+
+    // TEST CASE #2: Wide-layout N-way parity over multi-megabyte regions
+    //
+    // One xorBlocks() call per region for 4+1, 8+1 and 12+1 layouts, compared with encoding
+    // the same 4+1 region one sector at a time through xorLBA().
+    //
+    printf("\nN-way Region Parity Performance Test (%d MiB per unit, kernel = %s)\n",
+           REGION_SIZE / (1024 * 1024), raidActiveKernel());
+
+    for(idx = 0; idx < 12; idx++)
+    {
+        region[idx] = malloc(REGION_SIZE);
+        memset(region[idx], idx + 1, REGION_SIZE);
+    }
+    regionParity = malloc(REGION_SIZE);
+
+    for(nsrc = 4; nsrc <= 12; nsrc += 4)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+        for(rep = 0; rep < REGION_REPS; rep++)
+            xorBlocks(region, nsrc, regionParity, REGION_SIZE);
+        clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+
+        regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+        printf("%d+1 xorBlocks: %lf GB/s\n", nsrc,
+               ((double)nsrc * REGION_SIZE * REGION_REPS) / regionSecs / 1.0e9);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+    for(rep = 0; rep < REGION_REPS; rep++)
+        for(LBAidx = 0; LBAidx < (REGION_SIZE / SECTOR_SIZE); LBAidx++)
+            xorLBA(PTR_CAST (region[0] + (LBAidx * SECTOR_SIZE)),
+                   PTR_CAST (region[1] + (LBAidx * SECTOR_SIZE)),
+                   PTR_CAST (region[2] + (LBAidx * SECTOR_SIZE)),
+                   PTR_CAST (region[3] + (LBAidx * SECTOR_SIZE)),
+                   PTR_CAST (regionParity + (LBAidx * SECTOR_SIZE)));
+    clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+
+    regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+    printf("4+1 per-sector xorLBA: %lf GB/s\n", (4.0 * REGION_SIZE * REGION_REPS) / regionSecs / 1.0e9);
+
+    for(idx = 0; idx < 12; idx++)
+        free(region[idx]);
+    free(regionParity);
+
+    // END TEST CASE #2
+
+    // TEST CASE #3: RAID-6 P+Q generation compared with XOR-only parity
+    //
+    // pqGenBlocks() computes P and Q in one pass over the data; the goal is to stay
+    // close to the XOR-only rate of xorBlocks() on the same 4+1 region.
+    //
+    printf("\nRAID-6 P+Q Performance Test (%d MiB per unit, 4 data units)\n", REGION_SIZE / (1024 * 1024));
+
+    for(idx = 0; idx < 6; idx++)
+    {
+        region[idx] = malloc(REGION_SIZE);
+        memset(region[idx], (idx + 1) * 37, REGION_SIZE);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+    for(rep = 0; rep < REGION_REPS; rep++)
+        xorBlocks(region, 4, region[4], REGION_SIZE);
+    clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+    regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+    printf("XOR only (%s): %lf GB/s\n", raidActiveKernel(), (4.0 * REGION_SIZE * REGION_REPS) / regionSecs / 1.0e9);
+
+    for(kernelIdx = 0; kernelIdx < 4; kernelIdx++)
+    {
+        if(raid6SelectKernel(gfKernelNames[kernelIdx]) != OK)
+        {
+            printf("P+Q (%s): not supported on this CPU\n", gfKernelNames[kernelIdx]);
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+        for(rep = 0; rep < REGION_REPS; rep++)
+            pqGenBlocks(region, 4, region[4], region[5], REGION_SIZE);
+        clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+        regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+        printf("P+Q (%s): %lf GB/s\n", gfKernelNames[kernelIdx], (4.0 * REGION_SIZE * REGION_REPS) / regionSecs / 1.0e9);
+    }
+    raid6SelectKernel(bestGfKernel);
+
+    for(idx = 0; idx < 6; idx++)
+        free(region[idx]);
+
+    // END TEST CASE #3
+
+    // TEST CASE #4: stripeFile/restoreFile throughput by stripe unit
+    //
+    // Stripes and restores a FILE_TEST_SIZE file through the page cache with growing stripe
+    // units, so the cost per syscall shows up directly in the ingest rate.
+    //
+    printf("\nStripe Unit File Throughput Test (%d MiB file)\n", FILE_TEST_SIZE / (1024 * 1024));
+
+    fileBuf = malloc(FILE_TEST_SIZE);
+    for(idx = 0; idx < FILE_TEST_SIZE; idx++)
+        fileBuf[idx] = (unsigned char)(idx * 31 + (idx >> 12));
+
+    if(((fdTest = fopen(FILE_TEST_NAME, "w")) == NULL) ||
+       (fwrite(fileBuf, 1, FILE_TEST_SIZE, fdTest) != FILE_TEST_SIZE))
+    {
+        perror(FILE_TEST_NAME);
+        exit(-1);
+    }
+    fclose(fdTest);
+
+    for(idx = 0; idx < 4; idx++)
+    {
+        fileCfg.unitSize = fileUnits[idx];
+
+        clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+        rc = stripeFileCfg(FILE_TEST_NAME, 0, &fileCfg);
+        clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+        stripeSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+
+        clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+        rc |= restoreFileCfg(FILE_TEST_NAME ".out", 0, FILE_TEST_SIZE, &fileCfg, 1, 0);
+        clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+        regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+        printf("unit %7d: stripe %lf MB/s, degraded restore %lf MB/s%s\n", fileUnits[idx],
+               FILE_TEST_SIZE / stripeSecs / 1.0e6, FILE_TEST_SIZE / regionSecs / 1.0e6, (rc < 0) ? " (FAILED)" : "");
+    }
+
+    // The same at a 64 KiB unit with the parallel mode on every CPU
+    fileCfg.unitSize = 64 * 1024;
+    fileCfg.threads = RAID_THREADS_AUTO;
+
+    clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+    rc = stripeFileCfg(FILE_TEST_NAME, 0, &fileCfg);
+    clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+    stripeSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+
+    clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+    rc |= restoreFileCfg(FILE_TEST_NAME ".out", 0, FILE_TEST_SIZE, &fileCfg, 1, 0);
+    clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+    regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+    printf("unit %7d, %ld threads: stripe %lf MB/s, degraded restore %lf MB/s%s\n", fileCfg.unitSize,
+           sysconf(_SC_NPROCESSORS_ONLN), FILE_TEST_SIZE / stripeSecs / 1.0e6, FILE_TEST_SIZE / regionSecs / 1.0e6,
+           (rc < 0) ? " (FAILED)" : "");
+
+    // And again with the io_uring engine keeping the default queue depth in flight
+    fileCfg.ioEngine = RAID_IO_URING;
+
+    clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+    rc = stripeFileCfg(FILE_TEST_NAME, 0, &fileCfg);
+    clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+    stripeSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+
+    clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+    rc |= restoreFileCfg(FILE_TEST_NAME ".out", 0, FILE_TEST_SIZE, &fileCfg, 1, 0);
+    clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+    regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+    printf("unit %7d, io_uring depth %d: stripe %lf MB/s, degraded restore %lf MB/s%s\n", fileCfg.unitSize,
+           RAID_URING_DEPTH, FILE_TEST_SIZE / stripeSecs / 1.0e6, FILE_TEST_SIZE / regionSecs / 1.0e6,
+           (rc < 0) ? " (FAILED)" : "");
+
+    // And through memory mappings of the file and the chunks
+    fileCfg.ioEngine = RAID_IO_MMAP;
+
+    clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+    rc = stripeFileCfg(FILE_TEST_NAME, 0, &fileCfg);
+    clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+    stripeSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+
+    clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+    rc |= restoreFileCfg(FILE_TEST_NAME ".out", 0, FILE_TEST_SIZE, &fileCfg, 1, 0);
+    clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+    regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+    printf("unit %7d, mmap: stripe %lf MB/s, degraded restore %lf MB/s%s\n", fileCfg.unitSize,
+           FILE_TEST_SIZE / stripeSecs / 1.0e6, FILE_TEST_SIZE / regionSecs / 1.0e6, (rc < 0) ? " (FAILED)" : "");
+
+    remove(FILE_TEST_NAME ".out");
+
+    // END TEST CASE #4
+
+    // TEST CASE #5: random reads and writes through raidPread and raidPwrite
+    //
+    // Reads READ_TEST_SIZE bytes at random offsets of the striped file, first with every
+    // chunk there and then with a data chunk removed, where a quarter of the reads have
+    // to be rebuilt from the other chunks. Then writes the same bytes back at random
+    // offsets, each a read-modify-write of one data unit and the parity.
+    //
+    printf("\nRandom Read/Write Test (%d byte I/Os, unit %d)\n", READ_TEST_SIZE, 64 * 1024);
+
+    fileCfg.threads = 0;
+    fileCfg.ioEngine = RAID_IO_SYNC;
+    rc = stripeFileCfg(FILE_TEST_NAME, 0, &fileCfg);
+
+    for(degraded = FALSE; degraded <= TRUE; degraded++)
+    {
+        if(degraded)
+            remove("StripeChunk2.bin");
+
+        if((rc < 0) || ((set = raidOpen(&fileCfg)) == NULL))
+        {
+            printf("random reads: cannot open the chunk set\n");
+            break;
+        }
+
+        srand(1);
+        clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+        for(idx = 0; (idx < READ_TEST_COUNT) && (rc >= 0); idx++)
+        {
+            readOffset = ((off_t)rand() * READ_TEST_SIZE) % (FILE_TEST_SIZE - READ_TEST_SIZE);
+            if((raidPread(set, readOffset, READ_TEST_SIZE, readBuf) != READ_TEST_SIZE) ||
+               (memcmp(readBuf, &fileBuf[readOffset], READ_TEST_SIZE) != 0))
+                rc = ERROR;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+        regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+
+        clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+        for(idx = 0; (idx < READ_TEST_COUNT) && (rc >= 0); idx++)
+        {
+            readOffset = ((off_t)rand() * READ_TEST_SIZE) % (FILE_TEST_SIZE - READ_TEST_SIZE);
+            if(raidPwrite(set, readOffset, READ_TEST_SIZE, &fileBuf[readOffset]) != READ_TEST_SIZE)
+                rc = ERROR;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+        stripeSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+        raidClose(set);
+
+        printf("%s: %lf reads, %lf writes per second%s\n", degraded ? "one chunk lost" : "all chunks",
+               READ_TEST_COUNT / regionSecs, READ_TEST_COUNT / stripeSecs, (rc < 0) ? " (FAILED)" : "");
+    }
+
+    // END TEST CASE #5
+
+    // TEST CASE #6: write-back cache
+    //
+    // Writes the file back in READ_TEST_SIZE pieces, in order, through raidPwrite without
+    // and with the stripe cache. Without it every piece is a read-modify-write of one data
+    // unit and the parity; with it the pieces merge into full stripes written with no reads.
+    //
+    printf("\nWrite-Back Cache Test (%d byte sequential writes, unit %d)\n", READ_TEST_SIZE, 64 * 1024);
+
+    rc = stripeFileCfg(FILE_TEST_NAME, 0, &fileCfg);
+    for(idx = 0; idx <= 64; idx += 64)
+    {
+        fileCfg.cacheStripes = idx;
+        if((rc < 0) || ((set = raidOpen(&fileCfg)) == NULL))
+        {
+            printf("cached writes: cannot open the chunk set\n");
+            break;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+        for(readOffset = 0; (readOffset < FILE_TEST_SIZE) && (rc >= 0); readOffset += READ_TEST_SIZE)
+            if(raidPwrite(set, readOffset, READ_TEST_SIZE, &fileBuf[readOffset]) != READ_TEST_SIZE)
+                rc = ERROR;
+        if(raidClose(set) != OK)
+            rc = ERROR;
+        clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+        regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+
+        printf("cache of %2d stripes: %lf MB/s%s\n", idx, FILE_TEST_SIZE / regionSecs / 1.0e6, (rc < 0) ? " (FAILED)" : "");
+    }
+    fileCfg.cacheStripes = 0;
+
+    // END TEST CASE #6
+
+    // TEST CASE #7: parity scrub
+    //
+    // Checks the parity of the chunk set left by the writes above, on one thread and then
+    // on every CPU. The rate counts all chunk bytes read, data and parity.
+    //
+    printf("\nParity Scrub Test (unit %d)\n", 64 * 1024);
+
+    for(idx = 0; idx <= 1; idx++)
+    {
+        fileCfg.threads = idx ? RAID_THREADS_AUTO : 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+        rc = raidScrub(&fileCfg, NULL, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+        regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+
+        printf("%ld threads: %lf MB/s%s\n", idx ? sysconf(_SC_NPROCESSORS_ONLN) : 1L,
+               (double)FILE_TEST_SIZE * (DATA_CHUNKS + 1) / DATA_CHUNKS / regionSecs / 1.0e6, (rc != 0) ? " (FAILED)" : "");
+    }
+    fileCfg.threads = 0;
+
+    // END TEST CASE #7
+
+    // TEST CASE #8: CRC32C unit checksums
+    //
+    // Every unit striped, rebuilt or read whole is checksummed, so the checksum has to
+    // run well ahead of the parity to stay out of the way. Checksums the test file once
+    // per kernel.
+    //
+    printf("\nCRC32C Checksum Test (%d MiB)\n", FILE_TEST_SIZE / (1024 * 1024));
+
+    for(kernelIdx = 0; kernelIdx < 2; kernelIdx++)
+    {
+        if(crc32cSelectKernel(crcKernelNames[kernelIdx]) != OK)
+        {
+            printf("%s: not supported on this CPU\n", crcKernelNames[kernelIdx]);
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+        for(rep = 0; rep < 4; rep++)
+            crc ^= crc32c(0, fileBuf, FILE_TEST_SIZE);
+        clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+        regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+        printf("%s: %lf GB/s\n", crcKernelNames[kernelIdx], (4.0 * FILE_TEST_SIZE) / regionSecs / 1.0e9);
+    }
+    crc32cSelectKernel(bestCrcKernel);
+
+    // END TEST CASE #8
+
+    // TEST CASE #9: stripe width
+    //
+    // Stripes and restores the test file over 2 to RAID_MAX_DATA data chunks. All the
+    // chunks share one directory here, so this measures the per-chunk overhead; with the
+    // chunks on separate devices (cfg.chunkPath) the wider sets gain bandwidth as well.
+    //
+    printf("\nStripe Width Test (unit %d)\n", fileCfg.unitSize);
+
+    for(idx = 2; idx <= RAID_MAX_DATA; idx *= 2)
+    {
+        fileCfg.dataChunks = idx;
+
+        clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+        rc = stripeFileCfg(FILE_TEST_NAME, 0, &fileCfg);
+        clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+        stripeSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+
+        clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+        rc |= restoreFileCfg(FILE_TEST_NAME ".out", 0, FILE_TEST_SIZE, &fileCfg, 1, 0);
+        clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+        regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+        printf("%2d data chunks: stripe %lf MB/s, degraded restore %lf MB/s%s\n", idx,
+               FILE_TEST_SIZE / stripeSecs / 1.0e6, FILE_TEST_SIZE / regionSecs / 1.0e6, (rc < 0) ? " (FAILED)" : "");
+    }
+    fileCfg.dataChunks = 0;
+
+    // END TEST CASE #9
+
+    // TEST CASE #10: small objects
+    //
+    // Stores and reads back OBJECT_TEST_COUNT objects of OBJECT_TEST_SIZE bytes, first with
+    // stripeFileCfg and restoreFileCfg, which open and check the chunks on every call, then
+    // through one set kept open, with raidStripe and raidPread.
+    //
+    printf("\nSmall Object Test (%d byte objects, unit %d)\n", OBJECT_TEST_SIZE, 4096);
+
+    fileCfg.unitSize = 4096;
+    if(((fdTest = fopen(FILE_TEST_NAME, "w")) == NULL) ||
+       (fwrite(fileBuf, 1, OBJECT_TEST_SIZE, fdTest) != OBJECT_TEST_SIZE))
+    {
+        perror(FILE_TEST_NAME);
+        exit(-1);
+    }
+    fclose(fdTest);
+
+    rc = OK;
+    clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+    for(idx = 0; (idx < OBJECT_TEST_COUNT) && (rc >= 0); idx++)
+    {
+        if((stripeFileCfg(FILE_TEST_NAME, 0, &fileCfg) != OBJECT_TEST_SIZE) ||
+           (restoreFileCfg(FILE_TEST_NAME ".out", 0, OBJECT_TEST_SIZE, &fileCfg, 0, 0) != OBJECT_TEST_SIZE))
+            rc = ERROR;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+    regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+    printf("open per call: %lf objects per second%s\n", OBJECT_TEST_COUNT / regionSecs, (rc < 0) ? " (FAILED)" : "");
+
+    rc = ((set = raidCreate(&fileCfg)) == NULL) ? ERROR : OK;
+    clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+    for(idx = 0; (idx < OBJECT_TEST_COUNT) && (rc >= 0); idx++)
+    {
+        readOffset = (idx * 4096) % (FILE_TEST_SIZE - OBJECT_TEST_SIZE);
+        if((raidStripe(set, &fileBuf[readOffset], OBJECT_TEST_SIZE) != OBJECT_TEST_SIZE) ||
+           (raidPread(set, 0, READ_TEST_SIZE, readBuf) != READ_TEST_SIZE) ||
+           (memcmp(readBuf, &fileBuf[readOffset], READ_TEST_SIZE) != 0))
+            rc = ERROR;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+    regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+    if((set != NULL) && ((raidScrubSet(set, NULL, NULL) != 0) || (raidClose(set) != OK)))
+        rc = ERROR;
+    printf("set kept open: %lf objects per second%s\n", OBJECT_TEST_COUNT / regionSecs, (rc < 0) ? " (FAILED)" : "");
+    fileCfg.unitSize = 64 * 1024;
+
+    // END TEST CASE #10
+
+    // TEST CASE #11: streams
+    //
+    // Stripes the test file through stripeStream and restores it through restoreStream,
+    // one RAID_STREAM_BATCH window at a time, next to stripeFileCfg and restoreFileCfg
+    // on the same file, with the parallel mode on every CPU.
+    //
+    printf("\nStream Throughput Test (%d MiB file, %d MiB batches)\n", FILE_TEST_SIZE / (1024 * 1024),
+           RAID_STREAM_BATCH / (1024 * 1024));
+
+    if(((fdTest = fopen(FILE_TEST_NAME, "w")) == NULL) ||
+       (fwrite(fileBuf, 1, FILE_TEST_SIZE, fdTest) != FILE_TEST_SIZE))
+    {
+        perror(FILE_TEST_NAME);
+        exit(-1);
+    }
+    fclose(fdTest);
+
+    fileCfg.threads = RAID_THREADS_AUTO;
+
+    clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+    rc = stripeFileCfg(FILE_TEST_NAME, 0, &fileCfg);
+    clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+    stripeSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+
+    clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+    rc |= restoreFileCfg(FILE_TEST_NAME ".out", 0, FILE_TEST_SIZE, &fileCfg, 1, 0);
+    clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+    regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+    printf("file:   stripe %lf MB/s, degraded restore %lf MB/s%s\n",
+           FILE_TEST_SIZE / stripeSecs / 1.0e6, FILE_TEST_SIZE / regionSecs / 1.0e6, (rc < 0) ? " (FAILED)" : "");
+
+    streamFd = open(FILE_TEST_NAME, O_RDONLY);
+    clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+    rc = (stripeStream(streamFd, &fileCfg) == FILE_TEST_SIZE) ? OK : ERROR;
+    clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+    stripeSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+    if(streamFd >= 0)
+        close(streamFd);
+
+    streamFd = open(FILE_TEST_NAME ".out", O_WRONLY | O_CREAT | O_TRUNC, 00644);
+    clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+    if(restoreStream(streamFd, &fileCfg, 1, 0) != FILE_TEST_SIZE)
+        rc = ERROR;
+    clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+    regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+    if(streamFd >= 0)
+        close(streamFd);
+    printf("stream: stripe %lf MB/s, degraded restore %lf MB/s%s\n",
+           FILE_TEST_SIZE / stripeSecs / 1.0e6, FILE_TEST_SIZE / regionSecs / 1.0e6, (rc < 0) ? " (FAILED)" : "");
+    fileCfg.threads = 0;
+
+    // END TEST CASE #11
+
+    // TEST CASE #12: hedged reads
+    //
+    // Restores the test file on io_uring with the first data chunk dropped from the page
+    // cache before each run, so its reads go to the device while the others are served
+    // from memory: first waiting for every read, then hedging reads still out after
+    // HEDGE_TEST_US, which the library reports as stripes rebuilt from parity.
+    //
+    printf("\nHedged Read Test (unit %d, chunk 1 cold)\n", fileCfg.unitSize);
+
+    // The chunks are written back first, and restored once untimed, so that neither
+    // run competes with the write-back of the striping
+    fileCfg.ioEngine = RAID_IO_URING;
+    rc = stripeFileCfg(FILE_TEST_NAME, 0, &fileCfg);
+    for(idx = 0; idx < raidChunkCount(&fileCfg); idx++)
+    {
+        if((streamFd = open(raidChunkName(&fileCfg, idx), O_RDONLY)) >= 0)
+        {
+            fdatasync(streamFd);
+            close(streamFd);
+        }
+    }
+    restoreFileCfg(FILE_TEST_NAME ".out", 0, FILE_TEST_SIZE, &fileCfg, 0, 0);
+
+    for(idx = 0; idx < 2; idx++)
+    {
+        fileCfg.hedgeUs = idx ? HEDGE_TEST_US : 0;
+        if((streamFd = open(raidChunkName(&fileCfg, 0), O_RDONLY)) >= 0)
+        {
+            posix_fadvise(streamFd, 0, 0, POSIX_FADV_DONTNEED);
+            close(streamFd);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+        if(restoreFileCfg(FILE_TEST_NAME ".out", 0, FILE_TEST_SIZE, &fileCfg, 0, 0) != FILE_TEST_SIZE)
+            rc = ERROR;
+        clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+        regionSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+        printf("hedge %5d us: restore %lf MB/s%s\n", fileCfg.hedgeUs, FILE_TEST_SIZE / regionSecs / 1.0e6,
+               (rc < 0) ? " (FAILED)" : "");
+    }
+    fileCfg.hedgeUs = 0;
+    fileCfg.ioEngine = RAID_IO_SYNC;
+
+    // END TEST CASE #12
+
+    // TEST CASE #13: striping with a failed chunk
+    //
+    // Stripes the test file on every CPU with all chunks healthy, then with chunk 2
+    // linked to /dev/full so that its writes fail: once with the chunk taken offline and
+    // the rest striped degraded, and once failing over to a hot spare, which is rebuilt
+    // in the background before the striping returns. The spare run is restored from
+    // the spare to check it.
+    //
+    printf("\nFailed Chunk Stripe Test (unit %d, chunk 2 on /dev/full)\n", fileCfg.unitSize);
+
+    fileCfg.threads = RAID_THREADS_AUTO;
+    for(idx = 0; idx < 3; idx++)
+    {
+        remove("StripeChunk2.bin");
+        if((idx > 0) && (symlink("/dev/full", "StripeChunk2.bin") != 0))
+        {
+            perror("StripeChunk2.bin");
+            break;
+        }
+        fileCfg.sparePath = (idx == 2) ? "spare.bin" : NULL;
+        fileCfg.spareChunk = 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &RegionStart);
+        rc = stripeFileCfg(FILE_TEST_NAME, 0, &fileCfg);
+        clock_gettime(CLOCK_MONOTONIC, &RegionStop);
+        stripeSecs = (RegionStop.tv_sec - RegionStart.tv_sec) + ((RegionStop.tv_nsec - RegionStart.tv_nsec) / 1.0e9);
+        if((idx == 2) && ((fileCfg.spareChunk != 2) ||
+                          (restoreFileCfg(FILE_TEST_NAME ".out", 0, FILE_TEST_SIZE, &fileCfg, 0, 0) != FILE_TEST_SIZE)))
+            rc = ERROR;
+        printf("%-8s stripe %lf MB/s%s\n", (idx == 0) ? "healthy:" : ((idx == 1) ? "offline:" : "spare:"),
+               FILE_TEST_SIZE / stripeSecs / 1.0e6, (rc < 0) ? " (FAILED)" : "");
+    }
+    remove("StripeChunk2.bin");
+    remove("spare.bin");
+    remove("spare.bin.crc");
+    fileCfg.sparePath = NULL;
+    fileCfg.spareChunk = 0;
+    fileCfg.threads = 0;
+
+    remove(FILE_TEST_NAME);
+    remove(FILE_TEST_NAME ".out");
+    free(fileBuf);
+
+    // END TEST CASE #13
 }
@@ -41,3 +41,380 @@ echo "TEST SET 4: RAID performance test"
 echo "TEST SET 4: RAID performance test" >> testresults.log
 ./raid_perftest 1000 >> testresults.log  # Run the RAID performance test and log the output
 echo "" >> testresults.log
+
+# TEST SET 5: Word-wide (RAID64) build
+# This test builds the portable 64-bit-word drivers and repeats the encode, erase and rebuild test.
+echo "TEST SET 5: RAID64 word-wide build and rebuild test"
+echo "TEST SET 5: RAID64 word-wide build and rebuild test" >> testresults.log
+make raid64 >> testresults.log    # Build the RAID64 drivers
+./raidtest64 1000 >> testresults.log  # Run the word-wide RAID test and log the output
+echo "" >> testresults.log
+
+# TEST SET 6: RAID-6 (P+Q) Stripe and Two-Failure Restore
+# This test stripes the sample image with P+Q parity and restores it with every pair of chunks missing.
+echo "TEST SET 6: RAID-6 two-failure restore test"
+echo "TEST SET 6: RAID-6 two-failure restore test" >> testresults.log
+for pair in "1 2" "1 3" "1 4" "1 5" "1 6" "2 3" "2 4" "2 5" "2 6" "3 4" "3 5" "3 6" "4 5" "4 6" "5 6"; do
+    echo | ./stripetest -6 Baby-Musk-Ox.ppm restored.ppm $pair > /dev/null
+    cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "chunks $pair: restored OK" >> testresults.log
+done
+echo "" >> testresults.log
+
+# TEST SET 7: Locally Repairable Code (LRC) Restore and Chunk Rebuild
+# This test restores the sample image with each single chunk and each pair of chunks missing, then
+# rewrites single lost chunks in place, which reads only the chunk's local group.
+echo "TEST SET 7: LRC restore and local chunk rebuild test"
+echo "TEST SET 7: LRC restore and local chunk rebuild test" >> testresults.log
+for pair in "1" "2" "3" "4" "5" "6" "7" "1 2" "1 3" "1 5" "1 6" "1 7" "3 4" "3 5" "5 6" "6 7"; do
+    echo | ./stripetest -l Baby-Musk-Ox.ppm restored.ppm $pair > /dev/null
+    cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "chunks $pair: restored OK" >> testresults.log
+done
+for chunk in 1 4 5 7; do
+    echo | ./stripetest -l -b Baby-Musk-Ox.ppm restored.ppm $chunk | grep rebuilding >> testresults.log
+    cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "chunk $chunk: rebuilt OK" >> testresults.log
+done
+echo "" >> testresults.log
+
+# TEST SET 8: Rotating-Parity (Left-Symmetric) Layout
+# This test stripes the sample image with parity rotated across the chunk files and restores it with
+# each chunk file missing, for RAID-5, and with pairs of chunk files missing for RAID-6.
+echo "TEST SET 8: rotating-parity layout restore test"
+echo "TEST SET 8: rotating-parity layout restore test" >> testresults.log
+for chunk in 1 2 3 4 5; do
+    echo | ./stripetest -r Baby-Musk-Ox.ppm restored.ppm $chunk > /dev/null
+    cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "RAID-5 chunk $chunk: restored OK" >> testresults.log
+done
+for pair in "1 2" "2 5" "5 6"; do
+    echo | ./stripetest -6 -r Baby-Musk-Ox.ppm restored.ppm $pair > /dev/null
+    cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "RAID-6 chunks $pair: restored OK" >> testresults.log
+done
+echo "" >> testresults.log
+
+# TEST SET 9: Configurable Sector Size and Stripe Unit
+# This test stripes and restores the sample image with 4 KiB sectors and stripe units from 4 KiB to 1 MiB.
+echo "TEST SET 9: sector size and stripe unit restore test"
+echo "TEST SET 9: sector size and stripe unit restore test" >> testresults.log
+for unit in 4k 64k 1m; do
+    echo | ./stripetest -s 4k -u $unit Baby-Musk-Ox.ppm restored.ppm 2 > /dev/null
+    cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "unit $unit: restored OK" >> testresults.log
+    echo | ./stripetest -6 -u $unit Baby-Musk-Ox.ppm restored.ppm 1 5 > /dev/null
+    cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "unit $unit RAID-6: restored OK" >> testresults.log
+done
+echo "" >> testresults.log
+
+# TEST SET 10: Parallel (Range-Partitioned) Stripe, Restore and Rebuild
+# This test runs striping, degraded restore and in-place chunk rebuild on worker threads.
+echo "TEST SET 10: parallel stripe, restore and rebuild test"
+echo "TEST SET 10: parallel stripe, restore and rebuild test" >> testresults.log
+for threads in 2 4 0; do
+    echo | ./stripetest -t $threads -u 4k Baby-Musk-Ox.ppm restored.ppm 3 > /dev/null
+    cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "threads $threads: restored OK" >> testresults.log
+    echo | ./stripetest -6 -b -t $threads Baby-Musk-Ox.ppm restored.ppm 2 6 > /dev/null
+    cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "threads $threads RAID-6: rebuilt OK" >> testresults.log
+done
+echo "" >> testresults.log
+
+# TEST SET 11: io_uring Engine
+# This test runs striping, degraded restore and in-place chunk rebuild through io_uring
+# at several queue depths (falling back to synchronous I/O where io_uring is unavailable).
+echo "TEST SET 11: io_uring engine test"
+echo "TEST SET 11: io_uring engine test" >> testresults.log
+for depth in 1 8 0; do
+    echo | ./stripetest -q $depth -u 4k Baby-Musk-Ox.ppm restored.ppm 3 > /dev/null
+    cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "depth $depth: restored OK" >> testresults.log
+    echo | ./stripetest -l -r -b -q $depth -t 2 Baby-Musk-Ox.ppm restored.ppm 1 5 > /dev/null
+    cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "depth $depth LRC rotating: rebuilt OK" >> testresults.log
+done
+echo "" >> testresults.log
+
+# TEST SET 12: Memory-Mapped Stripe and Restore
+# This test stripes and restores through mappings of the file and the chunk files.
+echo "TEST SET 12: mmap stripe and restore test"
+echo "TEST SET 12: mmap stripe and restore test" >> testresults.log
+for unit in 512 4k 1m; do
+    echo | ./stripetest -m -u $unit Baby-Musk-Ox.ppm restored.ppm 2 > /dev/null
+    cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "unit $unit: restored OK" >> testresults.log
+    echo | ./stripetest -6 -r -m -t 2 -u $unit Baby-Musk-Ox.ppm restored.ppm 1 4 > /dev/null
+    cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "unit $unit RAID-6 rotating: restored OK" >> testresults.log
+done
+echo "" >> testresults.log
+
+# TEST SET 13: Files Past 2 GiB
+# This test stripes and restores a sparse 2.1 GiB file with data on both sides of the
+# 2 GiB mark, showing progress, to check the 64-bit size and offset path.
+echo "TEST SET 13: large file test"
+echo "TEST SET 13: large file test" >> testresults.log
+truncate -s 2200000000 largetest.bin
+dd if=Baby-Musk-Ox.ppm of=largetest.bin bs=4096 seek=524200 conv=notrunc status=none
+echo | ./stripetest -p -t 0 -u 1m largetest.bin largetest.out 3 > /dev/null 2>> testresults.log
+cmp largetest.bin largetest.out >> testresults.log && echo "2.1 GiB file: restored OK" >> testresults.log
+rm -f largetest.bin largetest.out StripeChunk*.bin
+echo "" >> testresults.log
+
+# TEST SET 14: Chunk Superblocks
+# This test restores from the chunk files alone (geometry and length from their
+# superblocks), then swaps two chunks and brings back a stale one, both of which the
+# restore must detect and rebuild around.
+echo "TEST SET 14: chunk superblock test"
+echo "TEST SET 14: chunk superblock test" >> testresults.log
+echo | ./stripetest -6 -r -u 4k Baby-Musk-Ox.ppm restored.ppm > /dev/null
+rm -f restored.ppm
+echo | ./stripetest -c restored.ppm > /dev/null
+cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "cold restore: restored OK" >> testresults.log
+mv StripeChunk2.bin swapped.bin; mv StripeChunk3.bin StripeChunk2.bin; mv swapped.bin StripeChunk3.bin
+echo | ./stripetest -c restored.ppm >> testresults.log
+cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "swapped chunks: restored OK" >> testresults.log
+cp StripeChunk4.bin stale.bin
+echo | ./stripetest -6 -r -u 4k Baby-Musk-Ox.ppm restored.ppm > /dev/null
+mv stale.bin StripeChunk4.bin
+echo | ./stripetest -c -b restored.ppm 1 >> testresults.log
+cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "stale chunk: rebuilt OK" >> testresults.log
+echo "" >> testresults.log
+
+# TEST SET 15: Random-Access Reads
+# This test reads byte ranges of the striped file through raidPread with chunks
+# removed, so parts of the ranges have to be rebuilt, and compares them with the
+# same ranges of the original file.
+echo "TEST SET 15: random read test"
+echo "TEST SET 15: random read test" >> testresults.log
+for range in 0:1 1000:100 65530:20 300000:70000 756900:1000; do
+    offset=${range%:*}; length=${range#*:}
+    tail -c +$((offset + 1)) Baby-Musk-Ox.ppm | head -c $length > expected.bin
+    (sleep 0.2; rm -f StripeChunk2.bin; echo) | ./stripetest -u 4k -g $range Baby-Musk-Ox.ppm range.bin > /dev/null
+    cmp expected.bin range.bin >> testresults.log && echo "range $range: read OK" >> testresults.log
+    (sleep 0.2; rm -f StripeChunk1.bin StripeChunk5.bin; echo) | ./stripetest -6 -r -g $range Baby-Musk-Ox.ppm range.bin > /dev/null
+    cmp expected.bin range.bin >> testresults.log && echo "range $range RAID-6 rotating: read OK" >> testresults.log
+done
+rm -f expected.bin range.bin
+echo "" >> testresults.log
+
+# TEST SET 16: In-Place Updates
+# This test writes patches over the striped file through raidPwrite, within one sector,
+# across units and over whole stripes, with and without a chunk removed, and restores
+# the file with another chunk missing to check that the parity was kept up to date.
+echo "TEST SET 16: in-place update test"
+echo "TEST SET 16: in-place update test" >> testresults.log
+head -c 20000 Baby-Musk-Ox.ppm | tr '\000-\377' '\377\000-\376' > patch.bin
+for offset in 5000 16000 300001; do
+    cp Baby-Musk-Ox.ppm expected.ppm
+    dd if=patch.bin of=expected.ppm bs=1 seek=$offset conv=notrunc status=none
+    echo | ./stripetest -u 4k -w $offset:patch.bin Baby-Musk-Ox.ppm restored.ppm 2 > /dev/null
+    cmp expected.ppm restored.ppm >> testresults.log && echo "offset $offset: updated OK" >> testresults.log
+    (sleep 0.2; rm -f StripeChunk3.bin; echo) | ./stripetest -6 -r -w $offset:patch.bin Baby-Musk-Ox.ppm restored.ppm 3 5 > /dev/null
+    cmp expected.ppm restored.ppm >> testresults.log && echo "offset $offset RAID-6 rotating, degraded: updated OK" >> testresults.log
+done
+rm -f patch.bin expected.ppm
+echo "" >> testresults.log
+
+# TEST SET 17: Write-Back Cache
+# This test repeats the in-place updates through a small stripe cache, so some stripes
+# fill up and go out as full stripes and the rest are flushed on close.
+echo "TEST SET 17: write-back cache test"
+echo "TEST SET 17: write-back cache test" >> testresults.log
+head -c 20000 Baby-Musk-Ox.ppm | tr '\000-\377' '\377\000-\376' > patch.bin
+for offset in 5000 16000 300001; do
+    cp Baby-Musk-Ox.ppm expected.ppm
+    dd if=patch.bin of=expected.ppm bs=1 seek=$offset conv=notrunc status=none
+    echo | ./stripetest -u 4k -k 2 -w $offset:patch.bin Baby-Musk-Ox.ppm restored.ppm 2 > /dev/null
+    cmp expected.ppm restored.ppm >> testresults.log && echo "offset $offset: cached update OK" >> testresults.log
+    (sleep 0.2; rm -f StripeChunk3.bin; echo) | ./stripetest -l -k 8 -w $offset:patch.bin Baby-Musk-Ox.ppm restored.ppm 3 5 > /dev/null
+    cmp expected.ppm restored.ppm >> testresults.log && echo "offset $offset LRC, degraded: cached update OK" >> testresults.log
+done
+rm -f patch.bin expected.ppm
+echo "" >> testresults.log
+
+# TEST SET 18: Checkpointed Rebuild
+# This test cuts a rate-limited rebuild short, then reruns it, which has to pick up at the
+# checkpoint and still produce the same chunk as the original striping.
+echo "TEST SET 18: checkpointed rebuild test"
+echo "TEST SET 18: checkpointed rebuild test" >> testresults.log
+cat Baby-Musk-Ox.ppm Baby-Musk-Ox.ppm Baby-Musk-Ox.ppm Baby-Musk-Ox.ppm > large.ppm
+echo | ./stripetest large.ppm restored.ppm > /dev/null
+cp StripeChunk2.bin original.bin
+rm -f StripeChunk2.bin
+echo | timeout 1 ./stripetest -c -b -L 1 restored.ppm 2 > /dev/null
+ls StripeChunk2.bin.rebuild >> testresults.log && echo "interrupted rebuild left a checkpoint OK" >> testresults.log
+echo | ./stripetest -c -b restored.ppm 2 | grep "resuming" >> testresults.log
+cmp original.bin StripeChunk2.bin >> testresults.log && cmp large.ppm restored.ppm >> testresults.log && echo "resumed rebuild OK" >> testresults.log
+rm -f large.ppm original.bin StripeChunk2.bin.rebuild
+echo "" >> testresults.log
+
+# TEST SET 19: Parity Scrub
+# This test scrubs a clean chunk set and one just updated in place, which must both be
+# consistent, then flips a byte in a parity chunk and in a data chunk and checks that
+# the scrub names the stripes and, through the unit checksums, the corrupt chunks.
+echo "TEST SET 19: parity scrub test"
+echo "TEST SET 19: parity scrub test" >> testresults.log
+head -c 20000 Baby-Musk-Ox.ppm > patch.bin
+echo | ./stripetest -6 -r -t 3 -S -w 30000:patch.bin Baby-Musk-Ox.ppm restored.ppm | grep "scrub found 0 stripes" >> testresults.log && echo "clean scrub after in-place update OK" >> testresults.log
+echo | ./stripetest -u 4k Baby-Musk-Ox.ppm restored.ppm > /dev/null
+printf '\252' | dd of=StripeChunkXOR.bin bs=1 seek=$((512 + 20 * 4096 + 7)) conv=notrunc status=none
+printf '\252' | dd of=StripeChunk2.bin bs=1 seek=$((512 + 31 * 4096)) conv=notrunc status=none
+echo | ./stripetest -c -S -t 2 restored.ppm | grep "^mismatch" | sort -n -k 2 > mismatches.txt
+printf 'mismatch 20 5\nmismatch 31 2\n' | cmp - mismatches.txt >> testresults.log && echo "scrub found the corrupt stripes OK" >> testresults.log
+rm -f patch.bin mismatches.txt
+echo "" >> testresults.log
+
+# TEST SET 20: Unit Checksums
+# This test corrupts chunks without removing them: overwriting the data of a RAID-6 data
+# chunk with another's and damaging one unit of a RAID-5 chunk. Restores must find the
+# bad units from their checksums and rebuild them, a restore that cannot must fail
+# rather than return a distorted image, and scrub must name the corrupt chunk.
+echo "TEST SET 20: unit checksum test"
+echo "TEST SET 20: unit checksum test" >> testresults.log
+echo | ./stripetest -6 -t 2 Baby-Musk-Ox.ppm restored.ppm > /dev/null
+dd if=StripeChunk3.bin of=StripeChunk2.bin bs=512 skip=1 seek=1 conv=notrunc status=none
+rm -f StripeChunk1.bin
+echo | ./stripetest -6 -c -t 2 restored.ppm 1 > /dev/null
+cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "RAID-6 restore past a silently corrupt chunk OK" >> testresults.log
+echo | ./stripetest -u 4k Baby-Musk-Ox.ppm restored.ppm > /dev/null
+printf 'XXXX' | dd of=StripeChunk3.bin bs=1 seek=$((512 + 9 * 4096 + 100)) conv=notrunc status=none
+echo | ./stripetest -c restored.ppm | grep "StripeChunk3.bin: checksum mismatch in stripe 9" > /dev/null &&
+cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "RAID-5 restore repaired the corrupt unit OK" >> testresults.log
+echo | ./stripetest -c -S restored.ppm | grep "^mismatch 9 3$" >> testresults.log && echo "scrub named the corrupt chunk OK" >> testresults.log
+rm -f StripeChunk1.bin restored.ppm
+echo | ./stripetest -c restored.ppm 1 > /dev/null || echo "restore with a chunk lost and another corrupt failed as expected OK" >> testresults.log
+echo "" >> testresults.log
+
+# TEST SET 21: Stripe Width and Chunk Placement
+# This test stripes over 2 to 32 data chunks, spreading the chunk files round-robin over
+# three directories standing in for separate devices. Each set loses chunks before the
+# restore, and a cold restore finds the width and placement from the superblocks.
+echo "TEST SET 21: stripe width and chunk placement test"
+echo "TEST SET 21: stripe width and chunk placement test" >> testresults.log
+rm -rf dev1 dev2 dev3 && mkdir dev1 dev2 dev3
+(sleep 0.2; rm -f dev3/StripeChunk3.bin; echo) | ./stripetest -n 8 -D dev1:dev2:dev3 Baby-Musk-Ox.ppm restored.ppm 3 > /dev/null
+cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "8 data chunks over 3 directories restore OK" >> testresults.log
+rm -f restored.ppm
+echo | ./stripetest -c -D dev1:dev2:dev3 restored.ppm 3 | grep "written as 8 data chunks" > /dev/null &&
+cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "cold restore found the width and placement OK" >> testresults.log
+rm -rf dev1/* dev2/* dev3/*
+(sleep 0.2; rm -f StripeChunk2.bin; echo) | ./stripetest -n 2 Baby-Musk-Ox.ppm restored.ppm 2 > /dev/null
+cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "2 data chunks restore OK" >> testresults.log
+(sleep 0.2; rm -f dev2/StripeChunk17.bin; echo) | ./stripetest -n 32 -t 4 -D dev1:dev2:dev3 Baby-Musk-Ox.ppm restored.ppm 17 > /dev/null
+cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "32 data chunks restore OK" >> testresults.log
+rm -rf dev1/* dev2/* dev3/*
+(sleep 0.2; rm -f dev2/StripeChunk5.bin dev2/StripeChunkXOR.bin; echo) | ./stripetest -6 -n 16 -b -D dev1:dev2:dev3 Baby-Musk-Ox.ppm restored.ppm 5 17 > /dev/null
+cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "RAID-6 16 data chunks rebuild OK" >> testresults.log
+rm -rf dev1/* dev2/* dev3/*
+(sleep 0.2; rm -f dev1/StripeChunk1.bin dev1/StripeChunk7.bin; echo) | ./stripetest -l -r -n 5 -D dev1:dev2:dev3 Baby-Musk-Ox.ppm restored.ppm 1 7 > /dev/null
+cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "LRC 5 data chunks rotating restore OK" >> testresults.log
+(sleep 0.2; rm -f StripeChunk13.bin; echo) | ./stripetest -r -n 12 -m Baby-Musk-Ox.ppm restored.ppm 13 > /dev/null
+cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "RAID-5 12 data chunks rotating restore OK" >> testresults.log
+echo | ./stripetest -n 33 Baby-Musk-Ox.ppm restored.ppm > /dev/null || echo "33 data chunks refused OK" >> testresults.log
+rm -rf dev1 dev2 dev3 StripeChunk*.bin StripeChunk*.bin.crc restored.ppm
+echo "" >> testresults.log
+
+# TEST SET 22: Streams
+# This test stripes from stdin and restores to stdout, as a backup pipeline would: the
+# image through a pipe, a stream longer than one 16 MiB batch with two chunks lost, and a
+# tar archive striped and unpacked again. No file length is given up front; it is read
+# back from the superblocks written at the end of the stream.
+echo "TEST SET 22: stream test"
+echo "TEST SET 22: stream test" >> testresults.log
+cat Baby-Musk-Ox.ppm | ./stripetest -E -t 4 - > /dev/null
+./stripetest -c - 2> /dev/null > restored.ppm
+cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "stdin stripe, stdout restore OK" >> testresults.log
+rm -f StripeChunk2.bin
+./stripetest -c -q 0 - 2 2> /dev/null | cmp - Baby-Musk-Ox.ppm >> testresults.log && echo "stdout restore with a lost chunk OK" >> testresults.log
+for copy in $(seq 60); do cat Baby-Musk-Ox.ppm; done > stream.bin
+cat stream.bin | ./stripetest -E -6 -t 4 - > /dev/null
+rm -f StripeChunk1.bin StripeChunkQ.bin
+./stripetest -c -6 -t 4 - 1 6 2> /dev/null | cmp - stream.bin >> testresults.log && echo "RAID-6 multi-batch stream with 2 lost chunks OK" >> testresults.log
+rm -f StripeChunk*.bin StripeChunk*.bin.crc
+tar cf - Baby-Musk-Ox.ppm | ./stripetest -E -r - > /dev/null
+./stripetest -c -r - 2> /dev/null | tar xOf - Baby-Musk-Ox.ppm | cmp - Baby-Musk-Ox.ppm >> testresults.log && echo "tar pipeline OK" >> testresults.log
+cat Baby-Musk-Ox.ppm | ./stripetest -E - > /dev/null
+echo | ./stripetest -c restored.ppm > /dev/null
+cmp Baby-Musk-Ox.ppm restored.ppm >> testresults.log && echo "stdin stripe, file restore OK" >> testresults.log
+rm -f StripeChunk*.bin StripeChunk*.bin.crc restored.ppm stream.bin
+echo "" >> testresults.log
+
+# TEST SET 23: Hedged Reads
+# This test restores with hedged reads on io_uring, dropping one chunk from the page cache
+# first so that its reads go to the device: a unit whose read is still out after the
+# deadline is rebuilt from parity. The restored file must match whether or not any reads
+# were hedged, also with chunks already lost, where fewer units can be rebuilt.
+echo "TEST SET 23: hedged read test"
+echo "TEST SET 23: hedged read test" >> testresults.log
+for copy in $(seq 30); do cat Baby-Musk-Ox.ppm; done > hedge.bin
+./stripetest -E -u 64k hedge.bin > /dev/null
+sync StripeChunk2.bin && dd if=StripeChunk2.bin iflag=nocache count=0 status=none
+echo | ./stripetest -c -H 20 -t 4 restored.bin > /dev/null
+cmp hedge.bin restored.bin >> testresults.log && echo "hedged restore with a cold chunk OK" >> testresults.log
+echo | ./stripetest -c -H 1 -q 64 restored.bin 1 > /dev/null
+cmp hedge.bin restored.bin >> testresults.log && echo "hedged restore with a lost chunk OK" >> testresults.log
+rm -f StripeChunk*.bin StripeChunk*.bin.crc
+./stripetest -E -6 -r hedge.bin > /dev/null
+sync StripeChunk3.bin && dd if=StripeChunk3.bin iflag=nocache count=0 status=none
+./stripetest -c -H 1 -t 2 - 2> /dev/null | cmp - hedge.bin >> testresults.log && echo "RAID-6 rotating hedged stream restore OK" >> testresults.log
+rm -f StripeChunk1.bin StripeChunk6.bin
+./stripetest -c -H 1 -t 2 - 1 6 2> /dev/null | cmp - hedge.bin >> testresults.log && echo "RAID-6 hedged restore with 2 lost chunks OK" >> testresults.log
+rm -f StripeChunk*.bin StripeChunk*.bin.crc restored.bin hedge.bin
+echo "" >> testresults.log
+
+# TEST SET 24: Failed Chunks
+# This test stripes with one chunk linked to /dev/full, so every write to it fails with
+# ENOSPC as on a full or failing device. The striping takes the chunk offline and goes on
+# degraded, or with -X moves it to a hot spare that is rebuilt in the background; either
+# way the file must restore. The chunk and its checksum sidecar are then put together on a
+# 1 MiB tmpfs that fills up, as on a failed device, mounted in a namespace of its own so
+# that no root is needed. A second failed chunk on RAID-5 is more than the code can
+# rebuild and must stop the striping with an error rather than hang.
+echo "TEST SET 24: failed chunk test"
+echo "TEST SET 24: failed chunk test" >> testresults.log
+for copy in $(seq 30); do cat Baby-Musk-Ox.ppm; done > failed.bin
+rm -f StripeChunk2.bin && ln -s /dev/full StripeChunk2.bin
+echo | ./stripetest -u 4k failed.bin restored.bin > /dev/null
+cmp failed.bin restored.bin >> testresults.log && echo "degraded stripe with a failed chunk OK" >> testresults.log
+echo | ./stripetest -u 4k -t 4 -X spare.bin failed.bin restored.bin > /dev/null
+cmp failed.bin restored.bin >> testresults.log && echo "failover to a spare OK" >> testresults.log
+rm -f StripeChunk2.bin
+echo | ./stripetest -c -X spare.bin:2 restored.bin > /dev/null
+cmp failed.bin restored.bin >> testresults.log && echo "restore from the spare OK" >> testresults.log
+rm -f StripeChunk*.bin StripeChunk*.bin.crc spare.bin spare.bin.crc
+ln -s /dev/full StripeChunk2.bin
+cat failed.bin | ./stripetest -E -6 -r -q 0 -X spare.bin - > /dev/null
+rm -f StripeChunk2.bin StripeChunk4.bin
+./stripetest -c -6 -r -X spare.bin:2 - 4 2> /dev/null | cmp - failed.bin >> testresults.log && echo "RAID-6 stream failover on io_uring with a lost chunk OK" >> testresults.log
+rm -f StripeChunk*.bin StripeChunk*.bin.crc spare.bin spare.bin.crc
+mkdir -p fullfs
+if unshare -rm true 2> /dev/null; then
+    unshare -rm bash -c "mount -t tmpfs -o size=1m tmpfs fullfs && echo | ./stripetest -u 4k -D .:fullfs:.:.:. failed.bin restored.bin" > /dev/null
+    cmp failed.bin restored.bin >> testresults.log && echo "degraded stripe with the chunk and its sidecar on a full device OK" >> testresults.log
+    rm -f StripeChunk*.bin StripeChunk*.bin.crc
+    unshare -rm bash -c "mount -t tmpfs -o size=1m tmpfs fullfs && echo | ./stripetest -u 4k -q 0 -t 4 -D .:fullfs:.:.:. -X spare.bin failed.bin restored.bin" > /dev/null
+    cmp failed.bin restored.bin >> testresults.log && echo "failover with the chunk and its sidecar on a full device OK" >> testresults.log
+else
+    echo "chunk and sidecar on a full device skipped: no user namespaces" >> testresults.log
+fi
+rmdir fullfs
+rm -f StripeChunk*.bin StripeChunk*.bin.crc spare.bin spare.bin.crc
+ln -s /dev/full StripeChunk2.bin && ln -s /dev/full StripeChunk3.bin
+echo | timeout 60 ./stripetest -t 4 -X spare.bin failed.bin restored.bin > /dev/null
+status=$?
+[ $status -ne 0 ] && [ $status -ne 124 ] && echo "RAID-5 stripe with 2 failed chunks stops OK" >> testresults.log
+rm -f StripeChunk*.bin StripeChunk*.bin.crc spare.bin spare.bin.crc restored.bin failed.bin
+echo "" >> testresults.log
+
+# TEST SET 25: Open Chunk Sets
+# This test drives the C++ wrapper raid::StripeSet through settest: create, stripe, read
+# back, an update in place through the write-back cache, a scrub, which has to write the
+# cache out so that a restore from the chunk files alone sees the update, moves, close
+# and reopen, and finally half the file striped over a set with a lost chunk, which has
+# to recreate the chunk. The chunks left behind must have the sizes of chunks striped
+# from that half afresh, so no stale tail of the longer contents survives.
+echo "TEST SET 25: open chunk set test"
+echo "TEST SET 25: open chunk set test" >> testresults.log
+head -c $(( $(stat -c %s Baby-Musk-Ox.ppm) / 2 )) Baby-Musk-Ox.ppm > half.ppm
+for opts in "" "-6 -r" "-l -u 4k" "-u 4k -k 2"; do
+    rm -f StripeChunk*.bin StripeChunk*.bin.crc
+    ./settest $opts Baby-Musk-Ox.ppm restored.ppm > settest.log && echo "settest $opts: every check OK" >> testresults.log
+    ls StripeChunk*.bin | xargs stat -c "%n %s" > sizes.log
+    rm -f StripeChunk*.bin StripeChunk*.bin.crc
+    ./stripetest -E $opts half.ppm > /dev/null
+    ls StripeChunk*.bin | xargs stat -c "%n %s" | cmp - sizes.log >> testresults.log &&
+        echo "settest $opts: chunks cut to the shorter contents OK" >> testresults.log
+done
+rm -f StripeChunk*.bin StripeChunk*.bin.crc restored.ppm half.ppm settest.log sizes.log
+echo "" >> testresults.log
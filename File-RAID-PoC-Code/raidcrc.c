@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "raidlib.h"
+#include "raidcrc.h"
+
+#if defined(__x86_64__)
+#define RAID_CRC_X86 (1)
+#include <immintrin.h>
+#endif
+
+// Runtime-dispatched CRC32C kernels
+//
+// The kernels update the raw CRC register: no initial or final inversion, which
+// crc32c() applies around them. With the register starting at 0 the CRC is linear in
+// the data, which is what lets lanes be combined and deltas be patched in.
+
+#define CRC_POLY (0x82f63b78)  // 0x1edc6f41 bit-reversed
+#define CRC_LANE (1024)        // Bytes per stream in the three-stream SSE4.2 kernel
+
+typedef uint32_t (*crcKernel_t)(uint32_t crc, const unsigned char *buf, size_t len);
+
+// Slicing-by-8 tables: crcTable[k][b] is the CRC of byte b followed by k zero bytes
+static uint32_t crcTable[8][256];
+
+// x^(2^k) modulo the polynomial, for shifting a CRC past runs of zero bytes
+static uint32_t crcPow2[64];
+
+// Multipliers that move a lane's CRC past one and two more lanes
+static uint32_t crcLane1, crcLane2;
+
+// a * b modulo the polynomial, bit-reflected; a must not be 0
+static uint32_t crcMulMod(uint32_t a, uint32_t b)
+{
+    uint32_t m = (uint32_t)1 << 31, p = 0;
+
+    for(;;)
+    {
+        if(a & m)
+        {
+            p ^= b;
+            if((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC_POLY : b >> 1;
+    }
+
+    return p;
+}
+
+// x^(8 * len) modulo the polynomial: multiplying a raw CRC by it appends len zero bytes
+static uint32_t crcShiftBytes(size_t len)
+{
+    uint32_t p = (uint32_t)1 << 31;
+    int k;
+
+    for(k = 3; len != 0; len >>= 1, k++)
+        if(len & 1)
+            p = crcMulMod(crcPow2[k], p);
+
+    return p;
+}
+
+// Portable kernel, eight bytes per step through the slicing tables
+static uint32_t crcSlice8(uint32_t crc, const unsigned char *buf, size_t len)
+{
+    uint32_t lo, hi;
+
+    for(; len >= 8; buf += 8, len -= 8)
+    {
+        lo = crc ^ ((uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24));
+        hi = (uint32_t)buf[4] | ((uint32_t)buf[5] << 8) | ((uint32_t)buf[6] << 16) | ((uint32_t)buf[7] << 24);
+        crc = crcTable[7][lo & 0xff] ^ crcTable[6][(lo >> 8) & 0xff] ^
+              crcTable[5][(lo >> 16) & 0xff] ^ crcTable[4][lo >> 24] ^
+              crcTable[3][hi & 0xff] ^ crcTable[2][(hi >> 8) & 0xff] ^
+              crcTable[1][(hi >> 16) & 0xff] ^ crcTable[0][hi >> 24];
+    }
+
+    for(; len > 0; buf++, len--)
+        crc = (crc >> 8) ^ crcTable[0][(crc ^ *buf) & 0xff];
+
+    return crc;
+}
+
+#ifdef RAID_CRC_X86
+
+// The crc32 instruction has a latency of three cycles and a throughput of one, so three
+// lanes of CRC_LANE bytes are run side by side and their CRCs combined
+__attribute__((target("sse4.2")))
+static uint32_t crcSSE42(uint32_t crc, const unsigned char *buf, size_t len)
+{
+    uint64_t c0 = crc, c1, c2, w0, w1, w2;
+    size_t idx;
+
+    for(; len >= 3 * CRC_LANE; buf += 3 * CRC_LANE, len -= 3 * CRC_LANE)
+    {
+        c1 = c2 = 0;
+        for(idx = 0; idx < CRC_LANE; idx += 8)
+        {
+            memcpy(&w0, buf + idx, 8);
+            memcpy(&w1, buf + CRC_LANE + idx, 8);
+            memcpy(&w2, buf + 2 * CRC_LANE + idx, 8);
+            c0 = _mm_crc32_u64(c0, w0);
+            c1 = _mm_crc32_u64(c1, w1);
+            c2 = _mm_crc32_u64(c2, w2);
+        }
+        c0 = crcMulMod(crcLane2, (uint32_t)c0) ^ crcMulMod(crcLane1, (uint32_t)c1) ^ (uint32_t)c2;
+    }
+
+    for(; len >= 8; buf += 8, len -= 8)
+    {
+        memcpy(&w0, buf, 8);
+        c0 = _mm_crc32_u64(c0, w0);
+    }
+
+    for(; len > 0; buf++, len--)
+        c0 = _mm_crc32_u8((uint32_t)c0, *buf);
+
+    return (uint32_t)c0;
+}
+
+static int sse42Supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2") ? TRUE : FALSE;
+}
+
+#endif
+
+static int alwaysSupported(void)
+{
+    return TRUE;
+}
+
+typedef struct crc_kernel
+{
+    const char *name;
+    crcKernel_t update;
+    int (*supported)(void);
+} crckernel_t;
+
+// Kernel table, ordered from least to most preferred
+static const crckernel_t crcKernelTable[] =
+{
+    { "slice8", crcSlice8, alwaysSupported },
+#ifdef RAID_CRC_X86
+    { "sse42",  crcSSE42,  sse42Supported },
+#endif
+};
+
+#define CRC_KERNEL_COUNT ((int)(sizeof(crcKernelTable) / sizeof(crcKernelTable[0])))
+
+static int activeCrcKernel = 0;
+static crcKernel_t raidCrc = crcSlice8;
+
+const char *crc32cActiveKernel(void)
+{
+    return crcKernelTable[activeCrcKernel].name;
+}
+
+int crc32cSelectKernel(const char *name)
+{
+    int idx;
+
+    for(idx = 0; idx < CRC_KERNEL_COUNT; idx++)
+    {
+        if((strcmp(crcKernelTable[idx].name, name) == 0) && crcKernelTable[idx].supported())
+        {
+            activeCrcKernel = idx;
+            raidCrc = crcKernelTable[idx].update;
+            return OK;
+        }
+    }
+
+    return ERROR;
+}
+
+// Build the tables and pick the fastest supported kernel before main() runs
+__attribute__((constructor))
+static void crc32cInit(void)
+{
+    uint32_t crc;
+    int idx, bit, k;
+
+    for(idx = 0; idx < 256; idx++)
+    {
+        crc = idx;
+        for(bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ CRC_POLY : crc >> 1;
+        crcTable[0][idx] = crc;
+    }
+    for(k = 1; k < 8; k++)
+        for(idx = 0; idx < 256; idx++)
+            crcTable[k][idx] = (crcTable[k - 1][idx] >> 8) ^ crcTable[0][crcTable[k - 1][idx] & 0xff];
+
+    // x^1, then each entry the square of the one before
+    crcPow2[0] = (uint32_t)1 << 30;
+    for(k = 1; k < 64; k++)
+        crcPow2[k] = crcMulMod(crcPow2[k - 1], crcPow2[k - 1]);
+
+    crcLane1 = crcShiftBytes(CRC_LANE);
+    crcLane2 = crcShiftBytes(2 * CRC_LANE);
+
+    for(idx = CRC_KERNEL_COUNT - 1; idx >= 0; idx--)
+    {
+        if(crcKernelTable[idx].supported())
+        {
+            activeCrcKernel = idx;
+            raidCrc = crcKernelTable[idx].update;
+            break;
+        }
+    }
+}
+
+uint32_t crc32c(uint32_t crc, const unsigned char *buf, size_t len)
+{
+    return ~raidCrc(~crc, buf, len);
+}
+
+// The CRC of the new buffer is the old CRC plus the raw CRC of the delta moved past the
+// bytes after it; the bytes before it are zero in the delta and add nothing
+uint32_t crc32cPatch(uint32_t crc, size_t len, size_t offset, const unsigned char *delta, size_t dlen)
+{
+    return crc ^ crcMulMod(crcShiftBytes(len - offset - dlen), raidCrc(0, delta, dlen));
+}
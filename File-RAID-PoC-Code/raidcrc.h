@@ -0,0 +1,24 @@
+#ifndef RAIDCRC_H
+#define RAIDCRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC32C (Castagnoli, polynomial 0x1edc6f41 reflected), the checksum of iSCSI, ext4 and
+// btrfs. The SSE4.2 crc32 instruction computes it directly; three independent streams
+// are run at once to cover its latency and then combined. Without SSE4.2 a table-driven
+// slicing-by-8 kernel is used. The kernel is selected at load time.
+
+// CRC of len bytes of buf, continuing from crc, the CRC of the bytes before them (0 to start)
+uint32_t crc32c(uint32_t crc, const unsigned char *buf, size_t len);
+
+// CRC of a len-byte buffer, given crc, its CRC before bytes [offset, offset + dlen) were
+// XORed with delta. Costs a pass over the delta only, not over the whole buffer.
+uint32_t crc32cPatch(uint32_t crc, size_t len, size_t offset, const unsigned char *delta, size_t dlen);
+
+// CRC kernel selected for this CPU: "slice8" or "sse42". crc32cSelectKernel returns
+// ERROR if the name is unknown or not supported here.
+const char *crc32cActiveKernel(void);
+int crc32cSelectKernel(const char *name);
+
+#endif
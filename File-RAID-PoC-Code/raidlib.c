@@ -1,13 +1,23 @@
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "raidlib.h" // Include the custom RAID library
+#include "raidsimd.h" // Runtime-dispatched XOR kernels
+#include "raid6lib.h" // RAID-6 P+Q parity
+#include "raidcrc.h" // CRC32C unit checksums
+#include "raiduring.h" // io_uring engine
 
 #ifdef RAID64
 #include "raidlib64.h" // Include 64-bit RAID library if defined
@@ -17,6 +27,8 @@
 #define PTR_CAST (unsigned char *)
 #endif
 
+#ifndef RAID64 // The word-wide kernels live in raidlib64.c
+
 // RAID-5 encoding
 //
 // This provides 80% capacity with 1/5 LBAs (Logical Block Addresses) used for parity.
@@ -34,11 +46,8 @@ void xorLBA(unsigned char *LBA1,
             unsigned char *LBA4,
             unsigned char *PLBA)
 {
-    int idx;
-
-    // Compute XOR for each byte in the sector to generate the parity LBA
-    for(idx=0; idx < SECTOR_SIZE; idx++)
-        *(PLBA + idx) = (*(LBA1 + idx)) ^ (*(LBA2 + idx)) ^ (*(LBA3 + idx)) ^ (*(LBA4 + idx));
+    // XOR the four LBAs with the widest kernel this CPU supports
+    raidXor4(LBA1, LBA2, LBA3, LBA4, PLBA, SECTOR_SIZE);
 }
 
 // RAID-5 Rebuild
@@ -52,18 +61,9 @@ void rebuildLBA(unsigned char *LBA1,
                 unsigned char *PLBA,
                 unsigned char *RLBA)
 {
-    int idx;
-    unsigned char checkParity;
-
-    // Rebuild the missing LBA (RLBA) using the remaining LBAs and parity LBA
-    for(idx = 0; idx < SECTOR_SIZE; idx++)
-    {
-        // Parity check word is simply XOR of remaining good LBAs
-        checkParity = (*(LBA1 + idx)) ^ (*(LBA2 + idx)) ^ (*(LBA3 + idx));
-
-        // Rebuilt LBA is XOR of original parity and parity check word
-        *(RLBA + idx) = (*(PLBA + idx)) ^ (checkParity);
-    }
+    // Rebuilt LBA is XOR of original parity and the remaining good LBAs,
+    // which is the same 4-way XOR used for encoding
+    raidXor4(LBA1, LBA2, LBA3, PLBA, RLBA, SECTOR_SIZE);
 }
 
 // Check if two LBAs are equivalent
@@ -86,426 +86,3926 @@ int checkEquivLBA(unsigned char *LBA1,
     return OK;
 }
 
-// Stripes the input file across multiple chunks and returns the number of bytes written
-int stripeFile(char *inputFileName, int offsetSectors)
+#endif
+
+// Default chunk files, in the current directory. Data chunk i is StripeChunk<i+1>.bin,
+// and so is every chunk of a rotating layout, where each file holds data and parity in
+// turn. The names are filled in before main() runs.
+static char numberedChunkName[MAX_CHUNKS][sizeof("StripeChunk00.bin")];
+
+// Parity chunk files for each code of a fixed layout, in chunk order after the data chunks
+static char *parityChunkName[][3] =
 {
-    int fd[5], idx;
-    FILE *fdin;
-    unsigned char stripe[5 * 512]; // Buffer to hold a stripe (4 data chunks + 1 XOR parity)
-    int offset = 0, bread = 0, btoread = (4 * 512), bwritten = 0, btowrite = (512), sectorCnt = 0, byteCnt = 0;
+    { "StripeChunkXOR.bin", NULL, NULL },                             // RAID_CODE_XOR
+    { "StripeChunkXOR.bin", "StripeChunkQ.bin", NULL },               // RAID_CODE_PQ
+    { "StripeChunkL1.bin", "StripeChunkL2.bin", "StripeChunkQ.bin" }  // RAID_CODE_LRC
+};
 
-    // Open the input file for reading
-    fdin = fopen(inputFileName, "r");
+__attribute__((constructor))
+static void chunkNamesInit(void)
+{
+    int idx;
+
+    for(idx = 0; idx < MAX_CHUNKS; idx++)
+        snprintf(numberedChunkName[idx], sizeof(numberedChunkName[idx]), "StripeChunk%d.bin", idx + 1);
+}
 
-    // Open files for each stripe chunk and the XOR parity chunk
-    fd[0] = open("StripeChunk1.bin", O_RDWR | O_CREAT, 00644);
-    fd[1] = open("StripeChunk2.bin", O_RDWR | O_CREAT, 00644);
-    fd[2] = open("StripeChunk3.bin", O_RDWR | O_CREAT, 00644);
-    fd[3] = open("StripeChunk4.bin", O_RDWR | O_CREAT, 00644);
-    fd[4] = open("StripeChunkXOR.bin", O_RDWR | O_CREAT, 00644);
+// Configuration used by the original stripeFile/restoreFile entry points
+static raidcfg_t defaultConfig = { RAID_CODE_XOR, RAID_LAYOUT_FIXED };
 
-    do
+// Chunk sets are handled as 64-bit masks, bit idx for the 0-based chunk idx
+#define CHUNK_BIT(idx) ((uint64_t)1 << (idx))
+#define UNIT(stripe, idx, unit) (&(stripe)[(size_t)(idx) * (unit)])
+
+// Stripe units are addressed through pointer arrays of MAX_CHUNKS + 1 entries, the last
+// for a scratch unit for parity that is not stored
+#define SCRATCH_UNIT (MAX_CHUNKS)
+
+// Data chunks per stripe
+static int dataCount(raidcfg_t *cfg)
+{
+    return ((cfg->dataChunks > 0) ? cfg->dataChunks : DATA_CHUNKS);
+}
+
+// The data units of a stripe, which come first in unit order
+static uint64_t dataMask(raidcfg_t *cfg)
+{
+    return (CHUNK_BIT(dataCount(cfg)) - 1);
+}
+
+// Number of chunk files written for a parity code
+static int chunkCount(raidcfg_t *cfg)
+{
+    if(cfg->code == RAID_CODE_LRC)
+        return dataCount(cfg) + LRC_GROUPS + 1;
+
+    return dataCount(cfg) + ((cfg->code == RAID_CODE_PQ) ? 2 : 1);
+}
+
+// Sector size in bytes: the unit granularity and buffer alignment
+static size_t sectorBytes(raidcfg_t *cfg)
+{
+    return ((cfg->sectorSize > 0) ? cfg->sectorSize : SECTOR_SIZE);
+}
+
+// Stripe unit in bytes, one sector when unset
+static size_t unitBytes(raidcfg_t *cfg)
+{
+    return ((cfg->unitSize > 0) ? cfg->unitSize : sectorBytes(cfg));
+}
+
+// Check the configuration before any file is touched
+static int checkConfig(raidcfg_t *cfg)
+{
+    size_t sector = sectorBytes(cfg), unit = unitBytes(cfg);
+
+    if((cfg->code < RAID_CODE_XOR) || (cfg->code > RAID_CODE_LRC) ||
+       (cfg->layout < RAID_LAYOUT_FIXED) || (cfg->layout > RAID_LAYOUT_ROTATING))
     {
-        // Read a stripe or until the end of the file
-        offset = 0, bread = 0, btoread = (4 * 512);
-        do
-        {
-            bread = fread(&stripe[offset], 1, btoread, fdin); 
-            offset += bread;
-            btoread = (4 * 512) - bread;
-        }
-        while (!(feof(fdin)) && (btoread > 0));
+        printf("raid config: unknown code %d or layout %d\n", cfg->code, cfg->layout);
+        return ERROR;
+    }
 
-        if((offset < (4 * 512)) && (feof(fdin)))
-        {
-            // Handle the case when the end of file is reached before a full stripe is read
-            printf("hit end of file\n");
-            bzero(&stripe[offset], btoread); // Zero-fill the remaining stripe
-            byteCnt += offset;
-        }
-        else
-        {
-            printf("read full stripe\n");
-            assert(offset == (4 * 512)); // Ensure a full stripe was read
-            byteCnt += (4 * 512);
-        };
+    if((sector < SECTOR_SIZE) || (sector & (sector - 1)) || (unit % sector) || (unit > RAID_MAX_UNIT))
+    {
+        printf("raid config: stripe unit %zu must be a multiple of the sector size %zu (a power of two "
+               "of at least %d bytes) and at most %d bytes\n", unit, sector, SECTOR_SIZE, RAID_MAX_UNIT);
+        return ERROR;
+    }
 
-        // Compute XOR parity for the stripe
-        xorLBA(PTR_CAST &stripe[0],
-               PTR_CAST &stripe[512],
-               PTR_CAST &stripe[1024],
-               PTR_CAST &stripe[1536],
-               PTR_CAST &stripe[2048]);
+    if((cfg->ioEngine < RAID_IO_SYNC) || (cfg->ioEngine > RAID_IO_MMAP) || (cfg->queueDepth < 0))
+    {
+        printf("raid config: unknown I/O engine %d or queue depth %d\n", cfg->ioEngine, cfg->queueDepth);
+        return ERROR;
+    }
 
-        // Write out the stripe chunks and XOR parity chunk to their respective files
-        offset = 0, bwritten = 0, btowrite = (512);
-        do
-        {
-            bwritten = write(fd[0], &stripe[offset], 512); 
-            offset += bwritten;
-            btowrite = (512) - bwritten;
-        }
-        while (btowrite > 0);
+    if((cfg->dataChunks != 0) && ((cfg->dataChunks < 2) || (cfg->dataChunks > RAID_MAX_DATA)))
+    {
+        printf("raid config: %d data chunks, must be 2 to %d\n", cfg->dataChunks, RAID_MAX_DATA);
+        return ERROR;
+    }
 
-        offset = 512, bwritten = 0, btowrite = (512);
-        do
-        {
-            bwritten = write(fd[1], &stripe[offset], 512); 
-            offset += bwritten;
-            btowrite = (512) - bwritten;
-        }
-        while (btowrite > 0);
+    if((cfg->cacheStripes < 0) || (cfg->cacheAgeMs < 0))
+    {
+        printf("raid config: bad cache of %d stripes or age %d ms\n", cfg->cacheStripes, cfg->cacheAgeMs);
+        return ERROR;
+    }
 
-        offset = 1024, bwritten = 0, btowrite = (512);
-        do
-        {
-            bwritten = write(fd[2], &stripe[offset], 512); 
-            offset += bwritten;
-            btowrite = (512) - bwritten;
-        }
-        while (btowrite > 0);
+    if((cfg->spareChunk < 0) || (cfg->spareChunk > chunkCount(cfg)) || ((cfg->spareChunk != 0) && (cfg->sparePath == NULL)))
+    {
+        printf("raid config: spare chunk %d without a spare, or not in the set\n", cfg->spareChunk);
+        return ERROR;
+    }
 
-        offset = 1536, bwritten = 0, btowrite = (512);
-        do
-        {
-            bwritten = write(fd[3], &stripe[offset], 512); 
-            offset += bwritten;
-            btowrite = (512) - bwritten;
-        }
-        while (btowrite > 0);
+    // The mmap engine never sees a failed write, so it would never fail over
+    if((cfg->sparePath != NULL) && (cfg->spareChunk == 0) && (cfg->ioEngine == RAID_IO_MMAP))
+    {
+        printf("raid config: a spare to fail over to needs the sync or io_uring engine, not mmap\n");
+        return ERROR;
+    }
 
-        offset = 2048, bwritten = 0, btowrite = (512);
-        do
-        {
-            bwritten = write(fd[4], &stripe[offset], 512); 
-            offset += bwritten;
-            btowrite = (512) - bwritten;
-        }
-        while (btowrite > 0);
+    return OK;
+}
+
+// Bytes of a stripe buffer: one unit per chunk, in unit order, then the scratch unit
+static size_t stripeBufBytes(raidcfg_t *cfg)
+{
+    return (chunkCount(cfg) + 1) * unitBytes(cfg);
+}
 
-        sectorCnt += 4;
+// Allocate a sector-aligned stripe buffer, with room for the scratch unit
+static unsigned char *allocStripe(raidcfg_t *cfg)
+{
+    void *stripe;
 
+    if(posix_memalign(&stripe, sectorBytes(cfg), stripeBufBytes(cfg)) != 0)
+    {
+        printf("raid: cannot allocate a %zu byte stripe buffer\n", stripeBufBytes(cfg));
+        return NULL;
     }
-    while (!(feof(fdin))); // Continue until the end of file is reached
 
-    // Close all file descriptors
-    fclose(fdin);
-    for(idx = 0; idx < 5; idx++) close(fd[idx]);
+    return stripe;
+}
+
+// Default file name of the 0-based chunk idx
+static char *defaultChunkName(raidcfg_t *cfg, int idx)
+{
+    if((cfg->layout == RAID_LAYOUT_ROTATING) || (idx < dataCount(cfg)))
+        return numberedChunkName[idx];
 
-    return(byteCnt); // Return the total number of bytes written
+    return parityChunkName[cfg->code][idx - dataCount(cfg)];
 }
 
-// Restores the original file from the striped chunks
-//
-// missingChunk = 0 for no missing chunk
-//              = 1 ... 4 for missing data chunk
-//              = 5 for missing XOR chunk
-int restoreFile(char *outputFileName, int offsetSectors, int fileLength, int missingChunk)
+// File of the 0-based chunk idx: the spare once the chunk has moved there, its path in
+// cfg->chunkPath, or its default name
+static char *chunkName(raidcfg_t *cfg, int idx)
 {
-    int fd[5], idx;
-    FILE *fdout;
-    unsigned char stripe[5 * 512];
-    int offset = 0, bread = 0, btoread = (4 * 512), bwritten = 0, btowrite = (512), sectorCnt = fileLength / 512;
-    int stripeCnt = fileLength / (4 * 512);
-    int lastStripeBytes = fileLength % (4 * 512);
+    if((cfg->sparePath != NULL) && (cfg->spareChunk == idx + 1))
+        return cfg->sparePath;
+    if(cfg->chunkPath != NULL)
+        return cfg->chunkPath[idx];
 
-    // Open the output file for writing the restored data
-    fdout = fopen(outputFileName, "w");
+    return defaultChunkName(cfg, idx);
+}
 
-    // Open files for each stripe chunk and the XOR parity chunk
-    fd[0] = open("StripeChunk1.bin", O_RDWR | O_CREAT, 00644);
-    fd[1] = open("StripeChunk2.bin", O_RDWR | O_CREAT, 00644);
-    fd[2] = open("StripeChunk3.bin", O_RDWR | O_CREAT, 00644);
-    fd[3] = open("StripeChunk4.bin", O_RDWR | O_CREAT, 00644);
-    fd[4] = open("StripeChunkXOR.bin", O_RDWR | O_CREAT, 00644);
+int raidChunkCount(raidcfg_t *cfg)
+{
+    return chunkCount(cfg);
+}
 
-    for(idx = 0; idx < stripeCnt; idx++)
-    {
-        // Read in the stripe chunks and XOR code
+const char *raidChunkName(raidcfg_t *cfg, int idx)
+{
+    return defaultChunkName(cfg, idx);
+}
 
-        if(missingChunk == 1)
-        {
-            printf("will rebuild chunk 1\n");
-        }
-        else
-        {
-            offset = 0, bread = 0, btoread = (512);
-            do
-            {
-                bread = read(fd[0], &stripe[offset], 512); 
-                offset += bread;
-                btoread = (512) - bread;
-            }
-            while (btoread > 0);
-        }
+// Number of distinct unit placements the layout cycles through
+static int layoutPeriod(raidcfg_t *cfg)
+{
+    return ((cfg->layout == RAID_LAYOUT_ROTATING) ? chunkCount(cfg) : 1);
+}
 
-        if(missingChunk == 2)
-        {
-            printf("will rebuild chunk 2\n");
-        }
-        else
-        {
-            offset = 512, bread = 0, btoread = (512);
-            do
-            {
-                bread = read(fd[1], &stripe[offset], 512); 
-                offset += bread;
-                btoread = (512) - bread;
-            }
-            while (btoread > 0);
-        }
+// Placement of stripe stripeIdx: unit u of the stripe (data units, then parity units)
+// lives in chunk (u + shift) % nchunks. Left-symmetric rotation moves the parity back one
+// chunk every stripe, with the data starting in the chunk after it.
+static int stripeShift(raidcfg_t *cfg, off_t stripeIdx)
+{
+    int nchunks = chunkCount(cfg);
 
-        if(missingChunk == 3)
-        {
-            printf("will rebuild chunk 3\n");
-        }
-        else
-        {
-            offset = 1024, bread = 0, btoread = (512);
-            do
-            {
-                bread = read(fd[2], &stripe[offset], 512); 
-                offset += bread;
-                btoread = (512) - bread;
-            }
-            while (btoread > 0);
-        }
+    if(cfg->layout != RAID_LAYOUT_ROTATING)
+        return 0;
 
-        if(missingChunk == 4)
-        {
-            printf("will rebuild chunk 4\n");
-        }
-        else
-        {
-            offset = 1536, bread = 0, btoread = (512);
-            do
-            {
-                bread = read(fd[3], &stripe[offset], 512); 
-                offset += bread;
-                btoread = (512) - bread;
-            }
-            while (btoread > 0);
-        }
+    return (nchunks - (stripeIdx % nchunks)) % nchunks;
+}
 
-        if(missingChunk == 5)
-        {
-            printf("will rebuild chunk 5\n");
-        }
-        else
-        {
-            offset = 2048, bread = 0, btoread = (512);
-            do
-            {
-                bread = read(fd[4], &stripe[offset], 512); 
-                offset += bread;
-                btoread = (512) - bread;
-            }
-            while (btoread > 0);
-        }
+// Convert a mask in unit order to chunk order for a stripe with the given shift
+static uint64_t unitsToChunks(uint64_t mask, int shift, int nchunks)
+{
+    return ((mask << shift) | (mask >> (nchunks - shift))) & (CHUNK_BIT(nchunks) - 1);
+}
 
-        // Rebuild the missing chunk if necessary
-        if(missingChunk == 1)
-        {
-            rebuildLBA(PTR_CAST &stripe[512], 
-                       PTR_CAST &stripe[1024], 
-                       PTR_CAST &stripe[1536], 
-                       PTR_CAST &stripe[2048], 
-                       PTR_CAST &stripe[0]);
-        }
+// Convert a mask in chunk order to unit order for a stripe with the given shift
+static uint64_t chunksToUnits(uint64_t mask, int shift, int nchunks)
+{
+    return unitsToChunks(mask, nchunks - shift, nchunks);
+}
 
-        if(missingChunk == 2)
-        {
-            rebuildLBA(PTR_CAST &stripe[0], 
-                       PTR_CAST &stripe[1024], 
-                       PTR_CAST &stripe[1536], 
-                       PTR_CAST &stripe[2048], 
-                       PTR_CAST &stripe[512]);
-        }
+// First data chunk of LRC local group g; the data chunks are split evenly between the
+// groups, the last group taking the odd one
+static int lrcGroupFirst(raidcfg_t *cfg, int group)
+{
+    return (group * dataCount(cfg)) / LRC_GROUPS;
+}
 
-        if(missingChunk == 3)
-        {
-            rebuildLBA(PTR_CAST &stripe[0],
-                       PTR_CAST &stripe[512],
-                       PTR_CAST &stripe[1536],
-                       PTR_CAST &stripe[2048],
-                       PTR_CAST &stripe[1024]);
-        }
+// Data chunks in LRC local group g
+static int lrcGroupData(raidcfg_t *cfg, int group)
+{
+    return lrcGroupFirst(cfg, group + 1) - lrcGroupFirst(cfg, group);
+}
 
-        if(missingChunk == 4)
-        {
-            rebuildLBA(PTR_CAST &stripe[0],
-                       PTR_CAST &stripe[512],
-                       PTR_CAST &stripe[1024],
-                       PTR_CAST &stripe[2048],
-                       PTR_CAST &stripe[1536]);
-        }
+// LRC local group g: its data chunks plus its local XOR parity chunk
+static uint64_t lrcGroupMask(raidcfg_t *cfg, int group)
+{
+    return (((CHUNK_BIT(lrcGroupData(cfg, group)) - 1) << lrcGroupFirst(cfg, group)) |
+            CHUNK_BIT(dataCount(cfg) + group));
+}
 
-        if(missingChunk == 5)
-        {
-            rebuildLBA(PTR_CAST &stripe[0],
-                       PTR_CAST &stripe[512],
-                       PTR_CAST &stripe[1024],
-                       PTR_CAST &stripe[1536],
-                       PTR_CAST &stripe[2048]);
-        }
+// Write all of buf at file offset pos, retrying short writes; a failed write returns
+// ERROR instead of being added to the offset
+static int writeFull(int fd, unsigned char *buf, size_t len, off_t pos)
+{
+    size_t offset = 0;
+    ssize_t bwritten;
 
-        // Write the restored stripe to the output file
-        offset = 0, bwritten = 0, btowrite = (4 * 512);
+    while(offset < len)
+    {
+        bwritten = pwrite(fd, &buf[offset], len - offset, pos + offset);
+        if(bwritten < 0)
+            return ERROR;
+        offset += bwritten;
+    }
 
-        do
-        {
-            bwritten = fwrite(&stripe[offset], 1, btowrite, fdout); 
-            offset += bwritten;
-            btowrite = (4 * 512) - bwritten;
-        }
-        while ((btowrite > 0));
+    return OK;
+}
 
+// Read all of buf from file offset pos, retrying short reads; hitting end of file early
+// returns ERROR
+static int readFull(int fd, unsigned char *buf, size_t len, off_t pos)
+{
+    size_t offset = 0;
+    ssize_t bread;
+
+    while(offset < len)
+    {
+        bread = pread(fd, &buf[offset], len - offset, pos + offset);
+        if(bread <= 0)
+            return ERROR;
+        offset += bread;
     }
 
-    // Handle the last stripe if it's not a full stripe
-    if(lastStripeBytes)
+    return OK;
+}
+
+// Offset of the first unit in a chunk file: the superblock sector comes first
+static off_t dataOffset(raidcfg_t *cfg)
+{
+    return (off_t)sectorBytes(cfg);
+}
+
+// Read the superblock of an open chunk file; ERROR when it has none
+static int readSuperblock(int fd, raidsb_t *sb)
+{
+    if((readFull(fd, (unsigned char *)sb, sizeof(*sb), 0) != OK) || (sb->magic != RAID_SB_MAGIC) ||
+       (sb->version != RAID_SB_VERSION))
+        return ERROR;
+
+    return OK;
+}
+
+// Write the superblock sector of each chunk in mask
+static int writeSuperblocks(raidcfg_t *cfg, int *fd, uint64_t mask, off_t fileLength, uint64_t generation)
+{
+    unsigned char *sector;
+    raidsb_t *sb;
+    int idx, rc = OK;
+
+    if((sector = calloc(1, sectorBytes(cfg))) == NULL)
+        return ERROR;
+
+    sb = (raidsb_t *)sector;
+    sb->magic = RAID_SB_MAGIC;
+    sb->version = RAID_SB_VERSION;
+    sb->sectorSize = sectorBytes(cfg);
+    sb->fileLength = fileLength;
+    sb->generation = generation;
+    sb->unitSize = unitBytes(cfg);
+    sb->dataChunks = dataCount(cfg);
+    sb->parityChunks = chunkCount(cfg) - dataCount(cfg);
+    sb->code = cfg->code;
+    sb->layout = cfg->layout;
+
+    for(idx = 0; (idx < chunkCount(cfg)) && (rc == OK); idx++)
     {
-        if(missingChunk == 1)
-        {
-            printf("will rebuild chunk 1\n");
-        }
-        else
-        {
-            offset = 0, bread = 0, btoread = (512);
-            do
-            {
-                bread = read(fd[0], &stripe[offset], 512); 
-                offset += bread;
-                btoread = (512) - bread;
-            }
-            while (btoread > 0);
-        }
+        if(!(mask & CHUNK_BIT(idx)))
+            continue;
 
-        if(missingChunk == 2)
-        {
-            printf("will rebuild chunk 2\n");
-        }
-        else
+        sb->chunkIndex = idx;
+        if(writeFull(fd[idx], sector, sectorBytes(cfg), 0) != OK)
         {
-            offset = 512, bread = 0, btoread = (512);
-            do
-            {
-                bread = read(fd[1], &stripe[offset], 512); 
-                offset += bread;
-                btoread = (512) - bread;
-            }
-            while (btoread > 0);
+            perror(chunkName(cfg, idx));
+            rc = ERROR;
         }
+    }
 
-        if(missingChunk == 3)
-        {
-            printf("will rebuild chunk 3\n");
-        }
+    free(sector);
+    return rc;
+}
+
+// Check the superblocks of the chunks in mask against cfg before any data is read.
+// Chunks that cannot be opened, have no superblock, were written with another geometry
+// or for another position, or are older than the newest generation found are added to
+// *bad. The newest superblock is returned in *newest; ERROR when no chunk is good.
+static int checkChunkSet(raidcfg_t *cfg, uint64_t mask, uint64_t *bad, raidsb_t *newest)
+{
+    raidsb_t sb[MAX_CHUNKS];
+    int idx, fd, nchunks = chunkCount(cfg);
+    uint64_t good = 0;
+    char why[64];
+
+    *bad = 0;
+    bzero(newest, sizeof(*newest));
+
+    for(idx = 0; idx < nchunks; idx++)
+    {
+        if(!(mask & CHUNK_BIT(idx)))
+            continue;
+
+        why[0] = '\0';
+        if((fd = open(chunkName(cfg, idx), O_RDONLY)) < 0)
+            snprintf(why, sizeof(why), "missing");
         else
         {
-            offset = 1024, bread = 0, btoread = (512);
-            do
-            {
-                bread = read(fd[2], &stripe[offset], 512); 
-                offset += bread;
-                btoread = (512) - bread;
-            }
-            while (btoread > 0);
+            if(readSuperblock(fd, &sb[idx]) != OK)
+                snprintf(why, sizeof(why), "no superblock");
+            close(fd);
         }
 
-        if(missingChunk == 4)
-        {
-            printf("will rebuild chunk 4\n");
-        }
-        else
+        if((why[0] == '\0') &&
+           ((sb[idx].sectorSize != sectorBytes(cfg)) || (sb[idx].unitSize != unitBytes(cfg)) ||
+            (sb[idx].dataChunks != dataCount(cfg)) || (sb[idx].parityChunks != nchunks - dataCount(cfg)) ||
+            (sb[idx].code != cfg->code) || (sb[idx].layout != cfg->layout)))
+            snprintf(why, sizeof(why), "written with another geometry");
+        else if((why[0] == '\0') && (sb[idx].chunkIndex != idx))
+            snprintf(why, sizeof(why), "out of place, it holds chunk %d", sb[idx].chunkIndex + 1);
+
+        if(why[0] != '\0')
         {
-            offset = 1536, bread = 0, btoread = (512);
-            do
-            {
-                bread = read(fd[3], &stripe[offset], 512); 
-                offset += bread;
-                btoread = (512) - bread;
-            }
-            while (btoread > 0);
+            printf("%s: %s, treating it as lost\n", chunkName(cfg, idx), why);
+            *bad |= CHUNK_BIT(idx);
+            continue;
         }
 
-        if(missingChunk == 5)
+        good |= CHUNK_BIT(idx);
+        if(sb[idx].generation > newest->generation)
+            *newest = sb[idx];
+    }
+
+    // A chunk left over from an older chunk set is stale
+    for(idx = 0; idx < nchunks; idx++)
+    {
+        if((good & CHUNK_BIT(idx)) && (sb[idx].generation < newest->generation))
         {
-            printf("will rebuild chunk 5\n");
+            printf("%s: stale, generation %llu of %llu, treating it as lost\n", chunkName(cfg, idx),
+                   (unsigned long long)sb[idx].generation, (unsigned long long)newest->generation);
+            good &= ~CHUNK_BIT(idx);
+            *bad |= CHUNK_BIT(idx);
         }
-        else
+    }
+
+    return ((good != 0) ? OK : ERROR);
+}
+
+// Unit checksums
+//
+// Next to each chunk file is a sidecar, <chunk>.crc, holding the CRC32C of the chunk's
+// unit of stripe s at byte 4 * s. Striping and rebuilds compute the checksums of the
+// units they write right after the parity, while the units are still in cache, and
+// reads check the units they read in full. The sidecars are mapped, so workers store
+// and load checksums without system calls. A chunk without a sidecar, such as one
+// written before checksums were kept, is not checked.
+#define SUMS_READ   (0) // Map existing sidecars read-only
+#define SUMS_UPDATE (1) // Map existing sidecars for update
+#define SUMS_CREATE (2) // Create the sidecars afresh
+#define SUMS_GROW   (64 * 1024) // Least a sidecar grows by when the file length is not known
+
+typedef struct unit_sums
+{
+    int fd[MAX_CHUNKS];
+    uint32_t *map[MAX_CHUNKS];  // NULL for chunks that are not checked
+    size_t len[MAX_CHUNKS];     // Bytes mapped
+} unitsums_t;
+
+static void sumsInit(unitsums_t *sums)
+{
+    int idx;
+
+    for(idx = 0; idx < MAX_CHUNKS; idx++)
+    {
+        sums->fd[idx] = -1;
+        sums->map[idx] = NULL;
+        sums->len[idx] = 0;
+    }
+}
+
+// Size the sidecar of chunk idx to len bytes and map it for writing. The bytes are
+// allocated before they are mapped, so that a full device fails here with ERROR rather
+// than with SIGBUS on the first store into a hole.
+static int sizeSums(unitsums_t *sums, int idx, size_t len)
+{
+    void *map;
+
+    if(sums->map[idx] != NULL)
+        munmap(sums->map[idx], sums->len[idx]);
+    sums->map[idx] = NULL;
+    sums->len[idx] = 0;
+
+    if(ftruncate(sums->fd[idx], len) != 0)
+        return ERROR;
+    if(len == 0)
+        return OK;
+    if((errno = posix_fallocate(sums->fd[idx], 0, len)) != 0)
+        return ERROR;
+
+    if((map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, sums->fd[idx], 0)) == MAP_FAILED)
+        return ERROR;
+
+    sums->map[idx] = map;
+    sums->len[idx] = len;
+    return OK;
+}
+
+// Map the sidecars of the chunks in mask for stripeCnt stripes. Created sidecars are
+// sized to fit; an existing one that is missing or too short is left out.
+static int mapSums(raidcfg_t *cfg, unitsums_t *sums, uint64_t mask, off_t stripeCnt, int mode)
+{
+    size_t len = (size_t)stripeCnt * sizeof(uint32_t);
+    char name[PATH_MAX];
+    struct stat st;
+    void *map;
+    int idx;
+
+    for(idx = 0; idx < chunkCount(cfg); idx++)
+    {
+        if(!(mask & CHUNK_BIT(idx)))
+            continue;
+
+        snprintf(name, sizeof(name), "%s.crc", chunkName(cfg, idx));
+        if(mode == SUMS_CREATE)
         {
-            offset = 2048, bread = 0, btoread = (512);
-            do
+            if(((sums->fd[idx] = open(name, O_RDWR | O_CREAT | O_TRUNC, 00644)) < 0) ||
+               (sizeSums(sums, idx, len) != OK))
             {
-                bread = read(fd[4], &stripe[offset], 512); 
-                offset += bread;
-                btoread = (512) - bread;
+                perror(name);
+                return ERROR;
             }
-            while (btoread > 0);
+            continue;
         }
 
-        // Rebuild the missing chunk if necessary
-        if(missingChunk == 1)
-        {
-            rebuildLBA(PTR_CAST &stripe[512], 
-                       PTR_CAST &stripe[1024], 
-                       PTR_CAST &stripe[1536], 
-                       PTR_CAST &stripe[2048], 
-                       PTR_CAST &stripe[0]);
-        }
+        if((sums->fd[idx] = open(name, (mode == SUMS_READ) ? O_RDONLY : O_RDWR)) < 0)
+            continue;
 
-        if(missingChunk == 2)
+        if((len > 0) && (fstat(sums->fd[idx], &st) == 0) && ((size_t)st.st_size >= len) &&
+           ((map = mmap(NULL, len, (mode == SUMS_READ) ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED,
+                        sums->fd[idx], 0)) != MAP_FAILED))
         {
-            rebuildLBA(PTR_CAST &stripe[0], 
-                       PTR_CAST &stripe[1024], 
-                       PTR_CAST &stripe[1536], 
-                       PTR_CAST &stripe[2048], 
-                       PTR_CAST &stripe[512]);
+            sums->map[idx] = map;
+            sums->len[idx] = len;
         }
+    }
 
-        if(missingChunk == 3)
-        {
-            rebuildLBA(PTR_CAST &stripe[0],
-                       PTR_CAST &stripe[512],
-                       PTR_CAST &stripe[1536],
-                       PTR_CAST &stripe[2048],
-                       PTR_CAST &stripe[1024]);
-        }
+    return OK;
+}
 
-        if(missingChunk == 4)
+// Write the mapped sidecars of the chunks in mask back to their files
+static int syncSums(unitsums_t *sums, uint64_t mask)
+{
+    int idx, rc = OK;
+
+    for(idx = 0; idx < MAX_CHUNKS; idx++)
+        if((mask & CHUNK_BIT(idx)) && (sums->map[idx] != NULL) && (msync(sums->map[idx], sums->len[idx], MS_SYNC) != 0))
+            rc = ERROR;
+
+    return rc;
+}
+
+// Drop the sidecar of chunk idx while other threads may still be storing into it: the
+// mapping is swapped in place for anonymous memory, where late stores land harmlessly,
+// and the file is closed, so nothing more reaches the chunk's device
+static void dropSums(unitsums_t *sums, int idx)
+{
+    if(sums->map[idx] != NULL)
+        mmap(sums->map[idx], sums->len[idx], PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    if(sums->fd[idx] >= 0)
+        close(sums->fd[idx]);
+    sums->fd[idx] = -1;
+}
+
+// Move the sidecar of chunk idx to a new file name, sized as before; the checksums
+// stored so far are not carried over
+static int moveSums(unitsums_t *sums, int idx, char *name)
+{
+    size_t len = sums->len[idx];
+    int fd;
+
+    if((fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 00644)) < 0)
+        return ERROR;
+
+    dropSums(sums, idx);
+    sums->fd[idx] = fd;
+    return sizeSums(sums, idx, len);
+}
+
+static void unmapSums(unitsums_t *sums)
+{
+    int idx;
+
+    for(idx = 0; idx < MAX_CHUNKS; idx++)
+    {
+        if(sums->map[idx] != NULL)
+            munmap(sums->map[idx], sums->len[idx]);
+        if(sums->fd[idx] >= 0)
+            close(sums->fd[idx]);
+    }
+    sumsInit(sums);
+}
+
+// Store the checksums of the units in mask (unit order) of stripe stripeIdx; nothing
+// when sums is NULL, as for the other helpers
+static void storeSums(raidcfg_t *cfg, unitsums_t *sums, unsigned char **units, off_t stripeIdx, uint64_t mask)
+{
+    int idx, nchunks = chunkCount(cfg), shift = stripeShift(cfg, stripeIdx), chunk;
+
+    for(idx = 0; (idx < nchunks) && (sums != NULL); idx++)
+    {
+        chunk = (idx + shift) % nchunks;
+        if((mask & CHUNK_BIT(idx)) && (sums->map[chunk] != NULL))
+            sums->map[chunk][stripeIdx] = crc32c(0, units[idx], unitBytes(cfg));
+    }
+}
+
+// Check the units in mask (unit order) of stripe stripeIdx against their checksums and
+// return the ones that do not match
+static uint64_t checkSums(raidcfg_t *cfg, unitsums_t *sums, unsigned char **units, off_t stripeIdx, uint64_t mask)
+{
+    int idx, nchunks = chunkCount(cfg), shift = stripeShift(cfg, stripeIdx), chunk;
+    uint64_t bad = 0;
+
+    for(idx = 0; (idx < nchunks) && (sums != NULL); idx++)
+    {
+        chunk = (idx + shift) % nchunks;
+        if((mask & CHUNK_BIT(idx)) && (sums->map[chunk] != NULL) &&
+           (crc32c(0, units[idx], unitBytes(cfg)) != sums->map[chunk][stripeIdx]))
+        {
+            printf("%s: checksum mismatch in stripe %lld\n", chunkName(cfg, chunk), (long long)stripeIdx);
+            bad |= CHUNK_BIT(idx);
+        }
+    }
+
+    return bad;
+}
+
+// The units of a stripe buffer, in unit order with the scratch unit at SCRATCH_UNIT. The
+// parity code works on these pointers, so the units need not be contiguous or in one buffer.
+static void stripeUnits(raidcfg_t *cfg, unsigned char *stripe, unsigned char **units)
+{
+    size_t unit = unitBytes(cfg);
+    int idx, nchunks = chunkCount(cfg);
+
+    for(idx = 0; idx < nchunks; idx++)
+        units[idx] = UNIT(stripe, idx, unit);
+    units[SCRATCH_UNIT] = UNIT(stripe, nchunks, unit);
+}
+
+// Compute the parity units of one stripe from its data units
+static void encodeStripe(raidcfg_t *cfg, unsigned char **stripe)
+{
+    unsigned char *data[RAID_MAX_DATA];
+    size_t unit = unitBytes(cfg);
+    int idx, ndata = dataCount(cfg);
+
+    for(idx = 0; idx < ndata; idx++)
+        data[idx] = stripe[idx];
+
+    if(cfg->code == RAID_CODE_PQ)
+    {
+        pqGenBlocks(data, ndata, stripe[ndata], stripe[ndata + 1], unit);
+    }
+    else if(cfg->code == RAID_CODE_LRC)
+    {
+        // One XOR parity per local group, then the global Q over all of the data.
+        // The P that comes out of the fused P+Q pass is just L1 ^ L2 and is not stored.
+        for(idx = 0; idx < LRC_GROUPS; idx++)
+            xorBlocks(&data[lrcGroupFirst(cfg, idx)], lrcGroupData(cfg, idx), stripe[ndata + idx], unit);
+
+        pqGenBlocks(data, ndata, stripe[SCRATCH_UNIT], stripe[ndata + LRC_GROUPS], unit);
+    }
+    else
+    {
+        // The N-way kernel covers any unit size in one call, where xorLBA is one sector
+        xorBlocks(data, ndata, stripe[ndata], unit);
+    }
+}
+
+// Recompute each parity unit of a stripe into the scratch unit and compare it with the
+// one read from disk; returns the parity units, in unit order, that do not match. A
+// parity unit that has been compared is free to take the P of the fused P+Q pass.
+static uint64_t scrubStripe(raidcfg_t *cfg, unsigned char **stripe)
+{
+    size_t unit = unitBytes(cfg);
+    int idx, ndata = dataCount(cfg), q = ndata + 1;
+    uint64_t bad = 0;
+
+    if(cfg->code == RAID_CODE_LRC)
+    {
+        for(idx = 0; idx < LRC_GROUPS; idx++)
+        {
+            xorBlocks(&stripe[lrcGroupFirst(cfg, idx)], lrcGroupData(cfg, idx), stripe[SCRATCH_UNIT], unit);
+            if(!equalBlocks(stripe[SCRATCH_UNIT], stripe[ndata + idx], unit))
+                bad |= CHUNK_BIT(ndata + idx);
+        }
+        q = ndata + LRC_GROUPS;
+    }
+    else
+    {
+        xorBlocks(stripe, ndata, stripe[SCRATCH_UNIT], unit);
+        if(!equalBlocks(stripe[SCRATCH_UNIT], stripe[ndata], unit))
+            bad |= CHUNK_BIT(ndata);
+    }
+
+    if(cfg->code != RAID_CODE_XOR)
+    {
+        pqGenBlocks(stripe, ndata, stripe[ndata], stripe[SCRATCH_UNIT], unit);
+        if(!equalBlocks(stripe[SCRATCH_UNIT], stripe[q], unit))
+            bad |= CHUNK_BIT(q);
+    }
+
+    return bad;
+}
+
+// Work out which chunks have to be read to produce the chunks in want when the chunks in
+// lost are gone. Chunks that are wanted and still there are always read. Returns ERROR
+// if the code cannot rebuild that many lost chunks.
+static int planRead(raidcfg_t *cfg, uint64_t want, uint64_t lost, uint64_t *readMask)
+{
+    uint64_t survivors = (CHUNK_BIT(chunkCount(cfg)) - 1) & ~lost, data = dataMask(cfg);
+    uint64_t pBit = CHUNK_BIT(dataCount(cfg)), qBit = CHUNK_BIT(dataCount(cfg) + 1);
+    int nlost = __builtin_popcountll(lost), need, group, local = TRUE;
+
+    *readMask = want & survivors;
+    if((want & lost) == 0)
+        return OK;
+
+    if(cfg->code == RAID_CODE_PQ)
+    {
+        if(nlost > 2)
+            return ERROR;
+
+        // All surviving data, plus one parity unit for each lost data unit, P first
+        *readMask |= survivors & data;
+        need = __builtin_popcountll(lost & data);
+        if((need > 0) && !(lost & pBit))
+        {
+            *readMask |= pBit;
+            need--;
+        }
+        if(need > 0)
+            *readMask |= qBit;
+    }
+    else if(cfg->code == RAID_CODE_LRC)
+    {
+        if(nlost > 2)
+            return ERROR;
+
+        // A group with one lost unit is repaired from the rest of that group alone.
+        // Q is regenerated from all of the data. Anything else needs every survivor.
+        for(group = 0; group < LRC_GROUPS; group++)
+        {
+            need = __builtin_popcountll(lost & lrcGroupMask(cfg, group));
+            if(need > 1)
+                local = FALSE;
+            else if(need == 1)
+                *readMask |= lrcGroupMask(cfg, group) & survivors;
+        }
+        if(lost & CHUNK_BIT(dataCount(cfg) + LRC_GROUPS))
+            *readMask |= survivors & data;
+        if(!local)
+            *readMask = survivors;
+    }
+    else
+    {
+        if(nlost > 1)
+            return ERROR;
+        *readMask = survivors;
+    }
+
+    return OK;
+}
+
+// Repair every LRC local group that is missing exactly one unit, when that unit is data
+// or wanted, from the other members of the group
+static void lrcLocalRepair(raidcfg_t *cfg, unsigned char **stripe, uint64_t *missing, uint64_t want)
+{
+    unsigned char *src[RAID_MAX_DATA];
+    size_t unit = unitBytes(cfg);
+    uint64_t gone;
+    int group, idx, cnt;
+
+    for(group = 0; group < LRC_GROUPS; group++)
+    {
+        gone = *missing & lrcGroupMask(cfg, group);
+        if((__builtin_popcountll(gone) != 1) || !(gone & (dataMask(cfg) | want)))
+            continue;
+
+        for(idx = 0, cnt = 0; idx < chunkCount(cfg); idx++)
+            if((lrcGroupMask(cfg, group) & ~gone) & CHUNK_BIT(idx))
+                src[cnt++] = stripe[idx];
+
+        xorBlocks(src, cnt, stripe[__builtin_ctzll(gone)], unit);
+        *missing &= ~gone;
+    }
+}
+
+
+// Rebuild the LRC units in want that are not in avail: local groups first, then the
+// global Q for whatever a local group could not cover
+static int lrcRebuildStripe(raidcfg_t *cfg, unsigned char **stripe, uint64_t avail, uint64_t want)
+{
+    unsigned char *P = stripe[SCRATCH_UNIT];
+    unsigned char *units[RAID_MAX_DATA + 2], *local[LRC_GROUPS];
+    size_t unit = unitBytes(cfg);
+    int ndata = dataCount(cfg), qIdx = ndata + LRC_GROUPS;
+    uint64_t missing = (CHUNK_BIT(qIdx + 1) - 1) & ~avail;
+    int lost[3] = { -1, -1, -1 }, nlost = 0, idx;
+
+    lrcLocalRepair(cfg, stripe, &missing, want);
+    if((want & missing) == 0)
+        return OK;
+
+    for(idx = 0; idx < ndata; idx++)
+    {
+        units[idx] = stripe[idx];
+        if(missing & CHUNK_BIT(idx))
+            lost[nlost++] = idx;
+    }
+    units[ndata] = P;
+    units[ndata + 1] = stripe[qIdx];
+
+    // Data a local group could not cover: RAID-6 recovery over the data, Q, and the
+    // P implied by the local parities (P = L1 ^ ... ^ Ln)
+    if(nlost > 0)
+    {
+        if((nlost > 2) || (missing & CHUNK_BIT(qIdx)))
+            return ERROR;
+
+        if(missing & ((CHUNK_BIT(qIdx) - 1) & ~dataMask(cfg)))
+            lost[nlost++] = ndata;
+        else
+        {
+            for(idx = 0; idx < LRC_GROUPS; idx++)
+                local[idx] = stripe[ndata + idx];
+            xorBlocks(local, LRC_GROUPS, P, unit);
+        }
+
+        if((nlost > 2) || (pqRecoverBlocks(units, ndata, lost[0], lost[1], unit) != OK))
+            return ERROR;
+
+        missing &= ~dataMask(cfg);
+        lrcLocalRepair(cfg, stripe, &missing, want);
+    }
+
+    // Q is re-encoded from the data
+    if(want & missing & CHUNK_BIT(qIdx))
+    {
+        pqRecoverBlocks(units, ndata, ndata + 1, -1, unit);
+        missing &= ~CHUNK_BIT(qIdx);
+    }
+
+    return ((want & missing) ? ERROR : OK);
+}
+
+// Rebuild the units in want that are not in avail, in place, from the units in avail.
+// Units that are neither available nor wanted are left alone.
+static int rebuildStripe(raidcfg_t *cfg, unsigned char **stripe, uint64_t avail, uint64_t want)
+{
+    unsigned char *units[MAX_CHUNKS];
+    size_t unit = unitBytes(cfg);
+    uint64_t missing = (CHUNK_BIT(chunkCount(cfg)) - 1) & ~avail, data = dataMask(cfg);
+    int lost[2] = { -1, -1 }, nlost = 0, idx, cnt, ndata = dataCount(cfg);
+
+    if((want & missing) == 0)
+        return OK;
+
+    if(cfg->code == RAID_CODE_LRC)
+        return lrcRebuildStripe(cfg, stripe, avail, want);
+
+    if(cfg->code == RAID_CODE_PQ)
+    {
+        // Lost data, plus P when the data has to come from Q, plus any wanted parity
+        if(!(missing & data))
+            missing &= want;
+        else if(!(missing & CHUNK_BIT(ndata)))
+            missing &= ~(CHUNK_BIT(ndata + 1) & ~want);
+
+        for(idx = 0; idx < ndata + 2; idx++)
+        {
+            units[idx] = stripe[idx];
+            if(missing & CHUNK_BIT(idx))
+            {
+                if(nlost == 2)
+                    return ERROR;
+                lost[nlost++] = idx;
+            }
+        }
+
+        return pqRecoverBlocks(units, ndata, lost[0], lost[1], unit);
+    }
+
+    if(__builtin_popcountll(missing) != 1)
+        return ERROR;
+
+    // The surviving units in chunk order; parity, when present, is always last
+    for(idx = 0, cnt = 0; idx < ndata + 1; idx++)
+        if(!(missing & CHUNK_BIT(idx)))
+            units[cnt++] = stripe[idx];
+
+    rebuildBlocks(units, cnt - 1, units[cnt - 1], stripe[__builtin_ctzll(missing)], unit);
+
+    return OK;
+}
+
+// One I/O of a stripe: len bytes at bufOff in the stripe buffer, to or from position pos
+// of file, which is a chunk index or FILE_SLOT for the input or output file
+#define FILE_SLOT (MAX_CHUNKS)
+
+typedef struct stripe_io
+{
+    int file;
+    size_t bufOff, len;
+    off_t pos;
+} stripeio_t;
+
+// The I/O for the units in units (unit order) of stripe stripeIdx; returns the count
+static int unitIo(raidcfg_t *cfg, off_t stripeIdx, uint64_t units, stripeio_t *io)
+{
+    int idx, cnt = 0, nchunks = chunkCount(cfg), shift = stripeShift(cfg, stripeIdx);
+    size_t unit = unitBytes(cfg);
+
+    for(idx = 0; idx < nchunks; idx++)
+    {
+        if(!(units & CHUNK_BIT(idx)))
+            continue;
+
+        io[cnt].file = (idx + shift) % nchunks;
+        io[cnt].bufOff = idx * unit;
+        io[cnt].len = unit;
+        io[cnt].pos = dataOffset(cfg) + (off_t)stripeIdx * unit;
+        cnt++;
+    }
+
+    return cnt;
+}
+
+// Chunks that have failed during a striping, shared by its ranges
+typedef struct job_fail
+{
+    uint64_t offline;    // Writes to these chunks failed, and their units are no longer written
+    uint64_t rebuilding; // Chunks moved to the spare whose earlier stripes are still being rebuilt
+    unitsums_t *sums;    // The striping's checksums, NULL when not kept
+} jobfail_t;
+
+// A write to chunk failed with err while striping: take the chunk offline and go on
+// without it, as long as the chunks left can rebuild the file data of every stripe.
+// Its sidecar is dropped, as it likely sits on the same failed device. ERROR when the
+// chunks left cannot go on, or when fail is NULL and a failed write ends the job.
+static int chunkFailed(raidcfg_t *cfg, jobfail_t *fail, int chunk, int err)
+{
+    int idx, nchunks = chunkCount(cfg);
+    uint64_t was, lost, readMask;
+
+    if(fail == NULL)
+        return ERROR;
+
+    was = __atomic_fetch_or(&fail->offline, CHUNK_BIT(chunk), __ATOMIC_RELAXED);
+    lost = was | CHUNK_BIT(chunk) | __atomic_load_n(&fail->rebuilding, __ATOMIC_RELAXED);
+    for(idx = 0; idx < layoutPeriod(cfg); idx++)
+    {
+        if(planRead(cfg, dataMask(cfg), chunksToUnits(lost, stripeShift(cfg, idx), nchunks), &readMask) != OK)
+        {
+            printf("%s: write failed (%s) with %d chunks lost, too many to go on\n", chunkName(cfg, chunk),
+                   strerror(err), __builtin_popcountll(lost));
+            return ERROR;
+        }
+    }
+
+    if(!(was & CHUNK_BIT(chunk)))
+    {
+        printf("%s: write failed (%s), taking it offline and striping on without it\n", chunkName(cfg, chunk),
+               strerror(err));
+        if(fail->sums != NULL)
+            dropSums(fail->sums, chunk);
+    }
+    return OK;
+}
+
+// Carry out cnt I/Os of one stripe with blocking pread/pwrite. A failed write to a chunk
+// takes it offline when fail allows (chunkFailed).
+static int syncIo(raidcfg_t *cfg, int *fd, int write, unsigned char *stripe, stripeio_t *io, int cnt,
+                  off_t stripeIdx, jobfail_t *fail)
+{
+    int idx, rc;
+
+    for(idx = 0; idx < cnt; idx++)
+    {
+        if(write)
+            rc = writeFull(fd[io[idx].file], &stripe[io[idx].bufOff], io[idx].len, io[idx].pos);
+        else
+            rc = readFull(fd[io[idx].file], &stripe[io[idx].bufOff], io[idx].len, io[idx].pos);
+
+        if((rc != OK) && write && (io[idx].file != FILE_SLOT) && (chunkFailed(cfg, fail, io[idx].file, errno) == OK))
+            continue;
+
+        if(rc != OK)
+        {
+            printf("%s %s failed at stripe %lld\n", write ? "write to" : "read from",
+                   (io[idx].file == FILE_SLOT) ? "file" : chunkName(cfg, io[idx].file), (long long)stripeIdx);
+            return ERROR;
+        }
+    }
+
+    return OK;
+}
+
+// Write the units in writeUnits (unit order) of stripe stripeIdx to the chunk files; a
+// failed write takes its chunk offline when fail allows
+static int writeStripe(raidcfg_t *cfg, int *fd, off_t stripeIdx, uint64_t writeUnits, unsigned char *stripe,
+                       jobfail_t *fail)
+{
+    stripeio_t io[MAX_CHUNKS];
+
+    return syncIo(cfg, fd, TRUE, stripe, io, unitIo(cfg, stripeIdx, writeUnits, io), stripeIdx, fail);
+}
+
+// Progress of one job, shared by its workers. The callback runs under the lock, each
+// time another RAID_PROGRESS_STEP bytes are done and at the end, so it is never entered
+// twice at once and never sees done go backwards.
+typedef struct job_progress
+{
+    pthread_mutex_t lock;
+    off_t done, total, reported;
+} jobprogress_t;
+
+static void progressInit(jobprogress_t *progress, off_t total)
+{
+    pthread_mutex_init(&progress->lock, NULL);
+    progress->done = progress->reported = 0;
+    progress->total = total;
+}
+
+static void progressAdd(raidcfg_t *cfg, jobprogress_t *progress, off_t bytes)
+{
+    off_t now;
+
+    if((cfg->progress == NULL) || (progress == NULL))
+        return;
+
+    now = __atomic_add_fetch(&progress->done, bytes, __ATOMIC_RELAXED);
+    if(((now - bytes) / RAID_PROGRESS_STEP == now / RAID_PROGRESS_STEP) && (now != progress->total))
+        return;
+
+    pthread_mutex_lock(&progress->lock);
+    if(now > progress->reported)
+    {
+        progress->reported = now;
+        cfg->progress(cfg->progressArg, now, progress->total);
+    }
+    pthread_mutex_unlock(&progress->lock);
+}
+
+// Findings of a scrub, shared by its workers; the callback runs under the lock
+typedef struct job_scrub
+{
+    pthread_mutex_t lock;
+    raidmismatch_t mismatch;
+    void *arg;
+    off_t stripes;   // Stripes whose parity does not match
+} jobscrub_t;
+
+// A range of stripes handled by one worker. Each stripe is read as described by plan,
+// transformed by compute, then written as described by plan; the sync and io_uring
+// engines both run the same description. All I/O is positional, so workers share the
+// file descriptors.
+typedef struct stripe_job
+{
+    raidcfg_t *cfg;
+    int fd[MAX_CHUNKS + 1];    // Chunk files by chunk, then the input or output file at FILE_SLOT
+    off_t fileLength;          // Bytes of file data held by the stripes
+    uint64_t readUnits[MAX_CHUNKS]; // Units to read, for each placement of the layout
+    uint64_t wantUnits[MAX_CHUNKS]; // Units to rebuild, for each placement of the layout
+    int (*plan)(struct stripe_job *job, off_t stripeIdx, int write, stripeio_t *io);
+    int (*compute)(struct stripe_job *job, unsigned char *stripe, off_t stripeIdx);
+    unsigned char *map[MAX_CHUNKS + 1]; // Mappings for the mmap engine, NULL when unmapped
+    size_t mapLen[MAX_CHUNKS + 1];
+    uint64_t mapOut;           // Mappings written, synced before they are unmapped
+    jobprogress_t *progress;   // Shared by the ranges of the job, NULL without a callback
+    jobscrub_t *scrub;         // Scrub findings, NULL for other jobs
+    unitsums_t *sums;          // Unit checksums, NULL when not kept
+    uint64_t gone;             // Chunks that cannot be read
+    uint64_t hedgeWant;        // Units a stripe's reads can be hedged for, 0 when they are not
+    uint64_t hedgeAvail;       // Units read for the stripe being computed when its reads were hedged
+    uint64_t hedgeSlow;        // Its units left to slow reads, rebuilt instead; 0 when not hedged
+    off_t hedged;              // Stripes whose reads were hedged
+    jobfail_t *fail;           // Striping: chunks taken offline, NULL when a failed write ends the job
+    unsigned char *window;     // File data of the stripes from windowFirst on, for streams
+    off_t windowFirst;
+    off_t first, last;
+    int rc;
+} stripejob_t;
+
+// Bytes of file data in stripe stripeIdx: a full stripe except at the end of the file
+static size_t stripeDataLen(stripejob_t *job, off_t stripeIdx)
+{
+    off_t stripeBytes = dataCount(job->cfg) * unitBytes(job->cfg);
+    off_t offset = stripeIdx * stripeBytes;
+
+    return (size_t)(((job->fileLength - offset) < stripeBytes) ? (job->fileLength - offset) : stripeBytes);
+}
+
+// Units (unit order) of stripe stripeIdx on chunks that have gone offline
+static uint64_t offlineUnits(stripejob_t *job, off_t stripeIdx)
+{
+    if(job->fail == NULL)
+        return 0;
+
+    return chunksToUnits(__atomic_load_n(&job->fail->offline, __ATOMIC_RELAXED), stripeShift(job->cfg, stripeIdx),
+                         chunkCount(job->cfg));
+}
+
+// Striping: read the stripe's data from the input file, then write every unit of the
+// chunks that are online
+static int stripePlan(stripejob_t *job, off_t stripeIdx, int write, stripeio_t *io)
+{
+    if(write)
+        return unitIo(job->cfg, stripeIdx, (CHUNK_BIT(chunkCount(job->cfg)) - 1) & ~offlineUnits(job, stripeIdx), io);
+
+    io[0].file = FILE_SLOT;
+    io[0].bufOff = 0;
+    io[0].len = stripeDataLen(job, stripeIdx);
+    io[0].pos = (off_t)stripeIdx * dataCount(job->cfg) * unitBytes(job->cfg);
+    return 1;
+}
+
+static int stripeCompute(stripejob_t *job, unsigned char *stripe, off_t stripeIdx)
+{
+    size_t len = stripeDataLen(job, stripeIdx), stripeBytes = dataCount(job->cfg) * unitBytes(job->cfg);
+    unsigned char *units[MAX_CHUNKS + 1];
+
+    // Zero-fill the last partial stripe
+    if(len < stripeBytes)
+        bzero(&stripe[len], stripeBytes - len);
+
+    stripeUnits(job->cfg, stripe, units);
+    encodeStripe(job->cfg, units);
+    storeSums(job->cfg, job->sums, units, stripeIdx, (CHUNK_BIT(chunkCount(job->cfg)) - 1) & ~offlineUnits(job, stripeIdx));
+    return OK;
+}
+
+// Check the units in avail (unit order) of a stripe that has been read against their
+// checksums. A unit that fails is lost for this stripe: the units its rebuild needs are
+// read as well, from the mappings or the chunk files, and checked in turn. *avail is left
+// holding the good units to rebuild want from; ERROR when there are too few.
+static int verifyUnits(stripejob_t *job, unsigned char *stripe, unsigned char **units, off_t stripeIdx,
+                       uint64_t *avail, uint64_t want)
+{
+    raidcfg_t *cfg = job->cfg;
+    int nchunks = chunkCount(cfg), shift = stripeShift(cfg, stripeIdx), chunk, idx;
+    uint64_t lost = chunksToUnits(job->gone, shift, nchunks) | job->hedgeSlow, check = *avail, bad, readMask;
+    size_t unit = unitBytes(cfg);
+    off_t pos = dataOffset(cfg) + stripeIdx * unit;
+
+    if(job->sums == NULL)
+        return OK;
+
+    while((bad = checkSums(cfg, job->sums, units, stripeIdx, check)) != 0)
+    {
+        lost |= bad;
+        *avail &= ~bad;
+        if(planRead(cfg, want, lost, &readMask) != OK)
+        {
+            printf("stripe %lld: too many bad units to rebuild\n", (long long)stripeIdx);
+            return ERROR;
+        }
+
+        // Mapped units are read-only, so rebuilt ones go to the stripe buffer
+        for(idx = 0; idx < nchunks; idx++)
+            if(bad & CHUNK_BIT(idx))
+                units[idx] = UNIT(stripe, idx, unit);
+
+        check = readMask & ~*avail;
+        for(idx = 0; idx < nchunks; idx++)
+        {
+            chunk = (idx + shift) % nchunks;
+            if(!(check & CHUNK_BIT(idx)))
+                continue;
+            if(job->map[chunk] != NULL)
+                units[idx] = job->map[chunk] + pos;
+            else if(readFull(job->fd[chunk], units[idx], unit, pos) != OK)
+            {
+                printf("%s: read failed at stripe %lld\n", chunkName(cfg, chunk), (long long)stripeIdx);
+                return ERROR;
+            }
+        }
+        *avail |= check;
+    }
+
+    return OK;
+}
+
+// Restore: read the planned units, then write the data to the output file
+static int restorePlan(stripejob_t *job, off_t stripeIdx, int write, stripeio_t *io)
+{
+    if(!write)
+        return unitIo(job->cfg, stripeIdx, job->readUnits[stripeIdx % layoutPeriod(job->cfg)], io);
+
+    io[0].file = FILE_SLOT;
+    io[0].bufOff = 0;
+    io[0].len = stripeDataLen(job, stripeIdx);
+    io[0].pos = (off_t)stripeIdx * dataCount(job->cfg) * unitBytes(job->cfg);
+    return 1;
+}
+
+static int restoreCompute(stripejob_t *job, unsigned char *stripe, off_t stripeIdx)
+{
+    uint64_t avail = job->hedgeSlow ? job->hedgeAvail : job->readUnits[stripeIdx % layoutPeriod(job->cfg)];
+    unsigned char *units[MAX_CHUNKS + 1];
+
+    stripeUnits(job->cfg, stripe, units);
+    if(verifyUnits(job, stripe, units, stripeIdx, &avail, dataMask(job->cfg)) != OK)
+        return ERROR;
+
+    return rebuildStripe(job->cfg, units, avail, dataMask(job->cfg));
+}
+
+// Chunk rebuild: read the planned units, then write the lost units to their chunk files
+static int rebuildPlan(stripejob_t *job, off_t stripeIdx, int write, stripeio_t *io)
+{
+    int placement = stripeIdx % layoutPeriod(job->cfg);
+
+    return unitIo(job->cfg, stripeIdx, write ? job->wantUnits[placement] : job->readUnits[placement], io);
+}
+
+static int rebuildCompute(stripejob_t *job, unsigned char *stripe, off_t stripeIdx)
+{
+    int placement = stripeIdx % layoutPeriod(job->cfg);
+    uint64_t avail = job->readUnits[placement];
+    unsigned char *units[MAX_CHUNKS + 1];
+
+    stripeUnits(job->cfg, stripe, units);
+    if((verifyUnits(job, stripe, units, stripeIdx, &avail, job->wantUnits[placement]) != OK) ||
+       (rebuildStripe(job->cfg, units, avail, job->wantUnits[placement]) != OK))
+        return ERROR;
+
+    storeSums(job->cfg, job->sums, units, stripeIdx, job->wantUnits[placement]);
+    return OK;
+}
+
+// Scrub: read every unit, check the parity, and write nothing
+static int scrubPlan(stripejob_t *job, off_t stripeIdx, int write, stripeio_t *io)
+{
+    return (write ? 0 : unitIo(job->cfg, stripeIdx, CHUNK_BIT(chunkCount(job->cfg)) - 1, io));
+}
+
+static int scrubCompute(stripejob_t *job, unsigned char *stripe, off_t stripeIdx)
+{
+    unsigned char *units[MAX_CHUNKS + 1];
+    uint64_t bad, parity;
+
+    // A unit that fails its checksum is named rather than the parity it upsets
+    stripeUnits(job->cfg, stripe, units);
+    bad = checkSums(job->cfg, job->sums, units, stripeIdx, CHUNK_BIT(chunkCount(job->cfg)) - 1);
+    parity = scrubStripe(job->cfg, units);
+    if(bad == 0)
+        bad = parity;
+    if(bad == 0)
+        return OK;
+
+    pthread_mutex_lock(&job->scrub->lock);
+    job->scrub->stripes++;
+    if(job->scrub->mismatch != NULL)
+        job->scrub->mismatch(job->scrub->arg, stripeIdx,
+                             unitsToChunks(bad, stripeShift(job->cfg, stripeIdx), chunkCount(job->cfg)));
+    pthread_mutex_unlock(&job->scrub->lock);
+
+    return OK;
+}
+
+// Streams: the file data of a batch of stripes is held in a window in memory, which a
+// pipe is read into or written out from in order, so the workers only do chunk I/O
+static unsigned char *windowData(stripejob_t *job, off_t stripeIdx)
+{
+    return &job->window[(size_t)(stripeIdx - job->windowFirst) * dataCount(job->cfg) * unitBytes(job->cfg)];
+}
+
+static int streamStripePlan(stripejob_t *job, off_t stripeIdx, int write, stripeio_t *io)
+{
+    return (write ? stripePlan(job, stripeIdx, TRUE, io) : 0);
+}
+
+static int streamStripeCompute(stripejob_t *job, unsigned char *stripe, off_t stripeIdx)
+{
+    memcpy(stripe, windowData(job, stripeIdx), stripeDataLen(job, stripeIdx));
+    return stripeCompute(job, stripe, stripeIdx);
+}
+
+static int streamRestorePlan(stripejob_t *job, off_t stripeIdx, int write, stripeio_t *io)
+{
+    return (write ? 0 : restorePlan(job, stripeIdx, FALSE, io));
+}
+
+static int streamRestoreCompute(stripejob_t *job, unsigned char *stripe, off_t stripeIdx)
+{
+    if(restoreCompute(job, stripe, stripeIdx) != OK)
+        return ERROR;
+
+    memcpy(windowData(job, stripeIdx), stripe, stripeDataLen(job, stripeIdx));
+    return OK;
+}
+
+// mmap engine: the input or output file and the chunk files are mapped, the data is
+// copied straight between the mappings and the parity is computed in the mapped parity
+// units. The stripe buffer only holds units that are lost on disk, and the scratch unit.
+static int mapPlan(stripejob_t *job, off_t stripeIdx, int write, stripeio_t *io)
+{
+    return 0;
+}
+
+// Point units at stripe stripeIdx in the mapped chunks of mask, and at the stripe buffer
+// for the others
+static void mappedUnits(stripejob_t *job, unsigned char *stripe, off_t stripeIdx, uint64_t mask, unsigned char **units)
+{
+    int idx, nchunks = chunkCount(job->cfg), shift = stripeShift(job->cfg, stripeIdx);
+    size_t unit = unitBytes(job->cfg);
+
+    stripeUnits(job->cfg, stripe, units);
+    for(idx = 0; idx < nchunks; idx++)
+        if(mask & CHUNK_BIT(idx))
+            units[idx] = job->map[(idx + shift) % nchunks] + dataOffset(job->cfg) + (size_t)stripeIdx * unit;
+}
+
+static int mapStripeCompute(stripejob_t *job, unsigned char *stripe, off_t stripeIdx)
+{
+    size_t unit = unitBytes(job->cfg), len = stripeDataLen(job, stripeIdx), pos;
+    unsigned char *src = job->map[FILE_SLOT] + (size_t)stripeIdx * dataCount(job->cfg) * unit;
+    unsigned char *units[MAX_CHUNKS + 1];
+    int idx;
+
+    mappedUnits(job, stripe, stripeIdx, CHUNK_BIT(chunkCount(job->cfg)) - 1, units);
+
+    // Split the data between the chunks; past the end of the file they keep the zeroes
+    // of the freshly sized chunk files
+    for(idx = 0, pos = 0; (idx < dataCount(job->cfg)) && (pos < len); idx++, pos += unit)
+        memcpy(units[idx], &src[pos], ((len - pos) < unit) ? (len - pos) : unit);
+
+    encodeStripe(job->cfg, units);
+    storeSums(job->cfg, job->sums, units, stripeIdx, CHUNK_BIT(chunkCount(job->cfg)) - 1);
+    return OK;
+}
+
+static int mapRestoreCompute(stripejob_t *job, unsigned char *stripe, off_t stripeIdx)
+{
+    size_t unit = unitBytes(job->cfg), len = stripeDataLen(job, stripeIdx), pos;
+    unsigned char *dst = job->map[FILE_SLOT] + (size_t)stripeIdx * dataCount(job->cfg) * unit;
+    uint64_t avail = job->readUnits[stripeIdx % layoutPeriod(job->cfg)];
+    unsigned char *units[MAX_CHUNKS + 1];
+    int idx;
+
+    // The chunk mappings are read-only: rebuildStripe only writes units outside avail
+    mappedUnits(job, stripe, stripeIdx, avail, units);
+    if((verifyUnits(job, stripe, units, stripeIdx, &avail, dataMask(job->cfg)) != OK) ||
+       (rebuildStripe(job->cfg, units, avail, dataMask(job->cfg)) != OK))
+        return ERROR;
+
+    for(idx = 0, pos = 0; (idx < dataCount(job->cfg)) && (pos < len); idx++, pos += unit)
+        memcpy(&dst[pos], units[idx], ((len - pos) < unit) ? (len - pos) : unit);
+
+    return OK;
+}
+
+// Unmap the files of the mmap engine. The written ones are synced first, so that a
+// failed write-back comes back as ERROR instead of being lost with the mapping.
+static int unmapJobFiles(stripejob_t *job)
+{
+    int idx, rc = OK;
+
+    for(idx = 0; idx <= FILE_SLOT; idx++)
+    {
+        if(job->map[idx] != NULL)
+        {
+            if((job->mapOut & CHUNK_BIT(idx)) && (msync(job->map[idx], job->mapLen[idx], MS_SYNC) != 0))
+            {
+                perror((idx == FILE_SLOT) ? "raid: file write-back" : chunkName(job->cfg, idx));
+                rc = ERROR;
+            }
+            munmap(job->map[idx], job->mapLen[idx]);
+        }
+        job->map[idx] = NULL;
+    }
+    job->mapOut = 0;
+
+    return rc;
+}
+
+// Map the files in mask (chunk bits, plus CHUNK_BIT(FILE_SLOT) for the input or output
+// file) for the mmap engine. Chunks hold stripeCnt units after their superblock sector
+// and the file fileLength bytes; the chunks are written when chunksOut is TRUE and the
+// file otherwise. Written files are allocated in full first, so that a full device fails
+// here rather than with SIGBUS on a store into a hole, and read files have to be long
+// enough. Returns ERROR with nothing mapped when a file cannot be mapped or allocated,
+// and the caller carries on with pread/pwrite.
+static int mapJobFiles(stripejob_t *job, uint64_t mask, off_t stripeCnt, int chunksOut)
+{
+    struct stat st;
+    int idx, out;
+
+    for(idx = 0; idx <= FILE_SLOT; idx++)
+    {
+        if(!(mask & CHUNK_BIT(idx)))
+            continue;
+
+        out = (idx == FILE_SLOT) ? !chunksOut : chunksOut;
+        job->mapLen[idx] = (idx == FILE_SLOT) ? (size_t)job->fileLength :
+                           (size_t)(dataOffset(job->cfg) + stripeCnt * unitBytes(job->cfg));
+        if(job->mapLen[idx] == 0)
+            continue;
+
+        if(out ? ((ftruncate(job->fd[idx], job->mapLen[idx]) != 0) ||
+                  (posix_fallocate(job->fd[idx], 0, job->mapLen[idx]) != 0)) :
+           ((fstat(job->fd[idx], &st) != 0) || ((size_t)st.st_size < job->mapLen[idx])))
+            break;
+
+        job->map[idx] = mmap(NULL, job->mapLen[idx], out ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED,
+                             job->fd[idx], 0);
+        if(job->map[idx] == MAP_FAILED)
+        {
+            job->map[idx] = NULL;
+            break;
+        }
+        if(out)
+            job->mapOut |= CHUNK_BIT(idx);
+
+        // The stripes are walked front to back. Huge pages only take where the kernel
+        // supports them for file mappings, so that hint may be refused.
+        madvise(job->map[idx], job->mapLen[idx], MADV_SEQUENTIAL);
+        madvise(job->map[idx], job->mapLen[idx], MADV_HUGEPAGE);
+    }
+
+    if(idx <= FILE_SLOT)
+    {
+        printf("raid: cannot map %s, using pread/pwrite\n",
+               (idx == FILE_SLOT) ? "the file" : chunkName(job->cfg, idx));
+        unmapJobFiles(job);
+        return ERROR;
+    }
+
+    return OK;
+}
+
+// Synchronous engine: one stripe at a time with blocking pread/pwrite
+static int syncRange(stripejob_t *job)
+{
+    stripeio_t io[MAX_CHUNKS];
+    unsigned char *stripe;
+    off_t idx;
+    int rc = OK;
+
+    if((stripe = allocStripe(job->cfg)) == NULL)
+        return ERROR;
+
+    for(idx = job->first; (idx < job->last) && (rc == OK); idx++)
+    {
+        rc = syncIo(job->cfg, job->fd, FALSE, stripe, io, job->plan(job, idx, FALSE, io), idx, NULL);
+        if(rc == OK)
+            rc = job->compute(job, stripe, idx);
+        if(rc == OK)
+            rc = syncIo(job->cfg, job->fd, TRUE, stripe, io, job->plan(job, idx, TRUE, io), idx, job->fail);
+        if(rc == OK)
+            progressAdd(job->cfg, job->progress, stripeDataLen(job, idx));
+    }
+
+    free(stripe);
+    return rc;
+}
+
+// io_uring engine: a set of stripe buffers (slots) each cycle through their reads,
+// compute and writes, with every slot's I/O in flight together, so the devices see
+// a queue of requests while parity is computed for the stripes that are ready.
+//
+// A slot works in one of the engine's buffers and its I/Os are tagged with the buffer.
+// When a slot's reads are hedged it moves on to a spare buffer, and the old one is stale
+// until the slow reads into it are in; their completions are dropped.
+#define URING_MAX_SLOTS (64)
+#define URING_IDLE  (0)
+#define URING_READ  (1)
+#define URING_WRITE (2)
+#define URING_BUF_FREE  (-1) // A spare buffer
+#define URING_BUF_STALE (-2) // Reads that were hedged are still going into it
+
+typedef struct uring_slot
+{
+    off_t stripeIdx;
+    int phase;     // URING_IDLE, URING_READ or URING_WRITE
+    int pending;   // I/Os of the phase still in flight
+    int buf;       // Buffer the slot works in
+    unsigned char *stripe;
+    stripeio_t io[MAX_CHUNKS];
+    uint64_t ioUnit[MAX_CHUNKS]; // Unit (unit order) each read is for, 0 for the file
+    int ioCount;
+    uint64_t readMask; // Units read or being read
+    uint64_t reading;  // Units whose reads are still out
+    uint64_t slow;     // Units rebuilt instead of read after a hedge
+    struct timespec started; // When the reads went out
+    int hedged;        // The reads have been hedged, or could not be
+} uringslot_t;
+
+typedef struct uring_bufs
+{
+    unsigned char *region;
+    size_t slotBytes;
+    int count;
+    int owner[2 * URING_MAX_SLOTS]; // Slot working in each buffer, URING_BUF_FREE or URING_BUF_STALE
+    int stale[2 * URING_MAX_SLOTS]; // Reads still going into a stale buffer
+} uringbufs_t;
+
+static long long elapsedUs(struct timespec *since)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000000LL + (now.tv_nsec - since->tv_nsec) / 1000;
+}
+
+static int uringQueueIo(stripejob_t *job, raiduring_t *ring, uringslot_t *slot, int ioIdx)
+{
+    stripeio_t *io = &slot->io[ioIdx];
+
+    if(raidUringQueue(ring, slot->phase == URING_WRITE, ring->fixedFiles ? io->file : job->fd[io->file],
+                      &slot->stripe[io->bufOff], io->len, io->pos,
+                      (unsigned long long)slot->buf * MAX_CHUNKS + ioIdx) != OK)
+    {
+        printf("io_uring: submission queue full\n");
+        return ERROR;
+    }
+
+    return OK;
+}
+
+// Note which units a slot's reads are for, as they go out
+static void uringReading(stripejob_t *job, uringslot_t *slot, int first)
+{
+    size_t unit = unitBytes(job->cfg);
+    int idx;
+
+    for(idx = first; idx < slot->ioCount; idx++)
+    {
+        slot->ioUnit[idx] = (slot->io[idx].file == FILE_SLOT) ? 0 : CHUNK_BIT(slot->io[idx].bufOff / unit);
+        slot->reading |= slot->ioUnit[idx];
+    }
+    slot->readMask |= slot->reading;
+}
+
+// Move a slot on to its next phase, computing between the reads and the writes, until
+// it has I/O in flight or its stripe is finished
+static int uringAdvance(stripejob_t *job, raiduring_t *ring, uringslot_t *slot, off_t *done)
+{
+    int idx, rc;
+
+    while(slot->pending == 0)
+    {
+        if(slot->phase == URING_WRITE)
+        {
+            progressAdd(job->cfg, job->progress, stripeDataLen(job, slot->stripeIdx));
+            slot->phase = URING_IDLE;
+            slot->stripeIdx = -1;
+            (*done)++;
+            return OK;
+        }
+
+        if(slot->phase == URING_READ)
+        {
+            job->hedgeAvail = slot->readMask;
+            job->hedgeSlow = slot->slow;
+            rc = job->compute(job, slot->stripe, slot->stripeIdx);
+            job->hedgeSlow = 0;
+            if(rc != OK)
+                return ERROR;
+        }
+
+        slot->phase++;
+        slot->pending = slot->ioCount = job->plan(job, slot->stripeIdx, slot->phase == URING_WRITE, slot->io);
+        if(slot->phase == URING_READ)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &slot->started);
+            slot->readMask = slot->reading = slot->slow = 0;
+            slot->hedged = FALSE;
+            uringReading(job, slot, 0);
+        }
+        for(idx = 0; idx < slot->pending; idx++)
+            if(uringQueueIo(job, ring, slot, idx) != OK)
+                return ERROR;
+    }
+
+    return OK;
+}
+
+// Hedge the reads of a slot that are still out at the deadline: their units are rebuilt
+// from the units that are in plus the further reads planRead picks. The units that are
+// in are copied to a spare buffer, the further reads go out into it, and the slow reads
+// are cancelled, their buffer stale until they complete. When the slow units cannot be
+// rebuilt the slot waits for its reads as usual.
+static int uringHedge(stripejob_t *job, raiduring_t *ring, uringslot_t *slot, int slotIdx, uringbufs_t *bufs)
+{
+    raidcfg_t *cfg = job->cfg;
+    int nchunks = chunkCount(cfg), shift = stripeShift(cfg, slot->stripeIdx), idx, spare, old = slot->buf;
+    uint64_t have = slot->readMask & ~slot->reading, readMask;
+    size_t unit = unitBytes(cfg);
+    unsigned char *stripe;
+
+    if(planRead(cfg, job->hedgeWant, chunksToUnits(job->gone, shift, nchunks) | slot->reading, &readMask) != OK)
+    {
+        slot->hedged = TRUE;
+        return OK;
+    }
+
+    // Without a spare the slot is hedged once a stale buffer frees up, if its reads are still out
+    for(spare = 0; (spare < bufs->count) && (bufs->owner[spare] != URING_BUF_FREE); spare++)
+        ;
+    if(spare == bufs->count)
+        return OK;
+    slot->hedged = TRUE;
+
+    // A read that is too far along to cancel lands in the stale buffer all the same
+    for(idx = 0; idx < slot->ioCount; idx++)
+        if(slot->ioUnit[idx] & slot->reading)
+            raidUringCancel(ring, (unsigned long long)old * MAX_CHUNKS + idx);
+
+    stripe = bufs->region + (size_t)spare * bufs->slotBytes;
+    for(idx = 0; idx < nchunks; idx++)
+        if(have & CHUNK_BIT(idx))
+            memcpy(UNIT(stripe, idx, unit), UNIT(slot->stripe, idx, unit), unit);
+
+    bufs->owner[old] = URING_BUF_STALE;
+    bufs->stale[old] = slot->pending;
+    bufs->owner[spare] = slotIdx;
+    slot->buf = spare;
+    slot->stripe = stripe;
+
+    slot->slow = slot->reading;
+    slot->readMask = have;
+    slot->reading = 0;
+    slot->pending = slot->ioCount = unitIo(cfg, slot->stripeIdx, readMask & ~have, slot->io);
+    uringReading(job, slot, 0);
+    job->hedged++;
+
+    for(idx = 0; idx < slot->pending; idx++)
+        if(uringQueueIo(job, ring, slot, idx) != OK)
+            return ERROR;
+
+    return OK;
+}
+
+static int uringRange(stripejob_t *job)
+{
+    static int warned = FALSE;
+    raidcfg_t *cfg = job->cfg;
+    size_t slotBytes = stripeBufBytes(cfg);
+    int depth = (cfg->queueDepth > 0) ? cfg->queueDepth : RAID_URING_DEPTH;
+    int nslots = depth / (chunkCount(cfg) + 1), inflight, idx, ioIdx, res, rc = OK;
+    int hedging = (job->hedgeWant != 0) && (cfg->hedgeUs > 0);
+    off_t total = job->last - job->first, next = job->first, done = 0;
+    uringslot_t slot[URING_MAX_SLOTS];
+    long long wait, left;
+    unsigned long long tag;
+    uringbufs_t bufs;
+    raiduring_t ring;
+    stripeio_t *io;
+    void *region;
+
+    if(nslots < 2)
+        nslots = 2;
+    if(nslots > URING_MAX_SLOTS)
+        nslots = URING_MAX_SLOTS;
+    if(nslots > total)
+        nslots = (total > 0) ? (int)total : 1;
+
+    // Hedging keeps a spare buffer per slot, and cancels and rereads along with the I/O
+    bufs.count = hedging ? 2 * nslots : nslots;
+    bufs.slotBytes = slotBytes;
+    if(raidUringInit(&ring, bufs.count * MAX_CHUNKS * (hedging ? 2 : 1)) != OK)
+    {
+        if(!__atomic_exchange_n(&warned, TRUE, __ATOMIC_RELAXED))
+            perror("io_uring unavailable, using synchronous I/O");
+        return syncRange(job);
+    }
+
+    if(posix_memalign(&region, sectorBytes(cfg), bufs.count * slotBytes) != 0)
+    {
+        raidUringExit(&ring);
+        return ERROR;
+    }
+    bufs.region = (unsigned char *)region;
+
+    // Fixed files and a registered buffer save work per op; the plain ops work without them
+    raidUringRegisterFiles(&ring, job->fd, MAX_CHUNKS + 1);
+    raidUringRegisterBuffer(&ring, region, bufs.count * slotBytes);
+
+    for(idx = 0; idx < bufs.count; idx++)
+    {
+        bufs.owner[idx] = (idx < nslots) ? idx : URING_BUF_FREE;
+        bufs.stale[idx] = 0;
+    }
+
+    for(idx = 0; idx < nslots; idx++)
+    {
+        slot[idx].stripeIdx = -1;
+        slot[idx].phase = URING_IDLE;
+        slot[idx].pending = 0;
+        slot[idx].buf = idx;
+        slot[idx].stripe = bufs.region + idx * slotBytes;
+    }
+
+    while((rc == OK) && (done < total))
+    {
+        // Start a stripe in every free slot
+        for(idx = 0; (idx < nslots) && (next < job->last) && (rc == OK); idx++)
+        {
+            if(slot[idx].stripeIdx < 0)
+            {
+                slot[idx].stripeIdx = next++;
+                rc = uringAdvance(job, &ring, &slot[idx], &done);
+            }
+        }
+
+        // Hedge the reads past their deadline, and wait no longer than the next deadline
+        wait = -1;
+        for(idx = 0; hedging && (idx < nslots) && (rc == OK); idx++)
+        {
+            if((slot[idx].phase != URING_READ) || slot[idx].hedged || (slot[idx].pending == 0))
+                continue;
+
+            if((left = cfg->hedgeUs - elapsedUs(&slot[idx].started)) > 0)
+                wait = ((wait < 0) || (left < wait)) ? left : wait;
+            else if(((rc = uringHedge(job, &ring, &slot[idx], idx, &bufs)) == OK) && (slot[idx].pending == 0))
+                rc = uringAdvance(job, &ring, &slot[idx], &done);
+        }
+        if((rc != OK) || (done == total))
+            break;
+
+        if(((wait < 0) ? raidUringSubmit(&ring, 1) : raidUringSubmitTimeout(&ring, 1, wait)) != OK)
+        {
+            perror("io_uring_enter");
+            rc = ERROR;
+            break;
+        }
+
+        while((rc == OK) && raidUringReap(&ring, &tag, &res))
+        {
+            if(tag >= RAID_URING_TAG_CANCEL)
+            {
+                // Without the timeout op the wait would spin: read without hedging instead
+                if((tag == RAID_URING_TAG_TIMEOUT) && (res == -EINVAL))
+                    hedging = FALSE;
+                continue;
+            }
+
+            // The result of a read that was hedged is not needed
+            if(bufs.owner[tag / MAX_CHUNKS] == URING_BUF_STALE)
+            {
+                if(--bufs.stale[tag / MAX_CHUNKS] == 0)
+                    bufs.owner[tag / MAX_CHUNKS] = URING_BUF_FREE;
+                continue;
+            }
+
+            idx = bufs.owner[tag / MAX_CHUNKS];
+            ioIdx = (int)(tag % MAX_CHUNKS);
+            io = &slot[idx].io[ioIdx];
+
+            if((res < 0) && (slot[idx].phase == URING_WRITE) && (io->file != FILE_SLOT) &&
+               (chunkFailed(cfg, job->fail, io->file, -res) == OK))
+            {
+                if(--slot[idx].pending == 0)
+                    rc = uringAdvance(job, &ring, &slot[idx], &done);
+            }
+            else if(res <= 0)
+            {
+                printf("io_uring %s %s failed at stripe %lld: %s\n", (slot[idx].phase == URING_WRITE) ? "write to" : "read from",
+                       (io->file == FILE_SLOT) ? "file" : chunkName(cfg, io->file), (long long)slot[idx].stripeIdx,
+                       (res < 0) ? strerror(-res) : "end of file");
+                slot[idx].pending--;
+                rc = ERROR;
+            }
+            else if((size_t)res < io->len)
+            {
+                // Short transfer: queue the rest
+                io->bufOff += res;
+                io->len -= res;
+                io->pos += res;
+                rc = uringQueueIo(job, &ring, &slot[idx], ioIdx);
+            }
+            else
+            {
+                if(slot[idx].phase == URING_READ)
+                    slot[idx].reading &= ~slot[idx].ioUnit[ioIdx];
+                if(--slot[idx].pending == 0)
+                    rc = uringAdvance(job, &ring, &slot[idx], &done);
+            }
+        }
+    }
+
+    // Wait out the I/O still in flight, on error or into stale buffers, before the buffers are freed
+    for(idx = 0, inflight = 0; idx < nslots; idx++)
+        inflight += slot[idx].pending;
+    for(idx = 0; idx < bufs.count; idx++)
+        inflight += bufs.stale[idx];
+    while((inflight > 0) && (raidUringSubmit(&ring, 1) == OK))
+        while(raidUringReap(&ring, &tag, &res))
+            if(tag < RAID_URING_TAG_CANCEL)
+                inflight--;
+
+    raidUringExit(&ring);
+    free(region);
+    return rc;
+}
+
+static void *rangeWorker(void *arg)
+{
+    stripejob_t *job = (stripejob_t *)arg;
+
+    job->rc = (job->cfg->ioEngine == RAID_IO_URING) ? uringRange(job) : syncRange(job);
+    return NULL;
+}
+
+// Number of workers for count stripes: cfg->threads, or one per online CPU for
+// RAID_THREADS_AUTO, and never more than there are stripes
+static int workerCount(raidcfg_t *cfg, off_t count)
+{
+    long want = cfg->threads;
+
+    if(want == RAID_THREADS_AUTO)
+        want = sysconf(_SC_NPROCESSORS_ONLN);
+    if(want > RAID_MAX_THREADS)
+        want = RAID_MAX_THREADS;
+    if(want > count)
+        want = count;
+
+    return ((want < 1) ? 1 : (int)want);
+}
+
+// Split stripes [first, last) into contiguous ranges, one per worker, and run them. The
+// caller works the first range; a range whose thread cannot be started is run inline.
+static int runRanges(stripejob_t *job, off_t first, off_t last)
+{
+    stripejob_t slice[RAID_MAX_THREADS];
+    pthread_t tid[RAID_MAX_THREADS];
+    off_t count = last - first;
+    int workers = workerCount(job->cfg, count), started, idx, rc = OK;
+
+    for(idx = 0; idx < workers; idx++)
+    {
+        slice[idx] = *job;
+        slice[idx].first = first + (count * idx) / workers;
+        slice[idx].last = first + (count * (idx + 1)) / workers;
+        slice[idx].rc = OK;
+        slice[idx].hedged = 0;
+    }
+
+    for(started = 1; started < workers; started++)
+    {
+        if(pthread_create(&tid[started], NULL, rangeWorker, &slice[started]) != 0)
+        {
+            perror("raidlib: pthread_create");
+            break;
+        }
+    }
+
+    rangeWorker(&slice[0]);
+    for(idx = started; idx < workers; idx++)
+        rangeWorker(&slice[idx]);
+
+    for(idx = 1; idx < started; idx++)
+        pthread_join(tid[idx], NULL);
+
+    for(idx = 0; idx < workers; idx++)
+    {
+        if(slice[idx].rc != OK)
+            rc = ERROR;
+        job->hedged += slice[idx].hedged;
+    }
+
+    return rc;
+}
+
+// Open every chunk file for writing, truncating any older, differently sized stripes.
+// *generation is set one past the newest chunk set being replaced.
+static int openChunksForWrite(raidcfg_t *cfg, int *fd, uint64_t *generation)
+{
+    int idx, nchunks = chunkCount(cfg);
+    struct stat st;
+    raidsb_t sb;
+
+    *generation = 1;
+    for(idx = 0; idx < nchunks; idx++)
+    {
+        if((fd[idx] = open(chunkName(cfg, idx), O_RDWR | O_CREAT, 00644)) >= 0)
+        {
+            if((readSuperblock(fd[idx], &sb) == OK) && (sb.generation >= *generation))
+                *generation = sb.generation + 1;
+
+            // A chunk on a device keeps its size
+            if((fstat(fd[idx], &st) != 0) || (S_ISREG(st.st_mode) && (ftruncate(fd[idx], 0) != 0)))
+            {
+                close(fd[idx]);
+                fd[idx] = -1;
+            }
+        }
+
+        if(fd[idx] < 0)
+        {
+            perror(chunkName(cfg, idx));
+            while(--idx >= 0) close(fd[idx]);
+            return ERROR;
+        }
+    }
+
+    return OK;
+}
+
+// Milliseconds since a CLOCK_MONOTONIC time
+static long long elapsedMs(struct timespec *since)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000LL + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+// Sleep while bytes done since start are ahead of rate MB/s; no cap when rate is 0
+static void paceRate(struct timespec *start, off_t bytes, int rate)
+{
+    struct timespec pause;
+    long long ahead;
+
+    if(rate <= 0)
+        return;
+
+    ahead = bytes / (rate * 1000LL) - elapsedMs(start);
+    if(ahead > 0)
+    {
+        pause.tv_sec = ahead / 1000;
+        pause.tv_nsec = (ahead % 1000) * 1000000L;
+        nanosleep(&pause, NULL);
+    }
+}
+
+// Hot spare
+//
+// Striping runs in batches of stripes when it has a spare to fail over to. Once a batch
+// is done with a chunk offline, the chunk moves to the spare: its units of the later
+// batches are written there, and spareWorker rebuilds those of the stripes before from
+// the other chunks, on a thread of its own, while the striping goes on.
+typedef struct spare_rebuild
+{
+    stripejob_t job;   // Rebuild of the spare's units
+    unitsums_t sums;   // Its own mapping of the spare's checksums of those stripes
+    off_t stripes;     // Stripes written before the move
+    uint64_t chunk;    // Bit of the chunk on the spare
+    jobfail_t *fail;   // The striping's failed chunks
+    pthread_t tid;
+    int started, threaded;
+} sparerebuild_t;
+
+// Stripes in a batch of a striping with a spare, as for rebuildChunk
+static off_t spareBatch(raidcfg_t *cfg)
+{
+    off_t batch = RAID_REBUILD_BATCH / (dataCount(cfg) * unitBytes(cfg));
+
+    return (batch < 1) ? 1 : batch;
+}
+
+static void *spareWorker(void *arg)
+{
+    sparerebuild_t *spare = (sparerebuild_t *)arg;
+    raidcfg_t *cfg = spare->job.cfg;
+    off_t batch = spareBatch(cfg), next, end;
+    struct timespec start;
+    int rc = OK;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(next = 0; (next < spare->stripes) && (rc == OK); next = end)
+    {
+        end = ((spare->stripes - next) > batch) ? next + batch : spare->stripes;
+        rc = runRanges(&spare->job, next, end);
+        paceRate(&start, end * dataCount(cfg) * unitBytes(cfg), cfg->rebuildRate);
+    }
+
+    // From here on a second failed chunk only costs what the code can rebuild
+    if(rc == OK)
+        __atomic_and_fetch(&spare->fail->rebuilding, ~spare->chunk, __ATOMIC_RELAXED);
+    spare->job.rc = rc;
+    return NULL;
+}
+
+// Move the first chunk to go offline to the spare, with stripes [0, stripes) written and
+// no range running. A chunk that cannot move stays offline, with a message.
+static void spareFailover(stripejob_t *job, sparerebuild_t *spare, off_t stripes)
+{
+    raidcfg_t *cfg = job->cfg;
+    int idx, chunk, nchunks = chunkCount(cfg), shift, fd;
+    uint64_t offline = job->fail->offline;
+    stripejob_t *rebuild = &spare->job;
+    char name[PATH_MAX];
+
+    if((cfg->sparePath == NULL) || (cfg->spareChunk != 0) || spare->started || (offline == 0))
+        return;
+    chunk = __builtin_ctzll(offline);
+
+    // The spare's units are rebuilt from the chunks still online. Their reads are not
+    // checked, as the sidecars are being written, and resized for streams, while the
+    // striping goes on; the spare's checksums of the stripes before go through a mapping
+    // of the rebuild's own.
+    *rebuild = *job;
+    rebuild->plan = rebuildPlan;
+    rebuild->compute = rebuildCompute;
+    rebuild->sums = NULL;
+    rebuild->progress = NULL;
+    rebuild->fail = NULL;
+    rebuild->window = NULL;
+    rebuild->gone = offline;
+    for(idx = 0; idx <= FILE_SLOT; idx++)
+        rebuild->map[idx] = NULL;
+    for(idx = 0; idx < layoutPeriod(cfg); idx++)
+    {
+        shift = stripeShift(cfg, idx);
+        rebuild->wantUnits[idx] = chunksToUnits(CHUNK_BIT(chunk), shift, nchunks);
+        if(planRead(cfg, rebuild->wantUnits[idx], chunksToUnits(offline, shift, nchunks), &rebuild->readUnits[idx]) != OK)
+        {
+            printf("%s: too many chunks offline to rebuild it on the spare\n", chunkName(cfg, chunk));
+            return;
+        }
+    }
+
+    if((fd = open(cfg->sparePath, O_RDWR | O_CREAT | O_TRUNC, 00644)) < 0)
+    {
+        perror(cfg->sparePath);
+        return;
+    }
+    printf("%s: moving %s to the spare, rebuilding its first %lld stripes in the background\n", cfg->sparePath,
+           chunkName(cfg, chunk), (long long)stripes);
+
+    close(job->fd[chunk]);
+    job->fd[chunk] = rebuild->fd[chunk] = fd;
+    cfg->spareChunk = chunk + 1;
+    snprintf(name, sizeof(name), "%s.crc", cfg->sparePath);
+    sumsInit(&spare->sums);
+    if(moveSums(job->sums, chunk, name) != OK)
+        perror(name);
+    else if((spare->sums.map[chunk] = mmap(NULL, stripes * sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_SHARED,
+                                           job->sums->fd[chunk], 0)) == MAP_FAILED)
+        spare->sums.map[chunk] = NULL;
+    else
+    {
+        spare->sums.len[chunk] = stripes * sizeof(uint32_t);
+        rebuild->sums = &spare->sums;
+    }
+
+    spare->stripes = stripes;
+    spare->chunk = CHUNK_BIT(chunk);
+    spare->fail = job->fail;
+    job->fail->rebuilding |= CHUNK_BIT(chunk);
+    job->fail->offline &= ~CHUNK_BIT(chunk);
+
+    spare->started = TRUE;
+    if(pthread_create(&spare->tid, NULL, spareWorker, spare) == 0)
+        spare->threaded = TRUE;
+    else
+    {
+        perror("raidlib: pthread_create");
+        spareWorker(spare);
+    }
+}
+
+// Wait for the spare to be rebuilt; OK when there was nothing to rebuild
+static int spareFinish(sparerebuild_t *spare)
+{
+    if(!spare->started)
+        return OK;
+
+    if(spare->threaded)
+        pthread_join(spare->tid, NULL);
+    unmapSums(&spare->sums);
+    return spare->job.rc;
+}
+
+// Range striping, for the parallel mode and the io_uring and mmap engines: stripe-aligned
+// ranges of the input are read with positional I/O, encoded, and written to the chunk
+// files at their computed offsets
+static int stripeFileRanges(char *inputFileName, raidcfg_t *cfg)
+{
+    int idx, nchunks = chunkCount(cfg);
+    off_t stripeBytes = dataCount(cfg) * unitBytes(cfg), stripeCnt, batch, next, end;
+    sparerebuild_t spare;
+    jobprogress_t progress;
+    uint64_t generation;
+    unitsums_t sums;
+    stripejob_t job;
+    jobfail_t fail;
+    struct stat st;
+    int rc;
+
+    bzero(&job, sizeof(job));
+    bzero(&fail, sizeof(fail));
+    bzero(&spare, sizeof(spare));
+    sumsInit(&sums);
+    job.cfg = cfg;
+    job.sums = &sums;
+    job.fail = &fail;
+    fail.sums = &sums;
+    job.plan = stripePlan;
+    job.compute = stripeCompute;
+    for(idx = 0; idx <= MAX_CHUNKS; idx++)
+        job.fd[idx] = -1;
+
+    if((job.fd[FILE_SLOT] = open(inputFileName, O_RDONLY)) < 0)
+    {
+        perror(inputFileName);
+        return ERROR;
+    }
+
+    // Ranges are computed from the file size, so anything but a regular file is striped
+    // as a stream
+    if((fstat(job.fd[FILE_SLOT], &st) != 0) || !S_ISREG(st.st_mode))
+    {
+        job.fileLength = stripeStream(job.fd[FILE_SLOT], cfg);
+        close(job.fd[FILE_SLOT]);
+        return job.fileLength;
+    }
+    job.fileLength = st.st_size;
+
+    if(openChunksForWrite(cfg, job.fd, &generation) != OK)
+    {
+        close(job.fd[FILE_SLOT]);
+        return ERROR;
+    }
+
+    stripeCnt = (job.fileLength + stripeBytes - 1) / stripeBytes;
+    progressInit(&progress, job.fileLength);
+    job.progress = &progress;
+    rc = mapSums(cfg, &sums, CHUNK_BIT(nchunks) - 1, stripeCnt, SUMS_CREATE);
+    if((rc == OK) && (cfg->ioEngine == RAID_IO_MMAP) &&
+       (mapJobFiles(&job, (CHUNK_BIT(nchunks) - 1) | CHUNK_BIT(FILE_SLOT), stripeCnt, TRUE) == OK))
+    {
+        job.plan = mapPlan;
+        job.compute = mapStripeCompute;
+    }
+
+    // With a spare, the chunks are written in batches, so that a failed one can move to
+    // the spare from the next batch on
+    batch = (cfg->sparePath != NULL) ? spareBatch(cfg) : stripeCnt;
+    for(next = 0; (next < stripeCnt) && (rc == OK); next = end)
+    {
+        end = ((stripeCnt - next) > batch) ? next + batch : stripeCnt;
+        rc = runRanges(&job, next, end);
+        if(rc == OK)
+            spareFailover(&job, &spare, end);
+    }
+    if(spareFinish(&spare) != OK)
+        rc = ERROR;
+
+    // The superblocks go last, once every unit is in place, and not to the chunks that
+    // went offline
+    if(unmapJobFiles(&job) != OK)
+        rc = ERROR;
+    unmapSums(&sums);
+    if(rc == OK)
+        rc = writeSuperblocks(cfg, job.fd, (CHUNK_BIT(nchunks) - 1) & ~fail.offline, job.fileLength, generation);
+
+    for(idx = 0; idx < nchunks; idx++) close(job.fd[idx]);
+    close(job.fd[FILE_SLOT]);
+    pthread_mutex_destroy(&progress.lock);
+
+    return((rc == OK) ? job.fileLength : ERROR);
+}
+
+// Stripes the input file across multiple chunks and returns the number of bytes written
+off_t stripeFile(char *inputFileName, int offsetSectors)
+{
+    return stripeFileCfg(inputFileName, offsetSectors, &defaultConfig);
+}
+
+// Stripes the input file across the data chunks plus the parity chunks of cfg->code
+// and returns the number of bytes written, or ERROR
+off_t stripeFileCfg(char *inputFileName, int offsetSectors, raidcfg_t *cfg)
+{
+    int fd[MAX_CHUNKS], idx, nchunks = chunkCount(cfg);
+    FILE *fdin;
+    unsigned char *stripe; // data units followed by parity units
+    unsigned char *units[MAX_CHUNKS + 1];
+    size_t stripeBytes = dataCount(cfg) * unitBytes(cfg);
+    size_t offset = 0, bread = 0;
+    off_t byteCnt = 0, stripeIdx = 0, total;
+    jobprogress_t progress;
+    uint64_t generation, online;
+    unitsums_t sums;
+    jobfail_t fail;
+    struct stat st;
+    int rc = OK;
+
+    if(checkConfig(cfg) != OK)
+        return ERROR;
+
+    // Failing over to a spare needs the batches of the range striping
+    if((workerCount(cfg, RAID_MAX_THREADS) > 1) || (cfg->ioEngine != RAID_IO_SYNC) || (cfg->sparePath != NULL))
+        return stripeFileRanges(inputFileName, cfg);
+
+    // Open the input file for reading
+    if((fdin = fopen(inputFileName, "r")) == NULL)
+    {
+        perror(inputFileName);
+        return ERROR;
+    }
+
+    if((stripe = allocStripe(cfg)) == NULL)
+    {
+        fclose(fdin);
+        return ERROR;
+    }
+
+    // Open files for each data chunk and parity chunk
+    if(openChunksForWrite(cfg, fd, &generation) != OK)
+    {
+        fclose(fdin);
+        free(stripe);
+        return ERROR;
+    }
+
+    // The total is only known for a regular file; otherwise the checksum sidecars grow
+    // as the stripes come in
+    total = ((fstat(fileno(fdin), &st) == 0) && S_ISREG(st.st_mode)) ? st.st_size : 0;
+    progressInit(&progress, total);
+    sumsInit(&sums);
+    bzero(&fail, sizeof(fail));
+    fail.sums = &sums;
+    rc = mapSums(cfg, &sums, CHUNK_BIT(nchunks) - 1, (total + stripeBytes - 1) / stripeBytes, SUMS_CREATE);
+
+    do
+    {
+        // Read a stripe or until the end of the file
+        offset = 0;
+        do
+        {
+            bread = fread(&stripe[offset], 1, stripeBytes - offset, fdin);
+            offset += bread;
+        }
+        while (!(feof(fdin)) && !(ferror(fdin)) && (offset < stripeBytes));
+
+        // Nothing left when the file is an exact multiple of the stripe size
+        if((offset == 0) || (rc != OK))
+            break;
+
+        // Zero-fill the remaining stripe when the end of file is reached first
+        if(offset < stripeBytes)
+            bzero(&stripe[offset], stripeBytes - offset);
+        byteCnt += offset;
+
+        // Compute the parity units for the stripe, and the checksums of every unit on a
+        // chunk that is online
+        stripeUnits(cfg, stripe, units);
+        encodeStripe(cfg, units);
+        online = (CHUNK_BIT(nchunks) - 1) & ~chunksToUnits(fail.offline, stripeShift(cfg, stripeIdx), nchunks);
+        for(idx = 0; (idx < nchunks) && (rc == OK); idx++)
+            if(!(fail.offline & CHUNK_BIT(idx)) && (sums.len[idx] < (stripeIdx + 1) * sizeof(uint32_t)))
+                rc = sizeSums(&sums, idx, 2 * sums.len[idx] + SUMS_GROW);
+        if(rc != OK)
+        {
+            perror("stripeFile: checksums");
+            break;
+        }
+        storeSums(cfg, &sums, units, stripeIdx, online);
+
+        // Write out each unit to its chunk file, unless the chunk has gone offline
+        rc = writeStripe(cfg, fd, stripeIdx, online, stripe, &fail);
+        stripeIdx++;
+        if(rc == OK)
+            progressAdd(cfg, &progress, offset);
+    }
+    while (!(feof(fdin)) && (rc == OK)); // Continue until the end of file is reached
+
+    // Trim the sidecars to the stripes written, then record the file length and geometry
+    // now that every unit is written
+    for(idx = 0; idx < nchunks; idx++)
+        if((sums.fd[idx] >= 0) && (ftruncate(sums.fd[idx], stripeIdx * sizeof(uint32_t)) != 0))
+            rc = ERROR;
+    unmapSums(&sums);
+    if(rc == OK)
+        rc = writeSuperblocks(cfg, fd, (CHUNK_BIT(nchunks) - 1) & ~fail.offline, byteCnt, generation);
+
+    // Close all file descriptors
+    fclose(fdin);
+    for(idx = 0; idx < nchunks; idx++) close(fd[idx]);
+    free(stripe);
+    pthread_mutex_destroy(&progress.lock);
+
+    return((rc == OK) ? byteCnt : ERROR); // Return the total number of bytes written
+}
+
+// Restores the original file from the striped chunks
+//
+// missingChunk = 0 for no missing chunk
+//              = 1 ... 4 for missing data chunk
+//              = 5 for missing XOR chunk
+off_t restoreFile(char *outputFileName, int offsetSectors, off_t fileLength, int missingChunk)
+{
+    return restoreFileCfg(outputFileName, offsetSectors, fileLength, &defaultConfig, missingChunk, 0);
+}
+
+// Restores the original file from the chunks written by stripeFileCfg
+//
+// missingChunk, missingChunk2 = 0 for no missing chunk
+//                             = 1 ... n for missing data chunk, n the data chunks (4 by default)
+//                             = n + 1 for missing XOR (P) chunk, or L1 for RAID_CODE_LRC
+//                             = n + 2 for missing Q chunk, or L2 for RAID_CODE_LRC
+//                             = n + 3 for missing Q chunk (RAID_CODE_LRC only)
+//
+// With RAID_LAYOUT_ROTATING the numbers are chunk files StripeChunk1.bin ... and each
+// file holds data or parity depending on the stripe.
+//
+// RAID_CODE_XOR survives one missing chunk, RAID_CODE_PQ and RAID_CODE_LRC any two.
+// Missing chunks are never opened, so they may be deleted.
+// The superblocks of the other chunks are checked first, and a chunk that is gone,
+// stale or out of place is rebuilt as well. fileLength may be RAID_LENGTH_FROM_CHUNKS.
+// With cfg->threads > 1 stripe ranges are rebuilt in parallel and written with pwrite.
+// The mmap engine writes the output through a mapping instead.
+//
+// restoreSetup vets the chunk set, plans the reads and opens the chunks and their
+// checksums for a restore job; restoreCleanup closes them again
+static int restoreSetup(raidcfg_t *cfg, off_t fileLength, int missingChunk, int missingChunk2,
+                        stripejob_t *job, unitsums_t *sums)
+{
+    int idx, chunk, nchunks = chunkCount(cfg);
+    off_t stripeBytes = dataCount(cfg) * unitBytes(cfg), stripeCnt;
+    uint64_t lost = 0, bad, openMask = 0;
+    int period = layoutPeriod(cfg), shift;
+    raidsb_t sb;
+    int rc = OK;
+
+    bzero(job, sizeof(*job));
+    sumsInit(sums);
+    for(idx = 0; idx <= FILE_SLOT; idx++)
+        job->fd[idx] = -1;
+
+    if(checkConfig(cfg) != OK)
+        return ERROR;
+
+    if((fileLength < 0) && (fileLength != RAID_LENGTH_FROM_CHUNKS))
+    {
+        printf("restoreFile: bad file length %lld\n", (long long)fileLength);
+        return ERROR;
+    }
+
+    if((missingChunk < 0) || (missingChunk > nchunks) || (missingChunk2 < 0) || (missingChunk2 > nchunks) ||
+       ((missingChunk2 != 0) && (missingChunk2 == missingChunk)))
+    {
+        printf("restoreFile: cannot rebuild chunks %d and %d\n", missingChunk, missingChunk2);
+        return ERROR;
+    }
+
+    if(missingChunk != 0)
+        lost |= CHUNK_BIT(missingChunk - 1);
+    if(missingChunk2 != 0)
+        lost |= CHUNK_BIT(missingChunk2 - 1);
+
+    // Vet the chunk set before reading any data
+    if(checkChunkSet(cfg, (CHUNK_BIT(nchunks) - 1) & ~lost, &bad, &sb) != OK)
+    {
+        printf("restoreFile: no usable chunks\n");
+        return ERROR;
+    }
+    lost |= bad;
+
+    if(fileLength == RAID_LENGTH_FROM_CHUNKS)
+        fileLength = sb.fileLength;
+    stripeCnt = (fileLength + stripeBytes - 1) / stripeBytes;
+
+    job->cfg = cfg;
+    job->fileLength = fileLength;
+    job->plan = restorePlan;
+    job->compute = restoreCompute;
+
+    // Plan the reads for each placement of the layout. Only the data units are wanted;
+    // lost parity is not rebuilt for the output file.
+    for(idx = 0; idx < period; idx++)
+    {
+        shift = stripeShift(cfg, idx);
+        if(planRead(cfg, dataMask(cfg), chunksToUnits(lost, shift, nchunks), &job->readUnits[idx]) != OK)
+        {
+            printf("restoreFile: cannot rebuild %d lost chunks\n", __builtin_popcountll(lost));
+            return ERROR;
+        }
+    }
+
+    // Every chunk that is there is opened: a unit that fails its checksum is rebuilt from
+    // units the plan does not read
+    openMask = (CHUNK_BIT(nchunks) - 1) & ~lost;
+    job->gone = lost;
+    if(cfg->hedgeUs > 0)
+        job->hedgeWant = dataMask(cfg);
+
+    for(chunk = 1; chunk <= nchunks; chunk++)
+        if(lost & CHUNK_BIT(chunk - 1))
+            printf("will rebuild chunk %d\n", chunk);
+
+    // Open the chunk files that are needed
+    for(idx = 0; idx < nchunks; idx++)
+    {
+        if((openMask & CHUNK_BIT(idx)) && ((job->fd[idx] = open(chunkName(cfg, idx), O_RDONLY)) < 0))
+        {
+            perror(chunkName(cfg, idx));
+            rc = ERROR;
+        }
+    }
+
+    if(rc == OK)
+        rc = mapSums(cfg, sums, openMask, stripeCnt, SUMS_READ);
+    job->sums = sums;
+
+    return rc;
+}
+
+static int restoreCleanup(stripejob_t *job, unitsums_t *sums)
+{
+    int idx, rc;
+
+    if(job->hedged > 0)
+        printf("restoreFile: rebuilt the slow reads of %lld stripes from parity\n", (long long)job->hedged);
+
+    rc = unmapJobFiles(job);
+    unmapSums(sums);
+    for(idx = 0; idx < MAX_CHUNKS; idx++)
+        if(job->fd[idx] >= 0) close(job->fd[idx]);
+
+    return rc;
+}
+
+off_t restoreFileCfg(char *outputFileName, int offsetSectors, off_t fileLength, raidcfg_t *cfg,
+                     int missingChunk, int missingChunk2)
+{
+    off_t stripeBytes = dataCount(cfg) * unitBytes(cfg), stripeCnt;
+    jobprogress_t progress;
+    unitsums_t sums;
+    stripejob_t job;
+    int rc;
+
+    rc = restoreSetup(cfg, fileLength, missingChunk, missingChunk2, &job, &sums);
+    fileLength = job.fileLength;
+    stripeCnt = (fileLength + stripeBytes - 1) / stripeBytes;
+
+    // Open the output file for writing the restored data (read too, for the mmap engine)
+    if((rc == OK) && ((job.fd[FILE_SLOT] = open(outputFileName, O_RDWR | O_CREAT | O_TRUNC, 00644)) < 0))
+    {
+        perror(outputFileName);
+        rc = ERROR;
+    }
+
+    if((rc == OK) && (cfg->ioEngine == RAID_IO_MMAP) &&
+       (mapJobFiles(&job, ((CHUNK_BIT(chunkCount(cfg)) - 1) & ~job.gone) | CHUNK_BIT(FILE_SLOT), stripeCnt, FALSE) == OK))
+    {
+        job.plan = mapPlan;
+        job.compute = mapRestoreCompute;
+    }
+
+    // Rebuild and write out the stripes, the last one cut to the file length
+    progressInit(&progress, fileLength);
+    job.progress = &progress;
+    if(rc == OK)
+        rc = runRanges(&job, 0, stripeCnt);
+
+    // Close the output file and all chunk files, once the mapped output is written back
+    if(restoreCleanup(&job, &sums) != OK)
+        rc = ERROR;
+    if(job.fd[FILE_SLOT] >= 0)
+        close(job.fd[FILE_SLOT]);
+    pthread_mutex_destroy(&progress.lock);
+
+    return((rc == OK) ? fileLength : ERROR); // Return the total file length restored
+}
+
+// Streams
+//
+// A pipe is read or written front to back, one batch of RAID_STREAM_BATCH bytes at a
+// time: the batch is read into a window, striped by the workers, and the next one read;
+// on restore the workers fill the window and it is written out. The chunk files still
+// take positional I/O, so the workers and the I/O engines work as for files, except
+// the mmap engine, which falls back to pread/pwrite.
+
+// Stripes in a stream batch
+static off_t streamBatch(raidcfg_t *cfg)
+{
+    off_t stripeBytes = dataCount(cfg) * unitBytes(cfg);
+
+    return ((RAID_STREAM_BATCH > stripeBytes) ? RAID_STREAM_BATCH / stripeBytes : 1);
+}
+
+// Read up to len bytes of a stream; short only at its end. Returns the bytes read or ERROR.
+static ssize_t readStream(int fd, unsigned char *buf, size_t len)
+{
+    size_t offset = 0;
+    ssize_t bread;
+
+    while(offset < len)
+    {
+        if((bread = read(fd, &buf[offset], len - offset)) == 0)
+            break;
+        if(bread < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return ERROR;
+        }
+        offset += bread;
+    }
+
+    return (ssize_t)offset;
+}
+
+static int writeStream(int fd, unsigned char *buf, size_t len)
+{
+    size_t offset = 0;
+    ssize_t bwritten;
+
+    while(offset < len)
+    {
+        if((bwritten = write(fd, &buf[offset], len - offset)) < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return ERROR;
+        }
+        offset += bwritten;
+    }
+
+    return OK;
+}
+
+off_t stripeStream(int inputFd, raidcfg_t *cfg)
+{
+    int idx, nchunks, rc = OK;
+    off_t stripeBytes, batch, stripeCnt = 0, cnt;
+    sparerebuild_t spare;
+    jobprogress_t progress;
+    uint64_t generation;
+    unitsums_t sums;
+    stripejob_t job;
+    jobfail_t fail;
+    ssize_t bread;
+
+    if(checkConfig(cfg) != OK)
+        return ERROR;
+
+    nchunks = chunkCount(cfg);
+    stripeBytes = dataCount(cfg) * unitBytes(cfg);
+    batch = streamBatch(cfg);
+
+    bzero(&job, sizeof(job));
+    bzero(&fail, sizeof(fail));
+    bzero(&spare, sizeof(spare));
+    job.cfg = cfg;
+    job.plan = streamStripePlan;
+    job.compute = streamStripeCompute;
+    job.fd[FILE_SLOT] = -1;
+    job.sums = &sums;
+    job.fail = &fail;
+    fail.sums = &sums;
+    if((job.window = malloc(batch * stripeBytes)) == NULL)
+        return ERROR;
+
+    if(openChunksForWrite(cfg, job.fd, &generation) != OK)
+    {
+        free(job.window);
+        return ERROR;
+    }
+
+    // The length is not known until the end, so the sidecars grow batch by batch
+    sumsInit(&sums);
+    rc = mapSums(cfg, &sums, CHUNK_BIT(nchunks) - 1, 0, SUMS_CREATE);
+    progressInit(&progress, 0);
+    job.progress = &progress;
+
+    while(rc == OK)
+    {
+        if((bread = readStream(inputFd, job.window, batch * stripeBytes)) <= 0)
+        {
+            if(bread < 0)
+            {
+                perror("stripeStream: read");
+                rc = ERROR;
+            }
+            break;
+        }
+
+        // An offline chunk's sidecar has been dropped
+        cnt = (bread + stripeBytes - 1) / stripeBytes;
+        for(idx = 0; (idx < nchunks) && (rc == OK); idx++)
+            if(!(fail.offline & CHUNK_BIT(idx)))
+                rc = sizeSums(&sums, idx, (stripeCnt + cnt) * sizeof(uint32_t));
+        if(rc != OK)
+        {
+            perror("stripeStream: checksums");
+            break;
+        }
+
+        job.windowFirst = stripeCnt;
+        job.fileLength += bread;
+        rc = runRanges(&job, stripeCnt, stripeCnt + cnt);
+        stripeCnt += cnt;
+        if(rc == OK)
+            spareFailover(&job, &spare, stripeCnt);
+
+        if(bread < batch * stripeBytes)
+            break;
+    }
+    if(spareFinish(&spare) != OK)
+        rc = ERROR;
+
+    // The length is recorded at the end of the stream, once every unit is written
+    unmapSums(&sums);
+    if(rc == OK)
+        rc = writeSuperblocks(cfg, job.fd, (CHUNK_BIT(nchunks) - 1) & ~fail.offline, job.fileLength, generation);
+
+    for(idx = 0; idx < nchunks; idx++) close(job.fd[idx]);
+    free(job.window);
+    pthread_mutex_destroy(&progress.lock);
+
+    return((rc == OK) ? job.fileLength : ERROR);
+}
+
+off_t restoreStream(int outputFd, raidcfg_t *cfg, int missingChunk, int missingChunk2)
+{
+    off_t stripeBytes, batch, stripeCnt, next, end;
+    jobprogress_t progress;
+    unitsums_t sums;
+    stripejob_t job;
+    size_t len;
+    int rc;
+
+    rc = restoreSetup(cfg, RAID_LENGTH_FROM_CHUNKS, missingChunk, missingChunk2, &job, &sums);
+    if(rc != OK)
+    {
+        restoreCleanup(&job, &sums);
+        return ERROR;
+    }
+
+    stripeBytes = dataCount(cfg) * unitBytes(cfg);
+    stripeCnt = (job.fileLength + stripeBytes - 1) / stripeBytes;
+    batch = streamBatch(cfg);
+    job.plan = streamRestorePlan;
+    job.compute = streamRestoreCompute;
+    if((job.window = malloc(batch * stripeBytes)) == NULL)
+        rc = ERROR;
+
+    progressInit(&progress, job.fileLength);
+    job.progress = &progress;
+
+    for(next = 0; (next < stripeCnt) && (rc == OK); next = end)
+    {
+        end = ((stripeCnt - next) > batch) ? next + batch : stripeCnt;
+        job.windowFirst = next;
+        rc = runRanges(&job, next, end);
+
+        // The last stripe is cut to the file length
+        len = (size_t)((end < stripeCnt) ? (end - next) * stripeBytes : job.fileLength - next * stripeBytes);
+        if((rc == OK) && (writeStream(outputFd, job.window, len) != OK))
+        {
+            perror("restoreStream: write");
+            rc = ERROR;
+        }
+    }
+
+    free(job.window);
+    restoreCleanup(&job, &sums);
+    pthread_mutex_destroy(&progress.lock);
+
+    return((rc == OK) ? job.fileLength : ERROR);
+}
+
+// Rebuild checkpoint, kept next to the first replacement chunk while rebuildChunk runs:
+// the stripes before nextStripe are written to the replacements and synced
+#define RAID_CKPT_MAGIC (0x54504b4344494152ULL) // "RAIDCKPT"
+
+typedef struct rebuild_checkpoint
+{
+    uint64_t magic;
+    uint64_t generation;   // Of the chunk set being repaired
+    uint64_t lost;         // Chunks being rebuilt
+    uint32_t unitSize;
+    uint32_t dataChunks;
+    uint64_t nextStripe;
+} rebuildckpt_t;
+
+static void checkpointName(raidcfg_t *cfg, uint64_t lost, char *name, size_t len)
+{
+    snprintf(name, len, "%s.rebuild", chunkName(cfg, __builtin_ctzll(lost)));
+}
+
+// The stripe a rebuild of the chunks in lost can pick up from, 0 to start over
+static off_t readCheckpoint(raidcfg_t *cfg, uint64_t lost, raidsb_t *sb)
+{
+    rebuildckpt_t ckpt;
+    char name[PATH_MAX];
+    off_t next = 0;
+    int fd;
+
+    checkpointName(cfg, lost, name, sizeof(name));
+    if((fd = open(name, O_RDONLY)) < 0)
+        return 0;
+
+    if((readFull(fd, (unsigned char *)&ckpt, sizeof(ckpt), 0) == OK) && (ckpt.magic == RAID_CKPT_MAGIC) &&
+       (ckpt.generation == sb->generation) && (ckpt.lost == lost) && (ckpt.unitSize == unitBytes(cfg)) &&
+       (ckpt.dataChunks == (uint32_t)dataCount(cfg)))
+        next = ckpt.nextStripe;
+    close(fd);
+
+    return next;
+}
+
+static int writeCheckpoint(raidcfg_t *cfg, uint64_t lost, raidsb_t *sb, off_t nextStripe)
+{
+    rebuildckpt_t ckpt;
+    char name[PATH_MAX];
+    int fd, rc;
+
+    bzero(&ckpt, sizeof(ckpt));
+    ckpt.magic = RAID_CKPT_MAGIC;
+    ckpt.generation = sb->generation;
+    ckpt.lost = lost;
+    ckpt.unitSize = unitBytes(cfg);
+    ckpt.dataChunks = dataCount(cfg);
+    ckpt.nextStripe = nextStripe;
+
+    checkpointName(cfg, lost, name, sizeof(name));
+    if((fd = open(name, O_WRONLY | O_CREAT, 00644)) < 0)
+    {
+        perror(name);
+        return ERROR;
+    }
+
+    rc = writeFull(fd, (unsigned char *)&ckpt, sizeof(ckpt), 0);
+    if((rc != OK) || (fdatasync(fd) != 0))
+    {
+        perror(name);
+        rc = ERROR;
+    }
+    close(fd);
+
+    return rc;
+}
+
+// Rebuild stripes [first, last) in batches of RAID_REBUILD_BATCH file bytes. After each
+// batch the replacements and their checksums are synced and the checkpoint moved past it. With
+// cfg->rebuildRate set, batches shrink to a quarter second's worth and the rebuild
+// sleeps whenever it gets ahead of that many MB/s of file data.
+static int rebuildBatches(stripejob_t *job, uint64_t lost, raidsb_t *sb, off_t first, off_t last)
+{
+    raidcfg_t *cfg = job->cfg;
+    off_t stripeBytes = dataCount(cfg) * unitBytes(cfg), batch = RAID_REBUILD_BATCH / stripeBytes, next, end;
+    struct timespec start;
+    int idx, rc = OK;
+
+    if((cfg->rebuildRate > 0) && (batch > (cfg->rebuildRate * 250000LL) / stripeBytes))
+        batch = (cfg->rebuildRate * 250000LL) / stripeBytes;
+    if(batch < 1)
+        batch = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(next = first; (next < last) && (rc == OK); next = end)
+    {
+        end = ((last - next) > batch) ? next + batch : last;
+        rc = runRanges(job, next, end);
+
+        for(idx = 0; (idx < MAX_CHUNKS) && (rc == OK); idx++)
+        {
+            if((lost & CHUNK_BIT(idx)) && (fdatasync(job->fd[idx]) != 0))
+            {
+                perror(chunkName(cfg, idx));
+                rc = ERROR;
+            }
+        }
+        if((rc == OK) && (syncSums(job->sums, lost) != OK))
+        {
+            perror("rebuildChunk: checksums");
+            rc = ERROR;
+        }
+        if(rc == OK)
+            rc = writeCheckpoint(cfg, lost, sb, end);
+        if(rc == OK)
+            paceRate(&start, (end - first) * stripeBytes, cfg->rebuildRate);
+    }
+
+    return rc;
+}
+
+// Reads the geometry and file length of a chunk set from its newest superblock. In the
+// current directory data chunk i is StripeChunk<i+1>.bin under every code, layout and
+// width, so the probe does not need to know them. Chunks given by cfg->chunkPath are
+// looked for there, as many as cfg describes.
+int raidProbe(raidcfg_t *cfg, off_t *fileLength)
+{
+    raidsb_t sb, newest;
+    int idx, fd, count = RAID_MAX_DATA;
+
+    if(cfg->chunkPath != NULL)
+    {
+        if(checkConfig(cfg) != OK)
+            return ERROR;
+        count = chunkCount(cfg);
+    }
+
+    newest.generation = 0;
+    for(idx = 0; idx < count; idx++)
+    {
+        if((fd = open((cfg->chunkPath != NULL) ? cfg->chunkPath[idx] : numberedChunkName[idx], O_RDONLY)) < 0)
+            continue;
+
+        if((readSuperblock(fd, &sb) == OK) && (sb.chunkIndex == idx) && (sb.generation > newest.generation))
+            newest = sb;
+        close(fd);
+    }
+
+    if(newest.generation == 0)
+    {
+        printf("raidProbe: no chunk superblock found\n");
+        return ERROR;
+    }
+
+    cfg->code = newest.code;
+    cfg->layout = newest.layout;
+    cfg->dataChunks = newest.dataChunks;
+    cfg->sectorSize = newest.sectorSize;
+    cfg->unitSize = newest.unitSize;
+    *fileLength = newest.fileLength;
+
+    return checkConfig(cfg);
+}
+
+// Rewrites lost chunk files missingChunk and missingChunk2 (1-based, 0 for none) from the
+// surviving chunks and returns the number of stripes written, or ERROR
+//
+// Only the chunks the code needs are read: every survivor for RAID_CODE_XOR, the data
+// plus P for RAID_CODE_PQ, and just the chunk's local group for RAID_CODE_LRC. The work
+// is checkpointed every RAID_REBUILD_BATCH bytes, so a rebuild that is cut short resumes
+// where it stopped, and cfg->rebuildRate caps its pace.
+off_t rebuildChunk(raidcfg_t *cfg, int missingChunk, int missingChunk2)
+{
+    int idx, nchunks = chunkCount(cfg);
+    int period = layoutPeriod(cfg), shift, rc = OK;
+    off_t stripeBytes = dataCount(cfg) * unitBytes(cfg), stripeCnt, resume;
+    uint64_t lost = 0, openMask = 0, bad;
+    char name[PATH_MAX];
+    jobprogress_t progress;
+    unitsums_t sums;
+    stripejob_t job;
+    raidsb_t sb;
+
+    if(checkConfig(cfg) != OK)
+        return ERROR;
+
+    if((missingChunk < 0) || (missingChunk > nchunks) || (missingChunk2 < 0) || (missingChunk2 > nchunks))
+    {
+        printf("rebuildChunk: cannot rebuild chunks %d and %d\n", missingChunk, missingChunk2);
+        return ERROR;
+    }
+
+    if(missingChunk != 0)
+        lost |= CHUNK_BIT(missingChunk - 1);
+    if(missingChunk2 != 0)
+        lost |= CHUNK_BIT(missingChunk2 - 1);
+
+    // Survivors that turn out to be gone, stale or out of place are rebuilt too
+    if(checkChunkSet(cfg, (CHUNK_BIT(nchunks) - 1) & ~lost, &bad, &sb) != OK)
+    {
+        printf("rebuildChunk: no usable chunks\n");
+        return ERROR;
+    }
+    lost |= bad;
+
+    bzero(&job, sizeof(job));
+    job.cfg = cfg;
+    job.plan = rebuildPlan;
+    job.compute = rebuildCompute;
+    job.fd[FILE_SLOT] = -1;
+
+    // Plan the reads for each placement of the layout; the lost units are the wanted ones
+    for(idx = 0; (idx < period) && (lost != 0); idx++)
+    {
+        shift = stripeShift(cfg, idx);
+        job.wantUnits[idx] = chunksToUnits(lost, shift, nchunks);
+        if(planRead(cfg, job.wantUnits[idx], job.wantUnits[idx], &job.readUnits[idx]) != OK)
+            break;
+        openMask |= unitsToChunks(job.readUnits[idx], shift, nchunks);
+    }
+    if((lost == 0) || (idx < period))
+    {
+        printf("rebuildChunk: cannot rebuild %d lost chunks\n", __builtin_popcountll(lost));
+        return ERROR;
+    }
+    job.gone = lost;
+
+    for(idx = 0; idx < nchunks; idx++)
+        if(lost & CHUNK_BIT(idx))
+            printf("rebuilding %s from %d of %d surviving chunks\n", chunkName(cfg, idx),
+                   __builtin_popcountll(openMask), nchunks - __builtin_popcountll(lost));
+
+    // Every chunk holds one unit per stripe of the file. A rebuild of the same chunks of
+    // the same set picks up at its checkpoint, keeping what the replacements hold.
+    stripeCnt = (sb.fileLength + stripeBytes - 1) / stripeBytes;
+    resume = readCheckpoint(cfg, lost, &sb);
+    if(resume > stripeCnt)
+        resume = 0;
+
+    // The replacements' checksums so far have to have survived along with the checkpoint
+    sumsInit(&sums);
+    job.sums = &sums;
+    if((resume > 0) && (mapSums(cfg, &sums, lost, stripeCnt, SUMS_UPDATE) != OK))
+        resume = 0;
+    for(idx = 0; (idx < nchunks) && (resume > 0); idx++)
+        if((lost & CHUNK_BIT(idx)) && (sums.map[idx] == NULL))
+        {
+            printf("%s: no checksums for the stripes before the checkpoint\n", chunkName(cfg, idx));
+            resume = 0;
+        }
+    if(resume > 0)
+        printf("resuming the rebuild at stripe %lld of %lld\n", (long long)resume, (long long)stripeCnt);
+    else
+    {
+        unmapSums(&sums);
+        rc = mapSums(cfg, &sums, lost, stripeCnt, SUMS_CREATE);
+    }
+    if(rc == OK)
+        rc = mapSums(cfg, &sums, (CHUNK_BIT(nchunks) - 1) & ~lost, stripeCnt, SUMS_READ);
+
+    // Open the chunks to read, and the replacements for the lost ones. Survivors the plan
+    // does not read are opened too, for rebuilding units that fail their checksums.
+    for(idx = 0; idx < MAX_CHUNKS; idx++)
+    {
+        job.fd[idx] = -1;
+        if((idx < nchunks) && !(lost & CHUNK_BIT(idx)))
+            job.fd[idx] = open(chunkName(cfg, idx), O_RDONLY);
+        else if(lost & CHUNK_BIT(idx))
+            job.fd[idx] = open(chunkName(cfg, idx), O_WRONLY | O_CREAT | ((resume > 0) ? 0 : O_TRUNC), 00644);
+        else
+            continue;
+
+        if(job.fd[idx] < 0)
+        {
+            perror(chunkName(cfg, idx));
+            rc = ERROR;
+        }
+    }
+
+    // Progress counts the file bytes the rebuilt stripes cover, including those rebuilt
+    // before the checkpoint
+    job.fileLength = sb.fileLength;
+    progressInit(&progress, job.fileLength);
+    progress.done = progress.reported = ((resume * stripeBytes) < job.fileLength) ? resume * stripeBytes : job.fileLength;
+    job.progress = &progress;
+    if(rc == OK)
+        rc = rebuildBatches(&job, lost, &sb, resume, stripeCnt);
+
+    // The replacements join the set's generation once their units are written, and the
+    // checkpoint goes with them
+    if(rc == OK)
+        rc = writeSuperblocks(cfg, job.fd, lost, sb.fileLength, sb.generation);
+    if(rc == OK)
+    {
+        checkpointName(cfg, lost, name, sizeof(name));
+        unlink(name);
+    }
+
+    for(idx = 0; idx < nchunks; idx++)
+        if(job.fd[idx] >= 0) close(job.fd[idx]);
+    unmapSums(&sums);
+    pthread_mutex_destroy(&progress.lock);
+
+    return((rc == OK) ? stripeCnt : ERROR);
+}
+
+// Reads every unit of the chunk set and checks its parity, reporting the stripes that do
+// not match through mismatch. Without a rate cap the stripes are one run of ranges; with
+// one they go in quarter-second batches, with a pause whenever the scrub gets ahead.
+// Scrub the fileLength bytes striped over the open chunk files fd, with sums the
+// checksums of their units; returns the stripes that do not match, or ERROR
+static off_t scrubChunks(raidcfg_t *cfg, int *fd, unitsums_t *sums, off_t fileLength, raidmismatch_t mismatch, void *arg)
+{
+    int idx, nchunks = chunkCount(cfg), rc = OK;
+    off_t stripeBytes = dataCount(cfg) * unitBytes(cfg), readBytes = nchunks * unitBytes(cfg);
+    off_t stripeCnt = (fileLength + stripeBytes - 1) / stripeBytes, batch, next, end;
+    jobprogress_t progress;
+    struct timespec start;
+    jobscrub_t scrub;
+    stripejob_t job;
+
+    bzero(&job, sizeof(job));
+    job.cfg = cfg;
+    job.plan = scrubPlan;
+    job.compute = scrubCompute;
+    job.fd[FILE_SLOT] = -1;
+    for(idx = 0; idx < MAX_CHUNKS; idx++)
+        job.fd[idx] = (idx < nchunks) ? fd[idx] : -1;
+    job.fileLength = fileLength;
+
+    // Checksums, where kept, tell which unit of a stripe went bad
+    job.sums = sums;
+
+    pthread_mutex_init(&scrub.lock, NULL);
+    scrub.mismatch = mismatch;
+    scrub.arg = arg;
+    scrub.stripes = 0;
+    job.scrub = &scrub;
+
+    progressInit(&progress, job.fileLength);
+    job.progress = &progress;
+
+    batch = stripeCnt;
+    if(cfg->scrubRate > 0)
+        batch = (cfg->scrubRate * 250000LL) / readBytes;
+    if(batch < 1)
+        batch = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(next = 0; (next < stripeCnt) && (rc == OK); next = end)
+    {
+        end = ((stripeCnt - next) > batch) ? next + batch : stripeCnt;
+        rc = runRanges(&job, next, end);
+        paceRate(&start, end * readBytes, cfg->scrubRate);
+    }
+
+    pthread_mutex_destroy(&progress.lock);
+    pthread_mutex_destroy(&scrub.lock);
+
+    return((rc == OK) ? scrub.stripes : ERROR);
+}
+
+off_t raidScrub(raidcfg_t *cfg, raidmismatch_t mismatch, void *arg)
+{
+    int fd[MAX_CHUNKS], idx, nchunks = chunkCount(cfg);
+    off_t stripeBytes = dataCount(cfg) * unitBytes(cfg), rc = OK;
+    unitsums_t sums;
+    uint64_t bad;
+    raidsb_t sb;
+
+    if(checkConfig(cfg) != OK)
+        return ERROR;
+
+    // Parity can only be checked against a complete set
+    if((checkChunkSet(cfg, CHUNK_BIT(nchunks) - 1, &bad, &sb) != OK) || (bad != 0))
+    {
+        printf("raidScrub: chunks are missing or stale, rebuild them first\n");
+        return ERROR;
+    }
+
+    for(idx = 0; idx < nchunks; idx++)
+    {
+        if((fd[idx] = open(chunkName(cfg, idx), O_RDONLY)) < 0)
+        {
+            perror(chunkName(cfg, idx));
+            rc = ERROR;
+        }
+    }
+
+    sumsInit(&sums);
+    if(rc == OK)
+        rc = mapSums(cfg, &sums, CHUNK_BIT(nchunks) - 1, (sb.fileLength + stripeBytes - 1) / stripeBytes, SUMS_READ);
+    if(rc == OK)
+        rc = scrubChunks(cfg, fd, &sums, sb.fileLength, mismatch, arg);
+
+    for(idx = 0; idx < nchunks; idx++)
+        if(fd[idx] >= 0) close(fd[idx]);
+    unmapSums(&sums);
+
+    return rc;
+}
+
+// A stripe held by the write-back cache. Only sectors flagged dirty hold data; a write
+// that covers part of a sector reads the rest of it first, so a dirty sector is whole.
+typedef struct cache_stripe
+{
+    off_t stripeIdx;           // -1 when the entry is free
+    unsigned char *data;       // The stripe's data units
+    unsigned char *dirty;      // One flag per sector of data
+    int dirtyCnt;
+    struct timespec since;     // When the stripe went dirty
+} cachestripe_t;
+
+// An open chunk set for random access
+struct raid_set
+{
+    raidcfg_t cfg;
+    int fd[MAX_CHUNKS];        // Open chunk files, -1 for lost chunks
+    uint64_t lost;             // Lost chunks
+    off_t fileLength;
+    uint64_t generation;       // Generation of the superblocks on the chunks
+    int readOnly;              // Chunks could only be opened for reading
+    unitsums_t sums;           // Checksums of the open chunks' units
+    unsigned char *stripe;     // Parts of units being read, rebuilt or written, and the scratch unit
+    unsigned char *delta;      // Data and parity deltas of a read-modify-write
+    pthread_mutex_t lock;
+
+    cachestripe_t *cache;      // cfg.cacheStripes entries, NULL when writing through
+    pthread_t flusher;         // Flushes stripes dirty for longer than the cache age
+    pthread_cond_t wake;
+    int stopping;              // Tells the flusher to exit
+    int flushRc;               // ERROR once a background flush has failed
+};
+
+// Read from a chunk of the set; a chunk that fails is lost for this and later reads
+static int setRead(raidset_t *set, int chunk, unsigned char *buf, size_t len, off_t pos)
+{
+    if(readFull(set->fd[chunk], buf, len, pos) == OK)
+        return OK;
+
+    printf("%s: read failed at %lld, treating it as lost\n", chunkName(&set->cfg, chunk), (long long)pos);
+    set->lost |= CHUNK_BIT(chunk);
+    return ERROR;
+}
+
+// Byte range [*from, *to) of data unit idx covered by bytes [start, start + len) of a stripe
+static void unitSpan(size_t unit, int idx, size_t start, size_t len, size_t *from, size_t *to)
+{
+    *from = (start > idx * unit) ? start - idx * unit : 0;
+    *to = (start + len < (idx + 1) * unit) ? start + len - idx * unit : unit;
+}
+
+// Sector-aligned window [*lo, *hi) of a unit that holds every byte the range covers in
+// any of its units: the whole unit once the range crosses a unit boundary
+static void unitWindow(raidcfg_t *cfg, size_t start, size_t len, size_t *lo, size_t *hi)
+{
+    size_t unit = unitBytes(cfg), sector = sectorBytes(cfg);
+    int first = start / unit;
+
+    *lo = 0;
+    *hi = unit;
+    if(first == (int)((start + len - 1) / unit))
+    {
+        *lo = (start - first * unit) & ~(sector - 1);
+        *hi = (start + len - first * unit + sector - 1) & ~(sector - 1);
+    }
+}
+
+// Read len bytes of the data of stripe stripeIdx, from byte start of the stripe, into buf.
+// Units that are there are read straight into buf. When a unit the range covers is lost,
+// the same sector-aligned window of the other units is read instead and the lost part is
+// rebuilt there: parity is computed byte position by byte position, so a window of every
+// unit is a smaller stripe of its own. Units read whole are checked against their
+// checksums, and one that fails is rebuilt like a lost one.
+static int setReadStripe(raidset_t *set, off_t stripeIdx, size_t start, size_t len, unsigned char *buf)
+{
+    raidcfg_t *cfg = &set->cfg, window;
+    size_t unit = unitBytes(cfg), lo, hi, from, to;
+    int nchunks = chunkCount(cfg), shift = stripeShift(cfg, stripeIdx);
+    int first = start / unit, last = (start + len - 1) / unit;
+    uint64_t want = (CHUNK_BIT(last + 1) - 1) & ~(CHUNK_BIT(first) - 1);
+    uint64_t lostUnits, readMask, whole, bad = 0;
+    int idx, rc;
+    unsigned char *units[MAX_CHUNKS + 1];
+    off_t base = dataOffset(cfg) + stripeIdx * unit;
+
+    // A read that fails adds its chunk to the lost ones, and a unit that fails its checksum
+    // is added to the bad ones, so this ends when the data is read or there is too little
+    // left to rebuild it
+    do
+    {
+        rc = OK;
+        lostUnits = chunksToUnits(set->lost, shift, nchunks) | bad;
+
+        if((want & lostUnits) == 0)
+        {
+            whole = 0;
+            for(idx = first; (idx <= last) && (rc == OK); idx++)
+            {
+                unitSpan(unit, idx, start, len, &from, &to);
+                rc = setRead(set, (idx + shift) % nchunks, &buf[idx * unit + from - start], to - from, base + from);
+                if((from == 0) && (to == unit))
+                {
+                    units[idx] = &buf[idx * unit - start];
+                    whole |= CHUNK_BIT(idx);
+                }
+            }
+            if((rc == OK) && ((whole = checkSums(cfg, &set->sums, units, stripeIdx, whole)) != 0))
+            {
+                bad |= whole;
+                rc = ERROR;
+            }
+            continue;
+        }
+
+        if(planRead(cfg, want, lostUnits, &readMask) != OK)
+        {
+            printf("raidPread: cannot rebuild %d lost chunks\n", __builtin_popcountll(set->lost));
+            return ERROR;
+        }
+
+        unitWindow(cfg, start, len, &lo, &hi);
+        window = *cfg;
+        window.unitSize = hi - lo;
+        stripeUnits(&window, set->stripe, units);
+
+        for(idx = 0; (idx < nchunks) && (rc == OK); idx++)
+            if(readMask & CHUNK_BIT(idx))
+                rc = setRead(set, (idx + shift) % nchunks, units[idx], hi - lo, base + lo);
+        if((rc == OK) && (hi - lo == unit) && ((whole = checkSums(cfg, &set->sums, units, stripeIdx, readMask)) != 0))
+        {
+            bad |= whole;
+            rc = ERROR;
+        }
+        if(rc != OK)
+            continue;
+
+        if(rebuildStripe(&window, units, readMask, want) != OK)
+            return ERROR;
+
+        for(idx = first; idx <= last; idx++)
+        {
+            unitSpan(unit, idx, start, len, &from, &to);
+            memcpy(&buf[idx * unit + from - start], units[idx] + from - lo, to - from);
+        }
+    }
+    while(rc != OK);
+
+    return OK;
+}
+
+// Write to a chunk of the set. A chunk that fails is lost from then on: the units written
+// to the others still rebuild it, so the set stays readable.
+static int setWrite(raidset_t *set, int chunk, unsigned char *buf, size_t len, off_t pos)
+{
+    if(writeFull(set->fd[chunk], buf, len, pos) == OK)
+        return OK;
+
+    printf("%s: write failed at %lld, treating it as lost\n", chunkName(&set->cfg, chunk), (long long)pos);
+    set->lost |= CHUNK_BIT(chunk);
+    return ERROR;
+}
+
+// Write len bytes of buf into the data of stripe stripeIdx, from byte start of the
+// stripe, and update the stripe's parity. The work is done on the same sector-aligned
+// window of every unit, and costs the fewer reads of:
+//
+// read-modify-write: read the old window of the units written and of the parity, then
+//   add the parity of the change, new data ^ old data, to the old parity. The codes are
+//   linear, so encoding the change with the other data units zero gives that parity.
+// reconstruct-write: read the window of the data units the write leaves partly or wholly
+//   as it was, rebuilding lost ones, and encode the parity afresh. A write that covers
+//   the whole window of every data unit, such as a full stripe, reads nothing.
+//
+// Lost chunks are never written; the parity written for them still rebuilds them.
+//
+// The checksum of a unit written whole is computed afresh. That of a unit written in
+// part is patched with the change to its window, so a reconstruct-write keeping
+// checksums also reads the old window of the units it writes.
+static int setWriteStripe(raidset_t *set, off_t stripeIdx, size_t start, size_t len, const unsigned char *buf)
+{
+    raidcfg_t *cfg = &set->cfg, window;
+    size_t unit = unitBytes(cfg), lo, hi, from, to;
+    int nchunks = chunkCount(cfg), shift = stripeShift(cfg, stripeIdx);
+    int first = start / unit, last = (start + len - 1) / unit;
+    uint64_t want = (CHUNK_BIT(last + 1) - 1) & ~(CHUNK_BIT(first) - 1);
+    uint64_t parity = (CHUNK_BIT(nchunks) - 1) & ~dataMask(cfg), covered = 0, need, lostUnits, readMask;
+    int ndata = dataCount(cfg), idx, rc;
+    unsigned char *units[MAX_CHUNKS + 1], *delta[MAX_CHUNKS + 1], *pair[2];
+    off_t base = dataOffset(cfg) + stripeIdx * unit;
+    uint32_t *sum;
+    int rmw, keep = FALSE, chunk;
+
+    unitWindow(cfg, start, len, &lo, &hi);
+    window = *cfg;
+    window.unitSize = hi - lo;
+    stripeUnits(&window, set->stripe, units);
+    stripeUnits(&window, set->delta, delta);
+
+    for(idx = first; idx <= last; idx++)
+    {
+        unitSpan(unit, idx, start, len, &from, &to);
+        if((from <= lo) && (to >= hi))
+            covered |= CHUNK_BIT(idx);
+    }
+    need = dataMask(cfg) & ~covered;
+
+    for(idx = 0; (idx < nchunks) && (hi - lo < unit); idx++)
+        if(set->sums.map[idx] != NULL)
+            keep = TRUE;
+
+    // A read that fails adds its chunk to the lost ones and the stripe is planned again
+    do
+    {
+        rc = OK;
+        lostUnits = chunksToUnits(set->lost, shift, nchunks);
+        rmw = ((lostUnits & (want | parity)) == 0) &&
+              (__builtin_popcountll(want | parity) < __builtin_popcountll(need));
+
+        if(rmw)
+            readMask = want | parity;
+        else if(planRead(cfg, need, lostUnits, &readMask) != OK)
+        {
+            printf("raidPwrite: cannot rebuild %d lost chunks\n", __builtin_popcountll(set->lost));
+            return ERROR;
+        }
+        if(keep)
+            readMask |= (want | parity) & ~lostUnits;
+
+        for(idx = 0; (idx < nchunks) && (rc == OK); idx++)
+            if(readMask & CHUNK_BIT(idx))
+                rc = setRead(set, (idx + shift) % nchunks, units[idx], hi - lo, base + lo);
+    }
+    while(rc != OK);
+
+    if(!rmw && (rebuildStripe(&window, units, readMask, need) != OK))
+        return ERROR;
+
+    // Lay the new data over the old, keeping the old in the delta units for a read-modify-write
+    // or for patching checksums
+    for(idx = 0; (idx < nchunks) && keep && !rmw; idx++)
+        if(((want | parity) & ~lostUnits) & CHUNK_BIT(idx))
+            memcpy(delta[idx], units[idx], hi - lo);
+
+    for(idx = 0; idx < ndata; idx++)
+    {
+        if(rmw)
         {
-            rebuildLBA(PTR_CAST &stripe[0],
-                       PTR_CAST &stripe[512],
-                       PTR_CAST &stripe[1024],
-                       PTR_CAST &stripe[2048],
-                       PTR_CAST &stripe[1536]);
+            if(want & CHUNK_BIT(idx))
+                memcpy(delta[idx], units[idx], hi - lo);
+            else
+                bzero(delta[idx], hi - lo);
         }
 
-        if(missingChunk == 5)
+        if(want & CHUNK_BIT(idx))
         {
-            rebuildLBA(PTR_CAST &stripe[0],
-                       PTR_CAST &stripe[512],
-                       PTR_CAST &stripe[1024],
-                       PTR_CAST &stripe[1536],
-                       PTR_CAST &stripe[2048]);
+            unitSpan(unit, idx, start, len, &from, &to);
+            memcpy(units[idx] + from - lo, &buf[idx * unit + from - start], to - from);
         }
+    }
 
-        // Write the last partial stripe to the output file
-        offset = 0, bwritten = 0, btowrite = (lastStripeBytes);
+    if(rmw)
+    {
+        for(idx = first; idx <= last; idx++)
+        {
+            pair[0] = delta[idx];
+            pair[1] = units[idx];
+            xorBlocks(pair, 2, delta[idx], hi - lo);
+        }
+        encodeStripe(&window, delta);
 
-        do
+        for(idx = ndata; idx < nchunks; idx++)
+        {
+            pair[0] = units[idx];
+            pair[1] = delta[idx];
+            xorBlocks(pair, 2, units[idx], hi - lo);
+        }
+    }
+    else
+    {
+        encodeStripe(&window, units);
+
+        for(idx = 0; (idx < nchunks) && keep; idx++)
+        {
+            if(((want | parity) & ~lostUnits) & CHUNK_BIT(idx))
+            {
+                pair[0] = delta[idx];
+                pair[1] = units[idx];
+                xorBlocks(pair, 2, delta[idx], hi - lo);
+            }
+        }
+    }
+
+    for(idx = 0; (idx < nchunks) && (rc == OK); idx++)
+    {
+        if(!(((want | parity) & ~lostUnits) & CHUNK_BIT(idx)))
+            continue;
+
+        chunk = (idx + shift) % nchunks;
+        if(((rc = setWrite(set, chunk, units[idx], hi - lo, base + lo)) != OK) || (set->sums.map[chunk] == NULL))
+            continue;
+
+        sum = &set->sums.map[chunk][stripeIdx];
+        if(hi - lo == unit)
+            *sum = crc32c(0, units[idx], unit);
+        else
+            *sum = crc32cPatch(*sum, unit, lo, delta[idx], hi - lo);
+    }
+
+    return rc;
+}
+
+// Write-back cache
+//
+// With cfg.cacheStripes set, raidPwrite lays its data into cached stripes instead of
+// writing the chunks. A stripe whose every sector is dirty is flushed at once as a full
+// stripe, with no reads. The others are flushed, one setWriteStripe per run of dirty
+// sectors, when their entry is wanted for another stripe (the oldest goes first), when
+// they have been dirty for the cache age, and on raidFlush and raidClose. Small writes
+// next to each other so merge into full stripes or long runs before parity is touched.
+
+static size_t cacheSectors(raidset_t *set)
+{
+    return dataCount(&set->cfg) * unitBytes(&set->cfg) / sectorBytes(&set->cfg);
+}
+
+static int cacheAge(raidset_t *set)
+{
+    return ((set->cfg.cacheAgeMs > 0) ? set->cfg.cacheAgeMs : RAID_CACHE_AGE_MS);
+}
+
+static cachestripe_t *cacheLookup(raidset_t *set, off_t stripeIdx)
+{
+    int idx;
+
+    for(idx = 0; idx < set->cfg.cacheStripes; idx++)
+        if(set->cache[idx].stripeIdx == stripeIdx)
+            return &set->cache[idx];
+
+    return NULL;
+}
+
+// A cached stripe is full when every sector inside the file is dirty; the sectors past
+// the end of the file hold zeros
+static int cacheFull(raidset_t *set, cachestripe_t *entry)
+{
+    size_t sector = sectorBytes(&set->cfg), sectors = cacheSectors(set);
+    off_t inFile = set->fileLength - entry->stripeIdx * (off_t)(sectors * sector);
+
+    if(inFile < (off_t)(sectors * sector))
+        sectors = (inFile + sector - 1) / sector;
+
+    return ((size_t)entry->dirtyCnt == sectors);
+}
+
+// Write the dirty sectors of a cached stripe to the chunks and free its entry
+static int cacheFlushStripe(raidset_t *set, cachestripe_t *entry)
+{
+    size_t sector = sectorBytes(&set->cfg), sectors = cacheSectors(set), first = 0, next;
+    int rc = OK;
+
+    if(cacheFull(set, entry))
+        rc = setWriteStripe(set, entry->stripeIdx, 0, sectors * sector, entry->data);
+    else
+    {
+        while((first < sectors) && (rc == OK))
+        {
+            if(!entry->dirty[first])
+            {
+                first++;
+                continue;
+            }
+
+            next = first + 1;
+            while((next < sectors) && entry->dirty[next])
+                next++;
+
+            rc = setWriteStripe(set, entry->stripeIdx, first * sector, (next - first) * sector,
+                                &entry->data[first * sector]);
+            first = next;
+        }
+    }
+
+    bzero(entry->dirty, sectors);
+    entry->dirtyCnt = 0;
+    entry->stripeIdx = -1;
+    return rc;
+}
+
+// Flush every cached stripe that has been dirty for at least ageMs
+static int cacheFlushAll(raidset_t *set, int ageMs)
+{
+    int idx, rc = OK;
+
+    for(idx = 0; idx < set->cfg.cacheStripes; idx++)
+        if((set->cache[idx].stripeIdx >= 0) && (elapsedMs(&set->cache[idx].since) >= ageMs) &&
+           (cacheFlushStripe(set, &set->cache[idx]) != OK))
+            rc = ERROR;
+
+    return rc;
+}
+
+// Drop every cached stripe without writing it, for contents that are being replaced
+static void cacheDiscard(raidset_t *set)
+{
+    int idx;
+
+    for(idx = 0; idx < set->cfg.cacheStripes; idx++)
+    {
+        bzero(set->cache[idx].dirty, cacheSectors(set));
+        set->cache[idx].dirtyCnt = 0;
+        set->cache[idx].stripeIdx = -1;
+    }
+}
+
+// The entry for stripe stripeIdx: the cached one, a free one, or the oldest after
+// flushing it
+static cachestripe_t *cacheEntry(raidset_t *set, off_t stripeIdx)
+{
+    cachestripe_t *entry = cacheLookup(set, stripeIdx), *oldest = NULL;
+    int idx;
+
+    if(entry != NULL)
+        return entry;
+
+    for(idx = 0; idx < set->cfg.cacheStripes; idx++)
+    {
+        entry = &set->cache[idx];
+        if(entry->stripeIdx < 0)
+            break;
+        if((oldest == NULL) || (elapsedMs(&entry->since) > elapsedMs(&oldest->since)))
+            oldest = entry;
+    }
+
+    if(idx == set->cfg.cacheStripes)
+    {
+        entry = oldest;
+        if(cacheFlushStripe(set, entry) != OK)
+            return NULL;
+    }
+
+    entry->stripeIdx = stripeIdx;
+    bzero(entry->data, cacheSectors(set) * sectorBytes(&set->cfg));
+    clock_gettime(CLOCK_MONOTONIC, &entry->since);
+    return entry;
+}
+
+// Lay len bytes of buf into the cached copy of stripe stripeIdx, from byte start of the stripe
+static int cacheWrite(raidset_t *set, off_t stripeIdx, size_t start, size_t len, const unsigned char *buf)
+{
+    size_t sector = sectorBytes(&set->cfg), first = start / sector, last = (start + len - 1) / sector, idx;
+    off_t inFile = set->fileLength - stripeIdx * (off_t)(cacheSectors(set) * sector);
+    int headPart = ((start % sector) != 0);
+    int tailPart = (((start + len) % sector) != 0) && ((off_t)(start + len) < inFile);
+    cachestripe_t *entry;
+    int rc = OK;
+
+    if((entry = cacheEntry(set, stripeIdx)) == NULL)
+        return ERROR;
+
+    // Sectors the write covers only part of are read first, up to the end of the file
+    if(headPart && !entry->dirty[first])
+        rc = setReadStripe(set, stripeIdx, first * sector, ((inFile - first * sector) < (off_t)sector) ?
+                           (size_t)(inFile - first * sector) : sector, &entry->data[first * sector]);
+    if((rc == OK) && tailPart && !entry->dirty[last] && !(headPart && (last == first)))
+        rc = setReadStripe(set, stripeIdx, last * sector, ((inFile - last * sector) < (off_t)sector) ?
+                           (size_t)(inFile - last * sector) : sector, &entry->data[last * sector]);
+    if(rc != OK)
+    {
+        if(entry->dirtyCnt == 0)
+            entry->stripeIdx = -1;
+        return ERROR;
+    }
+
+    memcpy(&entry->data[start], buf, len);
+    for(idx = first; idx <= last; idx++)
+    {
+        if(!entry->dirty[idx])
+        {
+            entry->dirty[idx] = TRUE;
+            entry->dirtyCnt++;
+        }
+    }
+
+    // A full stripe goes straight out
+    if(cacheFull(set, entry))
+        rc = cacheFlushStripe(set, entry);
+
+    return rc;
+}
+
+// Lay the dirty cached sectors of stripe stripeIdx over len bytes of it, from byte start,
+// read from the chunks
+static void cacheOverlay(raidset_t *set, off_t stripeIdx, size_t start, size_t len, unsigned char *buf)
+{
+    size_t sector = sectorBytes(&set->cfg), idx, from, to;
+    cachestripe_t *entry = cacheLookup(set, stripeIdx);
+
+    if(entry == NULL)
+        return;
+
+    for(idx = start / sector; idx * sector < start + len; idx++)
+    {
+        if(!entry->dirty[idx])
+            continue;
+
+        from = (idx * sector > start) ? idx * sector : start;
+        to = ((idx + 1) * sector < start + len) ? (idx + 1) * sector : start + len;
+        memcpy(&buf[from - start], &entry->data[from], to - from);
+    }
+}
+
+// Background flusher: wakes every half cache age and flushes the stripes that are due
+static void *cacheFlusher(void *arg)
+{
+    raidset_t *set = (raidset_t *)arg;
+    struct timespec wakeAt;
+
+    pthread_mutex_lock(&set->lock);
+    while(!set->stopping)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &wakeAt);
+        wakeAt.tv_sec += (cacheAge(set) / 2) / 1000;
+        wakeAt.tv_nsec += ((cacheAge(set) / 2) % 1000) * 1000000L;
+        if(wakeAt.tv_nsec >= 1000000000L)
+        {
+            wakeAt.tv_sec++;
+            wakeAt.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&set->wake, &set->lock, &wakeAt);
+
+        if(!set->stopping && (cacheFlushAll(set, cacheAge(set)) != OK))
+            set->flushRc = ERROR;
+    }
+    pthread_mutex_unlock(&set->lock);
+
+    return NULL;
+}
+
+static void cacheFree(raidset_t *set)
+{
+    int idx;
+
+    for(idx = 0; idx < set->cfg.cacheStripes; idx++)
+    {
+        free(set->cache[idx].data);
+        free(set->cache[idx].dirty);
+    }
+    free(set->cache);
+    set->cache = NULL;
+}
+
+// Allocate the cache entries and start the flusher
+static int cacheInit(raidset_t *set)
+{
+    size_t bytes = cacheSectors(set) * sectorBytes(&set->cfg);
+    pthread_condattr_t attr;
+    int idx, rc = OK;
+
+    if((set->cache = calloc(set->cfg.cacheStripes, sizeof(cachestripe_t))) == NULL)
+        return ERROR;
+
+    for(idx = 0; idx < set->cfg.cacheStripes; idx++)
+    {
+        set->cache[idx].stripeIdx = -1;
+        set->cache[idx].data = malloc(bytes);
+        set->cache[idx].dirty = calloc(1, cacheSectors(set));
+        if((set->cache[idx].data == NULL) || (set->cache[idx].dirty == NULL))
+            rc = ERROR;
+    }
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&set->wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if((rc != OK) || (pthread_create(&set->flusher, NULL, cacheFlusher, set) != 0))
+    {
+        printf("raidOpen: cannot set up a %d stripe cache\n", set->cfg.cacheStripes);
+        pthread_cond_destroy(&set->wake);
+        cacheFree(set);
+        return ERROR;
+    }
+
+    return OK;
+}
+
+// Flush the cache and stop the flusher
+static int cacheExit(raidset_t *set)
+{
+    int rc;
+
+    pthread_mutex_lock(&set->lock);
+    rc = cacheFlushAll(set, 0);
+    set->stopping = TRUE;
+    pthread_cond_signal(&set->wake);
+    pthread_mutex_unlock(&set->lock);
+
+    pthread_join(set->flusher, NULL);
+    pthread_cond_destroy(&set->wake);
+    cacheFree(set);
+
+    return (((rc == OK) && (set->flushRc == OK)) ? OK : ERROR);
+}
+
+raidset_t *raidOpen(raidcfg_t *cfg)
+{
+    int idx, nchunks = chunkCount(cfg);
+    uint64_t bad, readMask;
+    off_t stripeCnt;
+    raidset_t *set;
+    raidsb_t sb;
+
+    if(checkConfig(cfg) != OK)
+        return NULL;
+
+    if(checkChunkSet(cfg, CHUNK_BIT(nchunks) - 1, &bad, &sb) != OK)
+    {
+        printf("raidOpen: no usable chunks\n");
+        return NULL;
+    }
+
+    // The data of every placement has to be readable with the lost chunks gone
+    for(idx = 0; idx < layoutPeriod(cfg); idx++)
+    {
+        if(planRead(cfg, dataMask(cfg), chunksToUnits(bad, stripeShift(cfg, idx), nchunks), &readMask) != OK)
+        {
+            printf("raidOpen: cannot rebuild %d lost chunks\n", __builtin_popcountll(bad));
+            return NULL;
+        }
+    }
+
+    if((set = calloc(1, sizeof(*set))) == NULL)
+        return NULL;
+
+    set->cfg = *cfg;
+    set->lost = bad;
+    set->fileLength = sb.fileLength;
+    set->generation = sb.generation;
+    sumsInit(&set->sums);
+    pthread_mutex_init(&set->lock, NULL);
+
+    // Chunks on read-only media still serve reads
+    for(idx = 0; idx < MAX_CHUNKS; idx++)
+        set->fd[idx] = -1;
+    for(idx = 0; idx < nchunks; idx++)
+    {
+        if(bad & CHUNK_BIT(idx))
+            continue;
+
+        if((set->fd[idx] = open(chunkName(cfg, idx), set->readOnly ? O_RDONLY : O_RDWR)) < 0)
+        {
+            if(!set->readOnly && ((errno == EACCES) || (errno == EROFS)))
+            {
+                set->readOnly = TRUE;
+                while(--idx >= 0)
+                {
+                    if(set->fd[idx] >= 0) close(set->fd[idx]);
+                    set->fd[idx] = -1;
+                }
+                continue;
+            }
+
+            perror(chunkName(cfg, idx));
+            raidClose(set);
+            return NULL;
+        }
+    }
+
+    stripeCnt = (sb.fileLength + dataCount(cfg) * unitBytes(cfg) - 1) / (dataCount(cfg) * unitBytes(cfg));
+    if((mapSums(cfg, &set->sums, (CHUNK_BIT(nchunks) - 1) & ~bad, stripeCnt, set->readOnly ? SUMS_READ : SUMS_UPDATE) != OK) ||
+       ((set->stripe = allocStripe(cfg)) == NULL) || ((set->delta = allocStripe(cfg)) == NULL) ||
+       ((cfg->cacheStripes > 0) && !set->readOnly && (cacheInit(set) != OK)))
+    {
+        raidClose(set);
+        return NULL;
+    }
+
+    return set;
+}
+
+raidset_t *raidCreate(raidcfg_t *cfg)
+{
+    int fd[MAX_CHUNKS], idx, nchunks = chunkCount(cfg), rc;
+    uint64_t generation;
+    unitsums_t sums;
+
+    if(checkConfig(cfg) != OK)
+        return NULL;
+
+    // An empty set: superblocks only, and empty sidecars
+    if(openChunksForWrite(cfg, fd, &generation) != OK)
+        return NULL;
+    sumsInit(&sums);
+    rc = mapSums(cfg, &sums, CHUNK_BIT(nchunks) - 1, 0, SUMS_CREATE);
+    unmapSums(&sums);
+    if(rc == OK)
+        rc = writeSuperblocks(cfg, fd, CHUNK_BIT(nchunks) - 1, 0, generation);
+    for(idx = 0; idx < nchunks; idx++) close(fd[idx]);
+
+    return ((rc == OK) ? raidOpen(cfg) : NULL);
+}
+
+int raidClose(raidset_t *set)
+{
+    int idx, rc = OK;
+
+    if(set == NULL)
+        return OK;
+
+    if(set->cache != NULL)
+        rc = cacheExit(set);
+
+    for(idx = 0; idx < MAX_CHUNKS; idx++)
+        if(set->fd[idx] >= 0) close(set->fd[idx]);
+    unmapSums(&set->sums);
+
+    pthread_mutex_destroy(&set->lock);
+    free(set->stripe);
+    free(set->delta);
+    free(set);
+
+    return rc;
+}
+
+off_t raidLength(raidset_t *set)
+{
+    return set->fileLength;
+}
+
+ssize_t raidPread(raidset_t *set, off_t offset, size_t len, unsigned char *buf)
+{
+    off_t stripeBytes = dataCount(&set->cfg) * unitBytes(&set->cfg), pos, stripeIdx;
+    size_t done = 0, cnt;
+    int rc = OK;
+
+    if(offset < 0)
+        return ERROR;
+    if(offset >= set->fileLength)
+        return 0;
+    if(len > (size_t)(set->fileLength - offset))
+        len = set->fileLength - offset;
+
+    pthread_mutex_lock(&set->lock);
+    while((done < len) && (rc == OK))
+    {
+        pos = offset + done;
+        stripeIdx = pos / stripeBytes;
+        cnt = (size_t)((stripeIdx + 1) * stripeBytes - pos);
+        if(cnt > len - done)
+            cnt = len - done;
+
+        rc = setReadStripe(set, stripeIdx, pos - stripeIdx * stripeBytes, cnt, &buf[done]);
+        if((rc == OK) && (set->cache != NULL))
+            cacheOverlay(set, stripeIdx, pos - stripeIdx * stripeBytes, cnt, &buf[done]);
+        done += cnt;
+    }
+    pthread_mutex_unlock(&set->lock);
+
+    return ((rc == OK) ? (ssize_t)done : ERROR);
+}
+
+ssize_t raidPwrite(raidset_t *set, off_t offset, size_t len, const unsigned char *buf)
+{
+    off_t stripeBytes = dataCount(&set->cfg) * unitBytes(&set->cfg), pos, stripeIdx;
+    size_t done = 0, cnt;
+    int rc = OK;
+
+    if((offset < 0) || set->readOnly)
+        return ERROR;
+    if(offset >= set->fileLength)
+        return 0;
+    if(len > (size_t)(set->fileLength - offset))
+        len = set->fileLength - offset;
+
+    pthread_mutex_lock(&set->lock);
+    while((done < len) && (rc == OK))
+    {
+        pos = offset + done;
+        stripeIdx = pos / stripeBytes;
+        cnt = (size_t)((stripeIdx + 1) * stripeBytes - pos);
+        if(cnt > len - done)
+            cnt = len - done;
+
+        if(set->cache != NULL)
+            rc = cacheWrite(set, stripeIdx, pos - stripeIdx * stripeBytes, cnt, &buf[done]);
+        else
+            rc = setWriteStripe(set, stripeIdx, pos - stripeIdx * stripeBytes, cnt, &buf[done]);
+        done += cnt;
+    }
+    pthread_mutex_unlock(&set->lock);
+
+    return ((rc == OK) ? (ssize_t)done : ERROR);
+}
+
+// Size the sidecars of every chunk of the set for stripeCnt stripes, creating the
+// missing ones
+static int resizeSums(raidset_t *set, off_t stripeCnt)
+{
+    char name[PATH_MAX];
+    int idx;
+
+    for(idx = 0; idx < chunkCount(&set->cfg); idx++)
+    {
+        snprintf(name, sizeof(name), "%s.crc", chunkName(&set->cfg, idx));
+        if(((set->sums.fd[idx] < 0) && ((set->sums.fd[idx] = open(name, O_RDWR | O_CREAT, 00644)) < 0)) ||
+           (sizeSums(&set->sums, idx, (size_t)stripeCnt * sizeof(uint32_t)) != OK))
+        {
+            perror(name);
+            return ERROR;
+        }
+    }
+
+    return OK;
+}
+
+ssize_t raidStripe(raidset_t *set, const unsigned char *buf, size_t len)
+{
+    raidcfg_t *cfg = &set->cfg;
+    int idx, nchunks = chunkCount(cfg), rc = OK;
+    size_t stripeBytes = dataCount(cfg) * unitBytes(cfg), done, cnt;
+    off_t stripeCnt = (len + stripeBytes - 1) / stripeBytes, stripeIdx;
+    unsigned char *units[MAX_CHUNKS + 1];
+
+    if(set->readOnly)
+        return ERROR;
+
+    pthread_mutex_lock(&set->lock);
+
+    // The new contents replace whatever the cache holds
+    if(set->cache != NULL)
+        cacheDiscard(set);
+
+    // Every chunk is written afresh: lost ones are recreated, and the old superblocks and
+    // stripes, including any past the new end, are dropped first
+    for(idx = 0; (idx < nchunks) && (rc == OK); idx++)
+    {
+        if(((set->fd[idx] < 0) && ((set->fd[idx] = open(chunkName(cfg, idx), O_RDWR | O_CREAT, 00644)) < 0)) ||
+           (ftruncate(set->fd[idx], 0) != 0))
         {
-            bwritten = fwrite(&stripe[offset], 1, btowrite, fdout); 
-            offset += bwritten;
-            btowrite = lastStripeBytes - bwritten;
+            perror(chunkName(cfg, idx));
+            rc = ERROR;
         }
-        while ((btowrite > 0));
+    }
+    if(rc == OK)
+        rc = resizeSums(set, stripeCnt);
+
+    stripeUnits(cfg, set->stripe, units);
+    for(stripeIdx = 0, done = 0; (stripeIdx < stripeCnt) && (rc == OK); stripeIdx++, done += cnt)
+    {
+        cnt = ((len - done) < stripeBytes) ? len - done : stripeBytes;
+        memcpy(set->stripe, &buf[done], cnt);
+        if(cnt < stripeBytes)
+            bzero(&set->stripe[cnt], stripeBytes - cnt);
+
+        encodeStripe(cfg, units);
+        storeSums(cfg, &set->sums, units, stripeIdx, CHUNK_BIT(nchunks) - 1);
+        rc = writeStripe(cfg, set->fd, stripeIdx, CHUNK_BIT(nchunks) - 1, set->stripe, NULL);
+    }
+
+    // The superblocks go last, once every unit is in place
+    if(rc == OK)
+        rc = writeSuperblocks(cfg, set->fd, CHUNK_BIT(nchunks) - 1, len, set->generation + 1);
+
+    if(rc == OK)
+    {
+        set->generation++;
+        set->fileLength = len;
+        set->lost = 0;
+    }
+    else
+        set->fileLength = 0;
+    pthread_mutex_unlock(&set->lock);
+
+    return ((rc == OK) ? (ssize_t)len : ERROR);
+}
+
+off_t raidScrubSet(raidset_t *set, raidmismatch_t mismatch, void *arg)
+{
+    off_t rc = OK;
+
+    pthread_mutex_lock(&set->lock);
+    if(set->lost != 0)
+    {
+        printf("raidScrubSet: chunks are lost, rebuild them first\n");
+        rc = ERROR;
+    }
+
+    // Cached writes are checked too
+    if((rc == OK) && (set->cache != NULL))
+        rc = cacheFlushAll(set, 0);
+    if(rc == OK)
+        rc = scrubChunks(&set->cfg, set->fd, &set->sums, set->fileLength, mismatch, arg);
+    pthread_mutex_unlock(&set->lock);
+
+    return rc;
+}
+
+int raidFlush(raidset_t *set)
+{
+    int idx, rc = OK;
+
+    pthread_mutex_lock(&set->lock);
+    if(set->cache != NULL)
+    {
+        rc = cacheFlushAll(set, 0);
+
+        // Report a failed background flush once
+        if(set->flushRc != OK)
+            rc = ERROR;
+        set->flushRc = OK;
     }
 
-    // Close the output file and all chunk files
-    fclose(fdout);
-    for(idx = 0; idx < 5; idx++) close(fd[idx]);
+    for(idx = 0; idx < MAX_CHUNKS; idx++)
+    {
+        if((set->fd[idx] >= 0) && (fdatasync(set->fd[idx]) != 0))
+        {
+            perror(chunkName(&set->cfg, idx));
+            rc = ERROR;
+        }
+    }
+    if(syncSums(&set->sums, CHUNK_BIT(chunkCount(&set->cfg)) - 1) != OK)
+    {
+        perror("raidFlush: checksums");
+        rc = ERROR;
+    }
+    pthread_mutex_unlock(&set->lock);
 
-    return(fileLength); // Return the total file length restored
+    return rc;
 }
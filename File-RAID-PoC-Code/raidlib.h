@@ -1,8 +1,13 @@
 #ifndef RAIDLIB_H
 #define RAIDLIB_H
 
+#include <stdint.h>
 #include <unistd.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define OK (0)
 #define ERROR (-1)
 #define TRUE (1)
@@ -10,6 +15,8 @@
 
 #define SECTOR_SIZE (512)
 
+// Byte-wide LBA API, replaced by the word-wide API in raidlib64.h for RAID64 builds
+#ifndef RAID64
 void xorLBA(unsigned char *LBA1,
 	    unsigned char *LBA2,
 	    unsigned char *LBA3,
@@ -25,8 +32,283 @@ void rebuildLBA(unsigned char *LBA1,
 
 int checkEquivLBA(unsigned char *LBA1,
 		  unsigned char *LBA2);
+#endif
+
+// N-way XOR parity over arbitrary-length regions
+//
+// xorBlocks computes dst = src[0] ^ ... ^ src[nsrc-1] over len bytes in one call, so an
+// 8+1 or 12+1 layout costs one pass over memory instead of one call per sector.
+// rebuildBlocks recovers a lost unit from the surviving data units and the parity unit.
+// dst may alias src[0]. equalBlocks returns TRUE if a and b hold the same len bytes.
+// All use the runtime-dispatched kernels in raidsimd.c.
+void xorBlocks(unsigned char *const *src, int nsrc, unsigned char *dst, size_t len);
+void rebuildBlocks(unsigned char *const *survivors, int nsurvivors, unsigned char *parity,
+                   unsigned char *rebuilt, size_t len);
+int equalBlocks(const unsigned char *a, const unsigned char *b, size_t len);
+
+// Stripe layout: cfg->dataChunks data units per stripe, DATA_CHUNKS by default, followed
+// by one parity unit per parity chunk
+#define DATA_CHUNKS (4)
+#define RAID_MAX_DATA (32)
+#define MAX_CHUNKS (RAID_MAX_DATA + 3)
+#define STRIPE_DATA_BYTES (DATA_CHUNKS * SECTOR_SIZE) // with the default one-sector stripe unit
+
+// Parity codes
+#define RAID_CODE_XOR (0) // RAID-5: XOR parity chunk, survives any one lost chunk
+#define RAID_CODE_PQ  (1) // RAID-6: XOR (P) plus Reed-Solomon (Q) chunk, survives any two
+#define RAID_CODE_LRC (2) // Locally repairable: XOR per local group (L1, L2) plus global Q
+
+// LRC local groups: the first half of the data chunks -> L1 and the rest -> L2, so
+// {D1,D2} -> L1 and {D3,D4} -> L2 with four. A single lost chunk is rebuilt from its own
+// group, half the reads of RAID-5; Q covers any two lost chunks.
+#define LRC_GROUPS (2)
+
+// Parity placement
+#define RAID_LAYOUT_FIXED    (0) // Parity always in its own chunk files (RAID-4 style)
+#define RAID_LAYOUT_ROTATING (1) // Left-symmetric: parity moves back one chunk every stripe
+
+// Parallel mode: stripe-aligned ranges of the file are handled by worker threads
+#define RAID_THREADS_AUTO (-1)
+#define RAID_MAX_THREADS (64)
+
+// I/O engines. RAID_IO_URING keeps queueDepth reads and writes in flight across the
+// chunk files while parity is computed, and falls back to RAID_IO_SYNC when the kernel
+// does not offer io_uring. RAID_IO_MMAP stripes and restores through mappings of the
+// file and the chunks, for files that fit the address space, and falls back to
+// RAID_IO_SYNC when they cannot be mapped; rebuildChunk uses RAID_IO_SYNC with it.
+#define RAID_IO_SYNC  (0)
+#define RAID_IO_URING (1)
+#define RAID_IO_MMAP  (2)
+#define RAID_URING_DEPTH (32)
+
+// Hedged reads. With cfg->hedgeUs set, a restore on RAID_IO_URING gives a stripe's chunk
+// reads until the deadline; the units still out by then are rebuilt from the ones that
+// are in plus the parity they need, read at once, and the slow reads are cancelled, or
+// finish into a buffer that is set aside until they do. One slow device then costs a
+// parity read instead of its latency. A stripe whose slow units cannot be rebuilt (too
+// many lost already) waits for them as usual.
+
+// File bytes rebuildChunk rebuilds between checkpoints
+#define RAID_REBUILD_BATCH (16 * 1024 * 1024)
+
+// File bytes stripeStream and restoreStream hold in memory at a time
+#define RAID_STREAM_BATCH (16 * 1024 * 1024)
+
+// Default age at which the raidPwrite cache flushes a dirty stripe
+#define RAID_CACHE_AGE_MS (1000)
+
+// Largest stripe unit; a stripe buffer holds a unit per chunk plus one
+#define RAID_MAX_UNIT (16 * 1024 * 1024)
+
+// Progress callback: done of total bytes are finished. Striping, restore and rebuildChunk
+// count file bytes, a resumed rebuild starting from its checkpoint; total is 0 when not
+// known. It runs about every RAID_PROGRESS_STEP bytes and once at the end, and with
+// threads it runs on the worker threads, one call at a time.
+typedef void (*raidprogress_t)(void *arg, off_t done, off_t total);
+#define RAID_PROGRESS_STEP (64 * 1024 * 1024)
+
+typedef struct raid_config
+{
+    int code;        // RAID_CODE_XOR, RAID_CODE_PQ or RAID_CODE_LRC
+    int layout;      // RAID_LAYOUT_FIXED or RAID_LAYOUT_ROTATING
+    int sectorSize;  // Bytes per sector, a power of two >= SECTOR_SIZE; 0 for SECTOR_SIZE
+    int unitSize;    // Bytes each chunk holds per stripe, a multiple of sectorSize; 0 for one sector
+    int threads;     // Worker threads for stripe, restore and rebuild: 0 or 1 to run
+                     // sequentially, RAID_THREADS_AUTO for one per online CPU
+    int ioEngine;    // RAID_IO_SYNC, RAID_IO_URING or RAID_IO_MMAP
+    int queueDepth;  // io_uring I/Os in flight per worker; 0 for RAID_URING_DEPTH
+    int hedgeUs;     // Restore with RAID_IO_URING: rebuild a unit from parity when its read is
+                     // still out this many microseconds after the stripe's reads went out; 0 for off
+    raidprogress_t progress; // Called as the work proceeds, or NULL
+    void *progressArg;
+    int cacheStripes; // Stripes raidPwrite may hold in its write-back cache; 0 to write through
+    int cacheAgeMs;   // Cached writes reach the chunks within this; 0 for RAID_CACHE_AGE_MS
+    int rebuildRate;  // rebuildChunk cap in MB/s of file data rebuilt; 0 for none
+    int scrubRate;    // raidScrub cap in MB/s of chunk data read; 0 for none
+    int dataChunks;   // Data chunks per stripe, 2 to RAID_MAX_DATA; 0 for DATA_CHUNKS
+    char **chunkPath; // File of each chunk in chunk order, see raidChunkName; NULL for the
+                      // default names in the current directory
+    char *sparePath;  // Hot spare file a chunk whose writes fail while striping moves to; NULL for none.
+                      // Not with RAID_IO_MMAP until a chunk has moved there
+    int spareChunk;   // 1-based chunk that lives on sparePath, set by striping when it fails
+                      // over; 0 while the spare is not in use
+} raidcfg_t;
 
-int stripeFile(char *inputFileName, int offsetSectors);
-int restoreFile(char *outputFileName, int offsetSectors, int fileLength, int missingChunk);
+// Chunk files
+//
+// A chunk set is raidChunkCount(cfg) files: the data chunks, then the parity chunks of
+// cfg->code. By default they are StripeChunk1.bin ... StripeChunk<n>.bin in the current
+// directory for the data and StripeChunkXOR.bin, StripeChunkQ.bin, or StripeChunkL1.bin,
+// StripeChunkL2.bin and StripeChunkQ.bin for the parity; a rotating layout numbers all of
+// them, as each file holds data and parity in turn. Put each chunk on its own device,
+// through cfg->chunkPath, and striping and restore drive the devices side by side.
+// raidChunkName returns the default name of chunk idx (0-based), for building paths.
+// The checksum sidecar and rebuild checkpoint of a chunk live next to it.
+int raidChunkCount(raidcfg_t *cfg);
+const char *raidChunkName(raidcfg_t *cfg, int idx);
+
+// Failed chunks
+//
+// A write to a chunk that fails while striping takes the chunk offline: its units are
+// no longer written, and the striping goes on with the other chunks as long as they
+// can still rebuild the file data, so one failed device does not stop it. An offline
+// chunk gets no superblock, so a later restore treats it as lost. With cfg->sparePath
+// the chunk moves to the spare once the batch of stripes in flight is done
+// (RAID_REBUILD_BATCH bytes of file data): its later units are written to the spare,
+// and a background thread rebuilds the stripes before into it, at up to
+// cfg->rebuildRate, while the striping goes on. Striping returns once the spare is
+// complete, with cfg->spareChunk set; restores, rebuilds and raidOpen with the same cfg
+// then read the chunk from the spare. The mmap engine cannot see a failed write, so
+// this needs RAID_IO_SYNC or RAID_IO_URING, and a config with a spare to fail over to
+// is rejected with RAID_IO_MMAP.
+
+// Chunk superblock
+//
+// Every chunk file starts with one sector holding this superblock; the chunk's units
+// follow at offset sectorSize. It is written once all of the chunk's units are, so a
+// chunk set whose striping was cut short has no valid superblock. Restore checks the
+// superblocks before reading any data and treats a chunk that is missing, belongs to
+// another geometry or position, or is older than the newest generation in the set as
+// lost. Fields are in host byte order.
+#define RAID_SB_MAGIC   (0x4b4e484344494152ULL) // "RAIDCHNK"
+#define RAID_SB_VERSION (1)
+
+typedef struct raid_superblock
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t sectorSize;   // Sector size, and the offset of the first unit
+    uint64_t fileLength;   // Bytes of the original file
+    uint64_t generation;   // One more than the chunk set it replaced
+    uint32_t unitSize;     // Bytes per chunk per stripe
+    uint16_t dataChunks;
+    uint16_t parityChunks;
+    uint16_t code;         // RAID_CODE_*
+    uint16_t layout;       // RAID_LAYOUT_*
+    uint16_t chunkIndex;   // 0-based position of this chunk in the set
+    uint16_t reserved;
+} raidsb_t;
+
+// Unit checksums
+//
+// Striping writes a sidecar next to each chunk file, <chunk>.crc, with the CRC32C of
+// each of the chunk's stripe units (see raidcrc.h). Restore, rebuildChunk and raidPread
+// check the units they read whole against it, and a unit that fails is rebuilt from the
+// rest of its stripe like a lost one, so silent corruption of a chunk is repaired
+// without naming the chunk. A chunk without a sidecar is not checked.
+
+// Take restoreFileCfg's file length from the chunk superblocks
+#define RAID_LENGTH_FROM_CHUNKS ((off_t)-1)
+
+// File sizes and offsets are off_t (64-bit, see _FILE_OFFSET_BITS in the Makefile), and
+// files of any size are striped and restored in one pass with per-stripe buffers only
+
+// RAID-5 file striping with the default configuration
+off_t stripeFile(char *inputFileName, int offsetSectors);
+off_t restoreFile(char *outputFileName, int offsetSectors, off_t fileLength, int missingChunk);
+
+// File striping with an explicit configuration; RAID_CODE_PQ and RAID_CODE_LRC can
+// restore with any two chunks missing
+off_t stripeFileCfg(char *inputFileName, int offsetSectors, raidcfg_t *cfg);
+off_t restoreFileCfg(char *outputFileName, int offsetSectors, off_t fileLength, raidcfg_t *cfg,
+                     int missingChunk, int missingChunk2);
+
+// Striping from and restoring to a stream, such as a pipe, read or written strictly in
+// order so that it need not be seekable. stripeStream stripes inputFd up to its end and
+// records the length in the superblocks once the stream is over; restoreStream writes
+// the whole file, its length taken from the chunks. The data passes through a window of
+// RAID_STREAM_BATCH bytes, striped or restored on cfg->threads workers with
+// cfg->ioEngine (RAID_IO_MMAP maps nothing and uses pread/pwrite). Both return the
+// bytes of file data, or ERROR. stripeFileCfg stripes an input that is not a regular
+// file this way too.
+off_t stripeStream(int inputFd, raidcfg_t *cfg);
+off_t restoreStream(int outputFd, raidcfg_t *cfg, int missingChunk, int missingChunk2);
+
+// Fill in the code, layout, data chunks, sector size and stripe unit of cfg, and
+// *fileLength, from the superblock of a data chunk of the chunk set in the current
+// directory, or of a chunk in cfg->chunkPath when set, the paths laid out for the
+// geometry cfg holds. Returns OK, or ERROR when no chunk has a valid superblock.
+int raidProbe(raidcfg_t *cfg, off_t *fileLength);
+
+// Rewrite lost chunk files missingChunk and missingChunk2 (1-based, 0 for none) from the
+// surviving chunks, reading only the chunks the code needs. Returns the number of stripes
+// written, or ERROR.
+//
+// The replacements are synced every RAID_REBUILD_BATCH bytes and the progress recorded
+// in a checkpoint file, <first replacement>.rebuild. A rebuild of the same chunks of the
+// same chunk set that finds it carries on from there instead of starting over; the
+// checkpoint is removed when the rebuild completes. cfg->rebuildRate caps the rebuild
+// so that foreground I/O to the surviving chunks keeps its share of the devices.
+off_t rebuildChunk(raidcfg_t *cfg, int missingChunk, int missingChunk2);
+
+// Parity scrub
+//
+// raidScrub reads every unit of every stripe of the chunk set described by cfg,
+// recomputes the parity units from the data units and compares them with the ones on
+// disk. mismatch, if not NULL, is called once for each stripe whose parity does not
+// match, with stripe its 0-based index and chunks, bit i for 1-based chunk i + 1 (the
+// chunk numbers restoreFileCfg takes), the chunks whose units fail their checksums or,
+// when none do, the parity chunks that disagree. Without checksums a stripe whose data
+// chunk is corrupt shows up as all of its parity disagreeing. Stripe ranges are
+// scrubbed on cfg->threads workers with cfg->ioEngine, and cfg->scrubRate caps the
+// reads so that foreground I/O keeps its share of the devices. The callback runs on
+// the workers, one call at a time, in no particular stripe order. Returns the number of
+// stripes that do not match, or ERROR, also when a chunk is missing or stale.
+typedef void (*raidmismatch_t)(void *arg, off_t stripe, uint64_t chunks);
+
+off_t raidScrub(raidcfg_t *cfg, raidmismatch_t mismatch, void *arg);
+
+// Random access to a striped file
+//
+// raidOpen opens the chunk set described by cfg (see raidProbe), whose chunkPath, if
+// set, has to outlive the set. It checks the superblocks, treating chunks that are
+// missing, stale or out of place as lost. raidPread reads len bytes at offset of the
+// original file into buf. It reads only the parts of the stripe units the range covers,
+// and rebuilds the parts of lost units from the same parts of the surviving ones, so a
+// small read from a degraded set costs a few sector reads. A chunk whose read fails is
+// treated as lost from then on. Only units read whole are checked against their
+// checksums. Returns the bytes read, short at the end of the file, or ERROR. Calls on
+// one set are serialized.
+//
+// raidPwrite updates len bytes at offset in place, up to the end of the file, and the
+// parity of the stripes it touches. A partial stripe costs a read-modify-write of the
+// data and parity sectors written (new parity = old parity ^ parity of new ^ old data),
+// or reads the rest of the stripe's data when that is fewer reads; a full stripe is
+// encoded without reads. Lost chunks are left alone and stay rebuildable. As on any
+// RAID-5, a stripe cut short by a crash has stale parity until it is written again.
+// The checksums of the units written are kept up to date, patched with the change for
+// a partial unit; raidFlush syncs them with the chunks.
+// Returns the bytes written or ERROR; ERROR also when the chunks are read-only.
+//
+// With cfg->cacheStripes set, raidPwrite writes back through a cache of that many
+// stripes. Writes are merged per sector; a stripe that fills up is written at once as a
+// full stripe with no reads, and the rest go out after cfg->cacheAgeMs, when their entry
+// is needed for another stripe, or on raidFlush or raidClose. raidPread sees the cached
+// data. raidFlush writes out the cache and syncs the chunk files; it and raidClose
+// return ERROR when any write since the last raidFlush failed.
+//
+// A set stays open across any number of operations, so a service storing many small
+// objects pays for opening and checking the chunks once rather than per call.
+// raidCreate makes the chunk files of an empty set, replacing any set they held, and
+// opens it. raidStripe replaces the contents of the set with len bytes of buf, of any
+// length: every chunk is rewritten, lost ones included, under a new superblock
+// generation, and the chunks are cut to the new length. It returns len, or ERROR after
+// which the set reads as empty until a raidStripe succeeds. raidScrubSet is raidScrub
+// on the open chunks, after writing out the cache, and holds the set for the scrub.
+typedef struct raid_set raidset_t;
+
+raidset_t *raidOpen(raidcfg_t *cfg);
+raidset_t *raidCreate(raidcfg_t *cfg);
+ssize_t raidPread(raidset_t *set, off_t offset, size_t len, unsigned char *buf);
+ssize_t raidPwrite(raidset_t *set, off_t offset, size_t len, const unsigned char *buf);
+ssize_t raidStripe(raidset_t *set, const unsigned char *buf, size_t len);
+off_t raidScrubSet(raidset_t *set, raidmismatch_t mismatch, void *arg);
+int raidFlush(raidset_t *set);
+off_t raidLength(raidset_t *set);
+int raidClose(raidset_t *set);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef RAID64
+#define RAID64
+#endif
+#include "raidlib64.h"
+
+// Word-wide RAID-5 encode and rebuild
+//
+// The pointers are typed as 64-bit words, but callers routinely hand in byte buffers
+// (e.g. the stripe[] array in stripeFile), so alignment is not assumed. When every buffer
+// is 8-byte aligned the loop runs on plain word loads and stores. Otherwise the destination
+// is brought to alignment with a byte head, sources are loaded with memcpy (one unaligned
+// load on targets that allow it), and any remainder is finished with a byte tail.
+
+#define IS_ALIGNED(ptr) ((((uintptr_t)(ptr)) & (WORD_SIZE - 1)) == 0)
+
+static void xorWords(const unsigned char *LBA1,
+                     const unsigned char *LBA2,
+                     const unsigned char *LBA3,
+                     const unsigned char *LBA4,
+                     unsigned char *PLBA,
+                     size_t len)
+{
+    size_t idx = 0;
+    unsigned long long w1, w2, w3, w4;
+
+    if(IS_ALIGNED(LBA1) && IS_ALIGNED(LBA2) && IS_ALIGNED(LBA3) && IS_ALIGNED(LBA4) && IS_ALIGNED(PLBA))
+    {
+        const unsigned long long *W1 = (const unsigned long long *)LBA1;
+        const unsigned long long *W2 = (const unsigned long long *)LBA2;
+        const unsigned long long *W3 = (const unsigned long long *)LBA3;
+        const unsigned long long *W4 = (const unsigned long long *)LBA4;
+        unsigned long long *WP = (unsigned long long *)PLBA;
+        size_t words = len / WORD_SIZE, widx;
+
+        for(widx = 0; widx < words; widx++)
+            WP[widx] = W1[widx] ^ W2[widx] ^ W3[widx] ^ W4[widx];
+
+        idx = words * WORD_SIZE;
+    }
+    else
+    {
+        // Byte head until the destination is word aligned
+        for(; (idx < len) && !IS_ALIGNED(PLBA + idx); idx++)
+            PLBA[idx] = LBA1[idx] ^ LBA2[idx] ^ LBA3[idx] ^ LBA4[idx];
+
+        for(; idx + WORD_SIZE <= len; idx += WORD_SIZE)
+        {
+            memcpy(&w1, LBA1 + idx, WORD_SIZE);
+            memcpy(&w2, LBA2 + idx, WORD_SIZE);
+            memcpy(&w3, LBA3 + idx, WORD_SIZE);
+            memcpy(&w4, LBA4 + idx, WORD_SIZE);
+            w1 ^= w2 ^ w3 ^ w4;
+            memcpy(PLBA + idx, &w1, WORD_SIZE);
+        }
+    }
+
+    // Byte tail for lengths that are not a multiple of the word size
+    for(; idx < len; idx++)
+        PLBA[idx] = LBA1[idx] ^ LBA2[idx] ^ LBA3[idx] ^ LBA4[idx];
+}
+
+// RAID-5 encoding
+//
+// PRECONDITIONS:
+// 1) LBA pointers must have SECTOR_SIZE bytes allocated for them externally.
+// 2) Blocks pointed to by LBAs are initialized with data.
+//
+// POST-CONDITIONS:
+// 1) Contents of PLBA (Parity LBA) are modified and contain the computed parity using XOR.
+void xorLBA(unsigned long long *LBA1,
+            unsigned long long *LBA2,
+            unsigned long long *LBA3,
+            unsigned long long *LBA4,
+            unsigned long long *PLBA)
+{
+    xorWords((unsigned char *)LBA1, (unsigned char *)LBA2, (unsigned char *)LBA3, (unsigned char *)LBA4,
+             (unsigned char *)PLBA, SECTOR_SIZE);
+}
+
+// RAID-5 Rebuild
+//
+// Rebuilt LBA is the XOR of the original parity and the remaining good LBAs.
+void rebuildLBA(unsigned long long *LBA1,
+                unsigned long long *LBA2,
+                unsigned long long *LBA3,
+                unsigned long long *PLBA,
+                unsigned long long *RLBA)
+{
+    xorWords((unsigned char *)LBA1, (unsigned char *)LBA2, (unsigned char *)LBA3, (unsigned char *)PLBA,
+             (unsigned char *)RLBA, SECTOR_SIZE);
+}
+
+// Check if two LBAs are equivalent, comparing a word at a time and
+// narrowing to the first differing byte only on mismatch
+int checkEquivLBA(unsigned long long *LBA1,
+                  unsigned long long *LBA2)
+{
+    unsigned char *B1 = (unsigned char *)LBA1, *B2 = (unsigned char *)LBA2;
+    unsigned long long w1, w2;
+    int idx;
+
+    for(idx = 0; idx < SECTOR_SIZE; idx += WORD_SIZE)
+    {
+        memcpy(&w1, B1 + idx, WORD_SIZE);
+        memcpy(&w2, B2 + idx, WORD_SIZE);
+
+        if(w1 != w2)
+        {
+            while(B1[idx] == B2[idx])
+                idx++;
+
+            printf("EQUIV CHECK MISMATCH @ byte %d: LBA1=0x%x, LBA2=0x%x\n", idx, B1[idx], B2[idx]);
+            return ERROR;
+        }
+    }
+
+    return OK;
+}
@@ -0,0 +1,175 @@
+#ifndef RAIDSET_HPP
+#define RAIDSET_HPP
+
+// C++ wrapper for an open chunk set (raidset_t in raidlib.h)
+//
+// raid::StripeSet owns the set: the chunks are opened and checked once in the
+// constructor and closed in the destructor, and in between any number of stripes,
+// reads, updates and scrubs run against the open chunks. Failures throw
+// std::runtime_error. The wrapper keeps its own copy of the chunk and spare paths, so
+// the configuration passed in need not outlive it. A StripeSet can be moved but not
+// copied.
+// The destructor cannot report a failed write-back; call close() first to see it.
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "raidlib.h"
+
+namespace raid
+{
+
+class StripeSet
+{
+public:
+    // Open the chunk set described by cfg (raidOpen)
+    explicit StripeSet(const raidcfg_t &cfg) : StripeSet(cfg, false) {}
+
+    // Make the chunk files of an empty set and open it (raidCreate)
+    static StripeSet create(const raidcfg_t &cfg)
+    {
+        return StripeSet(cfg, true);
+    }
+
+    StripeSet(StripeSet &&other) noexcept
+        : cfg_(other.cfg_), paths_(std::move(other.paths_)), pathPtrs_(std::move(other.pathPtrs_)), set_(other.set_)
+    {
+        other.set_ = nullptr;
+    }
+
+    StripeSet &operator=(StripeSet &&other) noexcept
+    {
+        if(this != &other)
+        {
+            raidClose(set_);
+            cfg_ = other.cfg_;
+            paths_ = std::move(other.paths_);
+            pathPtrs_ = std::move(other.pathPtrs_);
+            set_ = other.set_;
+            other.set_ = nullptr;
+        }
+        return *this;
+    }
+
+    StripeSet(const StripeSet &) = delete;
+    StripeSet &operator=(const StripeSet &) = delete;
+
+    ~StripeSet()
+    {
+        raidClose(set_);
+    }
+
+    // Write out the cache and close the chunks, reporting a failed write-back
+    void close()
+    {
+        raidset_t *set = set_;
+
+        set_ = nullptr;
+        if(raidClose(set) != OK)
+            throw std::runtime_error("raidClose: a write to the chunk set failed");
+    }
+
+    // Replace the contents of the set with len bytes of buf (raidStripe)
+    void stripe(const void *buf, size_t len)
+    {
+        if(raidStripe(handle(), static_cast<const unsigned char *>(buf), len) < 0)
+            throw std::runtime_error("raidStripe failed");
+    }
+
+    void stripe(const std::vector<unsigned char> &data)
+    {
+        stripe(data.data(), data.size());
+    }
+
+    // Read up to len bytes at offset; returns the bytes read, short at the end
+    size_t read(off_t offset, void *buf, size_t len)
+    {
+        ssize_t bread = raidPread(handle(), offset, len, static_cast<unsigned char *>(buf));
+
+        if(bread < 0)
+            throw std::runtime_error("raidPread failed");
+        return static_cast<size_t>(bread);
+    }
+
+    std::vector<unsigned char> read(off_t offset, size_t len)
+    {
+        std::vector<unsigned char> data(len);
+
+        data.resize(read(offset, data.data(), len));
+        return data;
+    }
+
+    // Update len bytes at offset in place, up to the end of the contents
+    size_t write(off_t offset, const void *buf, size_t len)
+    {
+        ssize_t bwritten = raidPwrite(handle(), offset, len, static_cast<const unsigned char *>(buf));
+
+        if(bwritten < 0)
+            throw std::runtime_error("raidPwrite failed");
+        return static_cast<size_t>(bwritten);
+    }
+
+    // Check the parity of every stripe (raidScrubSet); returns the stripes that do not match
+    off_t scrub(raidmismatch_t mismatch = nullptr, void *arg = nullptr)
+    {
+        off_t stripes = raidScrubSet(handle(), mismatch, arg);
+
+        if(stripes < 0)
+            throw std::runtime_error("raidScrubSet failed");
+        return stripes;
+    }
+
+    void flush()
+    {
+        if(raidFlush(handle()) != OK)
+            throw std::runtime_error("raidFlush: a write to the chunk set failed");
+    }
+
+    off_t length()
+    {
+        return raidLength(handle());
+    }
+
+    // The open set, for the rest of the C API
+    raidset_t *handle()
+    {
+        if(set_ == nullptr)
+            throw std::logic_error("StripeSet is closed");
+        return set_;
+    }
+
+private:
+    StripeSet(const raidcfg_t &cfg, bool create) : cfg_(cfg), set_(nullptr)
+    {
+        int idx;
+
+        // Room for every path up front, so the pointers into them stay put
+        paths_.reserve(MAX_CHUNKS + 1);
+        if(cfg.chunkPath != nullptr)
+        {
+            for(idx = 0; (idx < raidChunkCount(&cfg_)) && (idx < MAX_CHUNKS); idx++)
+                paths_.push_back(cfg.chunkPath[idx]);
+            for(idx = 0; idx < static_cast<int>(paths_.size()); idx++)
+                pathPtrs_.push_back(&paths_[idx][0]);
+            cfg_.chunkPath = pathPtrs_.data();
+        }
+        if(cfg.sparePath != nullptr)
+        {
+            paths_.push_back(cfg.sparePath);
+            cfg_.sparePath = &paths_.back()[0];
+        }
+
+        if((set_ = create ? raidCreate(&cfg_) : raidOpen(&cfg_)) == nullptr)
+            throw std::runtime_error(create ? "raidCreate failed" : "raidOpen failed");
+    }
+
+    raidcfg_t cfg_;
+    std::vector<std::string> paths_;  // The set's copy of cfg.chunkPath, then cfg.sparePath
+    std::vector<char *> pathPtrs_;
+    raidset_t *set_;
+};
+
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef RAIDSIMD_H
+#define RAIDSIMD_H
+
+#include <stddef.h>
+
+// XOR parity kernel
+//
+// Computes PLBA = LBA1 ^ LBA2 ^ LBA3 ^ LBA4 over len bytes. Rebuild is the same
+// operation with the parity LBA passed as one of the four inputs.
+//
+// Buffers need not be aligned, and len need not be a multiple of the vector width.
+typedef void (*xorKernel_t)(const unsigned char *LBA1,
+                            const unsigned char *LBA2,
+                            const unsigned char *LBA3,
+                            const unsigned char *LBA4,
+                            unsigned char *PLBA,
+                            size_t len);
+
+// N-way XOR kernel
+//
+// Computes dst = src[0] ^ ... ^ src[nsrc-1] over len bytes, or dst ^= src[0] ^ ... when
+// accumulate is TRUE. nsrc is at most XOR_GROUP; xorBlocks() splits wider sets into groups
+// and walks the buffers one cache block at a time.
+typedef void (*xorNKernel_t)(const unsigned char *const *src,
+                             int nsrc,
+                             unsigned char *dst,
+                             size_t len,
+                             int accumulate);
+
+// Compare kernel
+//
+// Returns TRUE if a and b hold the same len bytes. Used by scrub to check recomputed
+// parity against what is on disk, so it is built for throughput on equal buffers.
+typedef int (*equalKernel_t)(const unsigned char *a,
+                             const unsigned char *b,
+                             size_t len);
+
+#define XOR_GROUP (8)          // Source streams per kernel pass
+#define XOR_BLOCK (32 * 1024)  // Bytes per cache block, sized so dst stays in L1/L2 across groups
+
+typedef struct raid_kernel
+{
+    const char *name;        // "scalar", "sse2", "avx2", "avx512"
+    xorKernel_t xor4;        // 4-way XOR over an arbitrary length
+    xorNKernel_t xorN;       // Up to XOR_GROUP-way XOR, 4 independent accumulators
+    equalKernel_t equal;     // Buffer compare
+    int (*supported)(void);  // TRUE if the running CPU can execute this kernel
+} raidkernel_t;
+
+// Kernels chosen at load time from CPUID; may be overridden with RAID_KERNEL=<name>
+extern xorKernel_t raidXor4;
+extern xorNKernel_t raidXorN;
+extern equalKernel_t raidEqual;
+
+int raidKernelCount(void);
+const raidkernel_t *raidKernelInfo(int kernelIdx);
+const char *raidActiveKernel(void);
+
+// Switch the active kernel by name, returns ERROR if unknown or not supported by this CPU
+int raidSelectKernel(const char *name);
+
+#endif
@@ -1,4 +1,10 @@
 #include "raidtest.h"
+#include "raidsimd.h"
+#include "raid6lib.h"
+#include "raidcrc.h"
+
+// Multi-block length for the N-way test, not a multiple of any vector width
+#define WIDE_LEN ((3 * XOR_BLOCK) + 77)
 
 // Function to modify a buffer by adding an offset to each byte and wrapping around at 100
 void modifyBuffer(unsigned char *bufferToModify, int offset)
@@ -34,6 +40,14 @@ void dumpBuffer(unsigned char *bufferToDump)
 int main(int argc, char *argv[])
 {
     int idx, LBAidx, numTestIterations, written = 0;
+    int kernelIdx;
+    size_t len;
+    const raidkernel_t *kernel;
+    int nsrc;
+    unsigned char *wide[14], *saved[14], *parity, *rebuilt, check, checkQ;
+    int lost1, lost2;
+    const char *crcKernels[2] = { "slice8", "sse42" };
+    uint32_t crcRef;
     int fd[5], fdrebuild;
     double rate = 0.0;
     struct timeval StartTime, StopTime;
@@ -154,6 +168,161 @@ int main(int argc, char *argv[])
     }
     printf("\n");
 
+    // TEST CASE #4: Every dispatched XOR kernel must match the scalar kernel
+    // on unaligned buffers and lengths that are not a multiple of the vector width,
+    // and every compare kernel must find the buffers equal until one byte differs
+    printf("TEST CASE 3 (XOR kernel cross-check, active kernel = %s):\n", raidActiveKernel());
+    for(kernelIdx = 1; kernelIdx < raidKernelCount(); kernelIdx++)
+    {
+        kernel = raidKernelInfo(kernelIdx);
+        if(!kernel->supported())
+            continue;
+
+        printf("%s ", kernel->name);
+        for(len = 0; len < (3 * SECTOR_SIZE); len += 37)
+        {
+            raidKernelInfo(0)->xor4(&testLBA1[0][1], &testLBA2[0][3], &testLBA3[0][5], &testLBA4[0][7],
+                                    (unsigned char *)&testPLBA[0][0], len);
+            kernel->xor4(&testLBA1[0][1], &testLBA2[0][3], &testLBA3[0][5], &testLBA4[0][7],
+                         &testRebuild[0][1], len);
+            assert(memcmp(&testPLBA[0][0], &testRebuild[0][1], len) == 0);
+
+            assert(kernel->equal((unsigned char *)&testPLBA[0][0], &testRebuild[0][1], len));
+            if(len > 0)
+            {
+                testRebuild[0][len / 3 + 1] ^= 0x10;
+                assert(!kernel->equal((unsigned char *)&testPLBA[0][0], &testRebuild[0][1], len));
+                assert(!raidKernelInfo(0)->equal((unsigned char *)&testPLBA[0][0], &testRebuild[0][1], len));
+            }
+        }
+    }
+    printf("\n");
+
+
+    // TEST CASE #5: N-way XOR over multi-block regions against a byte-at-a-time reference,
+    // including rebuild of each unit from the survivors and parity
+    printf("TEST CASE 4 (N-way xorBlocks/rebuildBlocks):\n");
+    for(nsrc = 1; nsrc <= 13; nsrc++)
+    {
+        printf("%d ", nsrc);
+        for(idx = 0; idx < nsrc; idx++)
+        {
+            wide[idx] = (unsigned char *)malloc(WIDE_LEN + 1) + 1;   // deliberately misaligned
+            for(len = 0; len < WIDE_LEN; len++)
+                wide[idx][len] = (unsigned char)((len * 31) + (idx * 7) + (len >> 9));
+        }
+        parity = malloc(WIDE_LEN);
+        rebuilt = malloc(WIDE_LEN);
+
+        xorBlocks(wide, nsrc, parity, WIDE_LEN);
+        for(len = 0; len < WIDE_LEN; len++)
+        {
+            check = 0;
+            for(idx = 0; idx < nsrc; idx++)
+                check ^= wide[idx][len];
+            assert(parity[len] == check);
+        }
+
+        // Rebuild the last unit from the first nsrc-1 and the parity
+        rebuildBlocks(wide, nsrc - 1, parity, rebuilt, WIDE_LEN);
+        assert(memcmp(rebuilt, wide[nsrc - 1], WIDE_LEN) == 0);
+
+        for(idx = 0; idx < nsrc; idx++)
+            free(wide[idx] - 1);
+        free(parity);
+        free(rebuilt);
+    }
+    printf("\n");
+
+    // TEST CASE #6: RAID-6 P+Q against a byte-at-a-time GF(2^8) reference, then
+    // recovery of every combination of two lost units for 4+2 and 12+2 layouts
+    printf("TEST CASE 5 (RAID-6 P+Q, kernel = %s):\n", raid6ActiveKernel());
+    for(nsrc = 4; nsrc <= 12; nsrc += 8)
+    {
+        for(idx = 0; idx < nsrc + 2; idx++)
+        {
+            wide[idx] = malloc(WIDE_LEN);
+            saved[idx] = malloc(WIDE_LEN);
+            if(idx < nsrc)
+                for(len = 0; len < WIDE_LEN; len++)
+                    wide[idx][len] = (unsigned char)((len * 131) ^ (idx * 29) ^ (len >> 7));
+        }
+
+        pqGenBlocks(wide, nsrc, wide[nsrc], wide[nsrc + 1], WIDE_LEN);
+        for(len = 0; len < WIDE_LEN; len++)
+        {
+            check = 0;
+            checkQ = 0;
+            for(idx = 0; idx < nsrc; idx++)
+            {
+                check ^= wide[idx][len];
+                checkQ ^= gfMul(gfPow2(idx), wide[idx][len]);
+            }
+            assert((wide[nsrc][len] == check) && (wide[nsrc + 1][len] == checkQ));
+        }
+
+        for(idx = 0; idx < nsrc + 2; idx++)
+            memcpy(saved[idx], wide[idx], WIDE_LEN);
+
+        for(lost1 = 0; lost1 < nsrc + 2; lost1++)
+        {
+            for(lost2 = lost1 + 1; lost2 < nsrc + 2; lost2++)
+            {
+                memset(wide[lost1], 0xA5, WIDE_LEN);
+                memset(wide[lost2], 0x5A, WIDE_LEN);
+                assert(pqRecoverBlocks(wide, nsrc, lost1, lost2, WIDE_LEN) == OK);
+                assert(memcmp(wide[lost1], saved[lost1], WIDE_LEN) == 0);
+                assert(memcmp(wide[lost2], saved[lost2], WIDE_LEN) == 0);
+            }
+        }
+        printf("%d+2 ", nsrc);
+
+        for(idx = 0; idx < nsrc + 2; idx++)
+        {
+            free(wide[idx]);
+            free(saved[idx]);
+        }
+    }
+    printf("\n");
+
+    // TEST CASE #7: CRC32C against the check value of "123456789", every kernel against the
+    // portable one at lengths around the three-lane block, and a CRC patched after part of
+    // the buffer changes against the CRC computed afresh
+    printf("TEST CASE 6 (CRC32C, kernel = %s):\n", crc32cActiveKernel());
+    wide[0] = malloc(WIDE_LEN + 1);
+    wide[1] = malloc(WIDE_LEN);
+    for(len = 0; len < WIDE_LEN + 1; len++)
+        wide[0][len] = (unsigned char)((len * 67) ^ (len >> 5));
+    for(kernelIdx = 0; kernelIdx < 2; kernelIdx++)
+    {
+        if(crc32cSelectKernel(crcKernels[kernelIdx]) != OK)
+            continue;
+
+        printf("%s ", crcKernels[kernelIdx]);
+        assert(crc32c(0, (const unsigned char *)"123456789", 9) == 0xe3069283);
+        for(len = 0; len < WIDE_LEN; len += (len < 3200) ? 1 : 4099)
+        {
+            crc32cSelectKernel("slice8");
+            crcRef = crc32c(0, &wide[0][1], len);
+            crc32cSelectKernel(crcKernels[kernelIdx]);
+            assert(crc32c(0, &wide[0][1], len) == crcRef);
+            assert(crc32c(crc32c(0, &wide[0][1], len / 3), &wide[0][1 + len / 3], len - len / 3) == crcRef);
+        }
+
+        // Change 600 bytes at 1000 and patch the CRC with the change
+        crcRef = crc32c(0, wide[0], WIDE_LEN);
+        bzero(wide[1], WIDE_LEN);
+        for(len = 1000; len < 1600; len++)
+        {
+            wide[1][len] = (unsigned char)(len * 13 + 1);
+            wide[0][len] ^= wide[1][len];
+        }
+        assert(crc32cPatch(crcRef, WIDE_LEN, 1000, &wide[1][1000], 600) == crc32c(0, wide[0], WIDE_LEN));
+    }
+    free(wide[0]);
+    free(wide[1]);
+    printf("\n");
+
     // End of tests
     printf("FINISHED\n");
 }
@@ -0,0 +1,262 @@
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "raidlib.h"
+#include "raiduring.h"
+
+// The ring indexes are shared with the kernel: loads of the kernel-owned index need
+// acquire ordering and stores of our index release ordering
+#define LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static int uringSetup(unsigned entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int uringRegister(int fd, unsigned opcode, void *arg, unsigned count)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+int raidUringInit(raiduring_t *ring, unsigned entries)
+{
+    struct io_uring_params params;
+    unsigned char *sq, *cq;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+
+    if((ring->fd = uringSetup(entries, &params)) < 0)
+        return ERROR;
+    ring->entries = params.sq_entries;
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    // Kernels with IORING_FEAT_SINGLE_MMAP share one mapping for both rings
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if(ring->cqRingSize > ring->sqRingSize)
+            ring->sqRingSize = ring->cqRingSize;
+        ring->cqRingSize = ring->sqRingSize;
+    }
+
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if(ring->sqRing == MAP_FAILED)
+        goto fail;
+
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+        ring->cqRing = ring->sqRing;
+    else
+    {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->fd, IORING_OFF_CQ_RING);
+        if(ring->cqRing == MAP_FAILED)
+        {
+            munmap(ring->sqRing, ring->sqRingSize);
+            goto fail;
+        }
+    }
+
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if(ring->sqes == MAP_FAILED)
+    {
+        if(ring->cqRing != ring->sqRing)
+            munmap(ring->cqRing, ring->cqRingSize);
+        munmap(ring->sqRing, ring->sqRingSize);
+        goto fail;
+    }
+
+    sq = (unsigned char *)ring->sqRing;
+    ring->sqHead = (unsigned *)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+
+    cq = (unsigned char *)ring->cqRing;
+    ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    return OK;
+
+fail:
+    close(ring->fd);
+    ring->fd = -1;
+    return ERROR;
+}
+
+void raidUringExit(raiduring_t *ring)
+{
+    if(ring->fd < 0)
+        return;
+
+    munmap(ring->sqes, ring->sqesSize);
+    if(ring->cqRing != ring->sqRing)
+        munmap(ring->cqRing, ring->cqRingSize);
+    munmap(ring->sqRing, ring->sqRingSize);
+
+    // Closing the ring also drops the registered files and buffers
+    close(ring->fd);
+    ring->fd = -1;
+}
+
+int raidUringRegisterFiles(raiduring_t *ring, int *fds, unsigned count)
+{
+    if(uringRegister(ring->fd, IORING_REGISTER_FILES, fds, count) < 0)
+        return ERROR;
+
+    ring->fixedFiles = TRUE;
+    return OK;
+}
+
+int raidUringRegisterBuffer(raiduring_t *ring, unsigned char *base, size_t len)
+{
+    struct iovec iov;
+
+    iov.iov_base = base;
+    iov.iov_len = len;
+    if(uringRegister(ring->fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+        return ERROR;
+
+    ring->fixedBase = base;
+    ring->fixedLen = len;
+    return OK;
+}
+
+// Claim the next submission queue entry, cleared, or NULL when the ring is full
+static struct io_uring_sqe *uringNextSqe(raiduring_t *ring)
+{
+    unsigned tail = *ring->sqTail, idx;
+    struct io_uring_sqe *sqe;
+
+    if(tail - LOAD_ACQUIRE(ring->sqHead) >= ring->entries)
+        return NULL;
+
+    idx = tail & *ring->sqMask;
+    sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sqArray[idx] = idx;
+    return sqe;
+}
+
+// Publish the entry claimed by uringNextSqe
+static void uringPushSqe(raiduring_t *ring)
+{
+    STORE_RELEASE(ring->sqTail, *ring->sqTail + 1);
+    ring->queued++;
+}
+
+int raidUringQueue(raiduring_t *ring, int write, int file, unsigned char *buf, unsigned len,
+                   off_t pos, unsigned long long tag)
+{
+    struct io_uring_sqe *sqe;
+
+    if((sqe = uringNextSqe(ring)) == NULL)
+        return ERROR;
+
+    sqe->fd = file;
+    sqe->off = pos;
+    sqe->addr = (unsigned long long)(unsigned long)buf;
+    sqe->len = len;
+    sqe->user_data = tag;
+    if(ring->fixedFiles)
+        sqe->flags = IOSQE_FIXED_FILE;
+
+    // Ops inside the registered region use the pre-pinned buffer
+    if((ring->fixedBase != NULL) && (buf >= ring->fixedBase) && (buf + len <= ring->fixedBase + ring->fixedLen))
+    {
+        sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = 0;
+    }
+    else
+        sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+
+    uringPushSqe(ring);
+    return OK;
+}
+
+int raidUringCancel(raiduring_t *ring, unsigned long long tag)
+{
+    struct io_uring_sqe *sqe;
+
+    if((sqe = uringNextSqe(ring)) == NULL)
+        return ERROR;
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = tag;
+    sqe->user_data = RAID_URING_TAG_CANCEL;
+    uringPushSqe(ring);
+
+    return OK;
+}
+
+int raidUringSubmitTimeout(raiduring_t *ring, unsigned waitFor, long long timeoutUs)
+{
+    struct io_uring_sqe *sqe;
+
+    if((sqe = uringNextSqe(ring)) == NULL)
+        return ERROR;
+
+    // The timeout op completes after waitFor other completions or when the time is up,
+    // whichever is first, so it never outlives the wait by much
+    ring->timeout.tv_sec = timeoutUs / 1000000;
+    ring->timeout.tv_nsec = (timeoutUs % 1000000) * 1000;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (unsigned long long)(unsigned long)&ring->timeout;
+    sqe->len = 1;
+    sqe->off = waitFor;
+    sqe->user_data = RAID_URING_TAG_TIMEOUT;
+    uringPushSqe(ring);
+
+    return raidUringSubmit(ring, waitFor);
+}
+
+int raidUringSubmit(raiduring_t *ring, unsigned waitFor)
+{
+    int rc;
+
+    do
+    {
+        rc = uringEnter(ring->fd, ring->queued, waitFor, (waitFor > 0) ? IORING_ENTER_GETEVENTS : 0);
+    }
+    while((rc < 0) && (errno == EINTR));
+
+    if(rc < 0)
+        return ERROR;
+
+    ring->queued -= ((unsigned)rc < ring->queued) ? (unsigned)rc : ring->queued;
+    return OK;
+}
+
+int raidUringReap(raiduring_t *ring, unsigned long long *tag, int *res)
+{
+    unsigned head = *ring->cqHead;
+    struct io_uring_cqe *cqe;
+
+    if(head == LOAD_ACQUIRE(ring->cqTail))
+        return FALSE;
+
+    cqe = &ring->cqes[head & *ring->cqMask];
+    *tag = cqe->user_data;
+    *res = cqe->res;
+    STORE_RELEASE(ring->cqHead, head + 1);
+
+    return TRUE;
+}
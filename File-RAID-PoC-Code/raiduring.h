@@ -0,0 +1,75 @@
+#ifndef RAIDURING_H
+#define RAIDURING_H
+
+#include <sys/types.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+// Minimal io_uring ring over the raw system calls, so the build does not need liburing
+//
+// The submission and completion rings are mapped once at init. Files and one buffer
+// region can be registered, after which reads and writes use the fixed-file and
+// fixed-buffer forms and skip the per-op file lookup and page pinning.
+
+typedef struct raid_uring
+{
+    int fd;
+    unsigned entries;
+
+    // Submission ring
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    struct io_uring_sqe *sqes;
+    unsigned queued;   // Entries added since the last submit
+
+    // Completion ring
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize, sqesSize;
+
+    struct __kernel_timespec timeout; // Of the last raidUringSubmitTimeout, read by the kernel at submit
+
+    int fixedFiles;                   // Files registered: file arguments are indexes
+    unsigned char *fixedBase;         // Registered buffer region, NULL when none
+    size_t fixedLen;
+} raiduring_t;
+
+// Create a ring with room for entries in-flight ops. Returns ERROR, with errno set,
+// when io_uring is not available (old kernel, seccomp, or disabled by sysctl).
+int raidUringInit(raiduring_t *ring, unsigned entries);
+void raidUringExit(raiduring_t *ring);
+
+// Register files (fd -1 leaves a slot empty) and one buffer region. On success later
+// ops take an index into fds instead of a descriptor. Both return OK or ERROR.
+int raidUringRegisterFiles(raiduring_t *ring, int *fds, unsigned count);
+int raidUringRegisterBuffer(raiduring_t *ring, unsigned char *base, size_t len);
+
+// Queue a read or write of len bytes at file offset pos; tag comes back with the completion.
+// Returns ERROR when the submission ring is full.
+int raidUringQueue(raiduring_t *ring, int write, int file, unsigned char *buf, unsigned len,
+                   off_t pos, unsigned long long tag);
+
+// Submit everything queued and wait until at least waitFor completions are available
+int raidUringSubmit(raiduring_t *ring, unsigned waitFor);
+
+// Submit everything queued and wait until waitFor completions are available or timeoutUs
+// microseconds have passed. The wait is a timeout op whose completion, tagged
+// RAID_URING_TAG_TIMEOUT, counts towards waitFor; -EINVAL in it means the kernel has no
+// timeout op and the call did not wait.
+int raidUringSubmitTimeout(raiduring_t *ring, unsigned waitFor, long long timeoutUs);
+
+// Queue a cancel of the op tagged tag. Its completion is tagged RAID_URING_TAG_CANCEL;
+// the op itself completes with -ECANCELED if it was cancelled, or as usual if it was
+// too far along. Returns ERROR when the submission ring is full.
+int raidUringCancel(raiduring_t *ring, unsigned long long tag);
+
+// Tags of the ring's own ops; callers' tags stay below them
+#define RAID_URING_TAG_TIMEOUT (~0ULL)
+#define RAID_URING_TAG_CANCEL  (~0ULL - 1)
+
+// Take one completion: returns TRUE and fills tag and res (bytes moved, or -errno),
+// or FALSE when the completion ring is empty
+int raidUringReap(raiduring_t *ring, unsigned long long *tag, int *res);
+
+#endif
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "raidset.hpp" // C++ wrapper for an open chunk set
+
+#define USAGE "usage: settest [-6|-l] [-r] [-u unit] [-k stripes] inputfile outputfile\n"
+
+#define PATCH_BYTES (10000) // Bytes updated in place by the write check
+
+// Count a check, printing OK or FAILED after its description
+static void check(const char *what, bool ok, int *failed)
+{
+    printf("%s %s\n", what, ok ? "OK" : "FAILED");
+    if(!ok)
+        (*failed)++;
+}
+
+// Read all of a file
+static std::vector<unsigned char> readFile(const char *name)
+{
+    std::ifstream in(name, std::ios::binary);
+
+    if(!in)
+        throw std::runtime_error(std::string(name) + ": cannot read");
+    return std::vector<unsigned char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// Drives raid::StripeSet through every path of the wrapper on the default chunk files:
+// create, stripe and read back, an update in place through the write-back cache, a
+// scrub, which has to write the cache out first, moves of the open set, close and
+// reopen, and a shorter stripe over a set with a lost chunk, which has to recreate the
+// chunk and cut the others to the new length.
+//
+// The set is left holding the first half of the updated file, also restored to the
+// output file, so that its chunks can be compared with those striped from half of the
+// input file, which has the same length.
+// Every check prints OK or FAILED; the exit code is the number that failed.
+int main(int argc, char *argv[])
+{
+    raidcfg_t cfg = { RAID_CODE_XOR, RAID_LAYOUT_FIXED };
+    std::vector<unsigned char> data, patch, half;
+    size_t offset;
+    int opt, failed = 0;
+
+    // -6 and -l select RAID-6 and the locally repairable code, -r rotates parity, -u sets
+    // the stripe unit and -k the stripes of the write-back cache (8 by default). The
+    // cache is never aged out here, so only a flush or a scrub writes it.
+    cfg.cacheStripes = 8;
+    cfg.cacheAgeMs = 3600 * 1000;
+    while((opt = getopt(argc, argv, "6lru:k:")) != -1)
+    {
+        if(opt == '6')
+            cfg.code = RAID_CODE_PQ;
+        else if(opt == 'l')
+            cfg.code = RAID_CODE_LRC;
+        else if(opt == 'r')
+            cfg.layout = RAID_LAYOUT_ROTATING;
+        else if(opt == 'u')
+            cfg.unitSize = atoi(optarg) * ((strchr(optarg, 'k') != NULL) ? 1024 : 1);
+        else if(opt == 'k')
+            cfg.cacheStripes = atoi(optarg);
+        else
+        {
+            printf(USAGE);
+            exit(-1);
+        }
+    }
+    if(argc - optind != 2)
+    {
+        printf(USAGE);
+        exit(-1);
+    }
+
+    try
+    {
+        data = readFile(argv[optind]);
+        if(data.size() < 2 * PATCH_BYTES)
+            throw std::runtime_error("input file too small");
+
+        // Create the set and store the whole file
+        raid::StripeSet set = raid::StripeSet::create(cfg);
+        set.stripe(data);
+        check("stripe and read back", (set.length() == (off_t)data.size()) && (set.read(0, data.size()) == data),
+              &failed);
+
+        // Update a range in place; it stays in the cache until written out
+        offset = data.size() / 3;
+        patch.assign(data.rbegin(), data.rbegin() + PATCH_BYTES);
+        check("write in place", set.write(offset, patch.data(), patch.size()) == patch.size(), &failed);
+        std::copy(patch.begin(), patch.end(), data.begin() + offset);
+        check("read through the cache", set.read(0, data.size()) == data, &failed);
+
+        // The scrub writes the cache out before it reads the chunks, so a restore from the
+        // chunk files alone, with the set still open, sees the update
+        check("scrub of the open set", set.scrub() == 0, &failed);
+        check("scrub after the cache is written out",
+              (restoreFileCfg(argv[optind + 1], 0, RAID_LENGTH_FROM_CHUNKS, &cfg, 0, 0) == (off_t)data.size()) &&
+              (readFile(argv[optind + 1]) == data), &failed);
+
+        // Move the open set around; the moved-from one is closed
+        raid::StripeSet moved(std::move(set));
+        bool closed = false;
+        try
+        {
+            set.handle();
+        }
+        catch(const std::logic_error &)
+        {
+            closed = true;
+        }
+        check("move construct", closed && (moved.read(offset, PATCH_BYTES) == patch), &failed);
+        set = std::move(moved);
+        check("move assign", set.read(0, data.size()) == data, &failed);
+
+        // Close, reporting the write-back, and open the chunks again
+        set.close();
+        raid::StripeSet reopened(cfg);
+        check("close and reopen", reopened.read(0, data.size()) == data, &failed);
+        reopened.close();
+
+        // Lose the first chunk and store half the file: every chunk is rewritten, the lost
+        // one included, and cut to the new length
+        unlink(raidChunkName(&cfg, 0));
+        half.assign(data.begin(), data.begin() + data.size() / 2);
+        raid::StripeSet degraded(cfg);
+        degraded.stripe(half);
+        check("shorter stripe over a lost chunk",
+              (degraded.length() == (off_t)half.size()) && (degraded.read(0, half.size()) == half), &failed);
+        degraded.close();
+
+        // Restoring without the second chunk needs the first one, as recreated
+        check("lost chunk recreated",
+              (access(raidChunkName(&cfg, 0), F_OK) == 0) &&
+              (restoreFileCfg(argv[optind + 1], 0, RAID_LENGTH_FROM_CHUNKS, &cfg, 2, 0) == (off_t)half.size()) &&
+              (readFile(argv[optind + 1]) == half), &failed);
+    }
+    catch(const std::exception &e)
+    {
+        printf("settest: %s\n", e.what());
+        failed++;
+    }
+
+    printf(failed ? "FAILED\n" : "FINISHED\n");
+    return failed;
+}
@@ -1,44 +1,431 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
 
 #include "raidlib.h" // Include the custom RAID library header
 
+#define USAGE "usage: stripetest [-6|-l] [-r] [-n data] [-D dir[:dir...]] [-b] [-S] [-L rate] [-s sector] [-u unit] [-t threads] [-q depth|-m] [-H usecs] [-X sparefile] [-p] [-g offset:length] [-w offset:patchfile [-k stripes]] inputfile outputfile <chunk to restore> <second chunk to restore>\n" \
+              "       stripetest -c [-D dir[:dir...]] [-b] [-S] [-L rate] [-g offset:length] [-w offset:patchfile [-k stripes]] [-t threads] [-q depth|-m] [-H usecs] [-X sparefile:chunk] [-p] outputfile <chunk to restore> <second chunk to restore>\n" \
+              "       stripetest -E [-6|-l] [-r] [-n data] [-D dir[:dir...]] [-s sector] [-u unit] [-t threads] [-q depth] [-X sparefile] [-p] inputfile\n" \
+              "       inputfile and outputfile may be - for stdin and stdout\n"
+
+// Parse a byte count with an optional k or m suffix, e.g. 4k or 1m
+static int parseSize(char *arg)
+{
+    char *end;
+    long size = strtol(arg, &end, 10);
+
+    if((*end == 'k') || (*end == 'K'))
+        size *= 1024;
+    else if((*end == 'm') || (*end == 'M'))
+        size *= 1024 * 1024;
+
+    return (int)size;
+}
+
+// Read length bytes at offset of the striped file through raidPread into outputFileName;
+// returns the bytes read or ERROR
+static off_t readRange(char *outputFileName, raidcfg_t *cfg, off_t offset, off_t length)
+{
+    unsigned char *buf;
+    raidset_t *set;
+    ssize_t bread;
+    FILE *fdout;
+
+    if((set = raidOpen(cfg)) == NULL)
+        return ERROR;
+
+    if((buf = malloc(length)) == NULL)
+    {
+        raidClose(set);
+        return ERROR;
+    }
+
+    bread = raidPread(set, offset, length, buf);
+    raidClose(set);
+
+    if((bread < 0) || ((fdout = fopen(outputFileName, "w")) == NULL))
+    {
+        free(buf);
+        return ERROR;
+    }
+    fwrite(buf, 1, bread, fdout);
+    fclose(fdout);
+    free(buf);
+
+    printf("read %lld bytes at %lld\n", (long long)bread, (long long)offset);
+    return bread;
+}
+
+// Write the contents of patchFileName over the striped file at offset through raidPwrite;
+// returns OK or ERROR
+static int writeRange(char *patchFileName, raidcfg_t *cfg, off_t offset)
+{
+    unsigned char *buf;
+    raidset_t *set;
+    struct stat st;
+    ssize_t bwritten = ERROR;
+    FILE *fdin;
+
+    if((stat(patchFileName, &st) != 0) || ((fdin = fopen(patchFileName, "r")) == NULL))
+    {
+        perror(patchFileName);
+        return ERROR;
+    }
+
+    buf = malloc(st.st_size + 1);
+    if((buf != NULL) && (fread(buf, 1, st.st_size, fdin) == (size_t)st.st_size) && ((set = raidOpen(cfg)) != NULL))
+    {
+        bwritten = raidPwrite(set, offset, st.st_size, buf);
+        if(raidClose(set) != OK)
+            bwritten = ERROR;
+    }
+    fclose(fdin);
+    free(buf);
+
+    if(bwritten < 0)
+        return ERROR;
+
+    printf("wrote %lld bytes at %lld\n", (long long)bwritten, (long long)offset);
+    return OK;
+}
+
+// Place chunk files round-robin in the colon-separated directories of dirs, each under
+// its default name; NULL dirs leaves them in the current directory. The paths are kept
+// in static storage since cfg refers to them.
+static void placeChunks(raidcfg_t *cfg, char *dirs)
+{
+    static char pathStore[MAX_CHUNKS][256];
+    static char *paths[MAX_CHUNKS];
+    char *dir[MAX_CHUNKS], *next;
+    int idx, ndirs = 0;
+
+    if(dirs == NULL)
+    {
+        cfg->chunkPath = NULL;
+        return;
+    }
+
+    for(next = dirs; (next != NULL) && (ndirs < MAX_CHUNKS); ndirs++)
+    {
+        dir[ndirs] = next;
+        if((next = strchr(next, ':')) != NULL)
+            *next++ = '\0';
+    }
+
+    // Count with the default names so an invalid width is still caught by the library
+    cfg->chunkPath = NULL;
+    for(idx = 0; (idx < raidChunkCount(cfg)) && (idx < MAX_CHUNKS); idx++)
+    {
+        snprintf(pathStore[idx], sizeof(pathStore[idx]), "%s/%s", dir[idx % ndirs], raidChunkName(cfg, idx));
+        paths[idx] = pathStore[idx];
+    }
+    cfg->chunkPath = paths;
+
+    // Undo the splitting so the list can be placed again for another geometry
+    for(idx = 1; idx < ndirs; idx++)
+        dir[idx][-1] = ':';
+}
+
+// Scrub callback for -S: one line per stripe, its number then the chunks that disagree
+static void showMismatch(void *arg, off_t stripe, uint64_t chunks)
+{
+    int idx;
+
+    printf("mismatch %lld", (long long)stripe);
+    for(idx = 0; chunks != 0; idx++, chunks >>= 1)
+        if(chunks & 1)
+            printf(" %d", idx + 1);
+    printf("\n");
+}
+
+// Progress callback for -p: arg names the operation. The rate, and from it the time
+// left, are measured from the first report of each operation.
+static void showProgress(void *arg, off_t done, off_t total)
+{
+    static void *lastArg;
+    static struct timespec start;
+    static off_t startDone;
+    struct timespec now;
+    double rate = 0.0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(arg != lastArg)
+    {
+        lastArg = arg;
+        start = now;
+        startDone = done;
+    }
+    else if(done > startDone)
+        rate = (done - startDone) / ((now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1.0e9);
+
+    if(total > 0)
+        fprintf(stderr, "\r%s %lld of %lld MiB (%d%%)", (char *)arg, (long long)(done >> 20),
+                (long long)(total >> 20), (int)((done * 100) / total));
+    else
+        fprintf(stderr, "\r%s %lld MiB", (char *)arg, (long long)(done >> 20));
+
+    if(rate > 0.0)
+    {
+        fprintf(stderr, ", %.1f MB/s", rate / 1.0e6);
+        if(total > done)
+            fprintf(stderr, ", about %lld s left   ", (long long)((total - done) / rate));
+    }
+
+    if(done == total)
+        fprintf(stderr, "\n");
+}
+
 int main(int argc, char *argv[])
 {
-    int bytesWritten, bytesRestored;
+    off_t bytesWritten, bytesRestored, mismatches;
     char rc;
-    int chunkToRebuild = 0; // Variable to store the chunk number to rebuild
+    int chunkToRebuild = 0, chunkToRebuild2 = 0; // Chunk numbers to rebuild
+    int ndata;
+    int opt, rebuildFirst = FALSE, cold = FALSE, scrub = FALSE, encodeOnly = FALSE;
+    int streamIn = FALSE, streamOut = FALSE, outFd = -1;
+    char *chunkDirs = NULL, *spareChunk;
+    long long getOffset = -1, getLength = 0, putOffset = -1;
+    char patchFileName[256];
+    raidcfg_t cfg = { RAID_CODE_XOR, RAID_LAYOUT_FIXED };
+
+    // -6 selects RAID-6 (P+Q) and -l the locally repairable code, both of which can restore
+    // with two chunks removed. -n sets the data chunks per stripe (2 to 32, 4 by default)
+    // and -D spreads the chunk files round-robin over the listed directories, e.g. one per
+    // device. -r rotates parity across the chunk files (left-symmetric)
+    // and -b rewrites the removed chunk files before restoring. -S checks the parity of
+    // every stripe before restoring and lists the stripes that do not match. -L caps -b
+    // and -S at rate MB/s.
+    // -s and -u set the sector size and the stripe unit each chunk holds per stripe
+    // (e.g. -s 4k -u 1m). -t runs stripe ranges on that many threads, -t 0 on one thread
+    // per CPU. -q uses io_uring
+    // with up to depth I/Os in flight per thread (-q 0 for the default depth), and -m
+    // stripes and restores through memory mappings of the files. -H hedges the restore's
+    // reads on io_uring: a unit not read within usecs is rebuilt from parity. -X gives the
+    // striping a hot spare to move a chunk whose writes fail to; with -c, sparefile:chunk
+    // names the chunk that moved there in an earlier run. -p shows progress.
+    // -c restores from chunk files already in the directory, taking the code, layout,
+    // sizes and file length from their superblocks instead of striping an input file.
+    // -g reads just length bytes at offset of the file into the output file, through the
+    // random access API, instead of restoring all of it. -w writes a patch file over the
+    // striped file at offset, updating the chunks in place, before the restore, with -k
+    // through a write-back cache of that many stripes. -E stripes the input file and
+    // stops there. An input file of - is read from stdin and an output file of - written
+    // to stdout as streams, e.g. tar cf - dir | stripetest -E - and stripetest -c - | tar xf -;
+    // the messages then go to stderr and there is no pause before the restore.
+    while((opt = getopt(argc, argv, "6lrn:D:bSL:s:u:t:q:mH:X:pcEg:w:k:")) != -1)
+    {
+        if(opt == '6')
+            cfg.code = RAID_CODE_PQ;
+        else if(opt == 'l')
+            cfg.code = RAID_CODE_LRC;
+        else if(opt == 'r')
+            cfg.layout = RAID_LAYOUT_ROTATING;
+        else if(opt == 'n')
+            cfg.dataChunks = atoi(optarg);
+        else if(opt == 'D')
+            chunkDirs = optarg;
+        else if(opt == 'b')
+            rebuildFirst = TRUE;
+        else if(opt == 'S')
+            scrub = TRUE;
+        else if(opt == 'L')
+            cfg.rebuildRate = cfg.scrubRate = atoi(optarg);
+        else if(opt == 's')
+            cfg.sectorSize = parseSize(optarg);
+        else if(opt == 'u')
+            cfg.unitSize = parseSize(optarg);
+        else if(opt == 't')
+            cfg.threads = (atoi(optarg) == 0) ? RAID_THREADS_AUTO : atoi(optarg);
+        else if(opt == 'q')
+        {
+            cfg.ioEngine = RAID_IO_URING;
+            cfg.queueDepth = atoi(optarg);
+        }
+        else if(opt == 'm')
+            cfg.ioEngine = RAID_IO_MMAP;
+        else if(opt == 'H')
+        {
+            cfg.ioEngine = RAID_IO_URING;
+            cfg.hedgeUs = atoi(optarg);
+        }
+        else if(opt == 'X')
+        {
+            if((spareChunk = strrchr(optarg, ':')) != NULL)
+            {
+                *spareChunk = '\0';
+                cfg.spareChunk = atoi(spareChunk + 1);
+            }
+            cfg.sparePath = optarg;
+        }
+        else if(opt == 'p')
+            cfg.progress = showProgress;
+        else if(opt == 'c')
+            cold = TRUE;
+        else if(opt == 'E')
+            encodeOnly = TRUE;
+        else if(opt == 'g')
+        {
+            if((sscanf(optarg, "%lld:%lld", &getOffset, &getLength) != 2) || (getOffset < 0) || (getLength <= 0))
+            {
+                printf(USAGE);
+                exit(-1);
+            }
+        }
+        else if(opt == 'k')
+            cfg.cacheStripes = atoi(optarg);
+        else if(opt == 'w')
+        {
+            if((sscanf(optarg, "%lld:%255s", &putOffset, patchFileName) != 2) || (putOffset < 0))
+            {
+                printf(USAGE);
+                exit(-1);
+            }
+        }
+        else
+        {
+            printf(USAGE);
+            exit(-1);
+        }
+    }
+    argc -= (optind - 1);
+    argv += (optind - 1);
+
+    // Cold restores take no input file: shift the output file into its usual place
+    if(cold)
+    {
+        argc++;
+        argv--;
+    }
 
     // Check if the correct number of arguments are provided
-    if(argc < 3)
+    if((argc < (encodeOnly ? 2 : 3)) || (cold && encodeOnly))
     {
-        printf("usage: stripetest inputfile outputfile <sector to restore>\n");
+        printf(USAGE);
         exit(-1); // Exit with an error code if insufficient arguments
     }
-    
+
+    // Keep stdout for the restored data and send everything else printed to stderr
+    streamIn = !cold && (strcmp(argv[1], "-") == 0);
+    if(!encodeOnly && (strcmp(argv[2], "-") == 0))
+    {
+        streamOut = TRUE;
+        if(((outFd = dup(STDOUT_FILENO)) < 0) || (dup2(STDERR_FILENO, STDOUT_FILENO) < 0))
+        {
+            perror("stdout");
+            exit(-1);
+        }
+    }
+
     // If the fourth argument is provided, parse it to determine the chunk to rebuild
     if(argc >= 4)
     {
         sscanf(argv[3], "%d", &chunkToRebuild); // Convert the argument to an integer
         printf("chunk to restore = %d\n", chunkToRebuild);
     }
+
+    if(argc >= 5)
+    {
+        sscanf(argv[4], "%d", &chunkToRebuild2);
+        printf("second chunk to restore = %d\n", chunkToRebuild2);
+    }
    
-    // Stripe the input file across 4 data chunks + 1 XOR parity chunk
-    bytesWritten = stripeFile(argv[1], 0); 
+    placeChunks(&cfg, chunkDirs);
 
-    // Inform the user that the input file has been written into chunks
-    printf("input file was written as 4 data chunks + 1 XOR parity - could have been on 5 devices\n");
-    printf("Remove chunk %d and enter g for go - could have been on 5 devices\n", chunkToRebuild);
-    printf("Hit return to start rebuild:");
+    if(cold)
+    {
+        // Probe the widest set the directories could hold, then name the chunks it has
+        if(chunkDirs != NULL)
+        {
+            cfg.dataChunks = RAID_MAX_DATA;
+            placeChunks(&cfg, chunkDirs);
+        }
+        if(raidProbe(&cfg, &bytesWritten) != OK)
+            exit(-1);
+        placeChunks(&cfg, chunkDirs);
+        printf("found a %lld byte file in chunks of %d byte units\n", (long long)bytesWritten, cfg.unitSize);
+    }
+    else
+    {
+        // Stripe the input file across the data chunks + parity
+        cfg.progressArg = "striped";
+        if(streamIn)
+            bytesWritten = stripeStream(STDIN_FILENO, &cfg);
+        else
+            bytesWritten = stripeFileCfg(argv[1], 0, &cfg);
+        if(bytesWritten < 0)
+            exit(-1);
+        if(cfg.spareChunk != 0)
+            printf("chunk %d failed and now lives on the spare %s\n", cfg.spareChunk, cfg.sparePath);
 
-    // Wait for the user to press 'g' and then hit return to start the rebuild process
-    rc = getchar();
+        if(encodeOnly)
+        {
+            printf("striped %lld bytes\n", (long long)bytesWritten);
+            exit(0);
+        }
+    }
+
+    // Inform the user that the input file has been written into chunks
+    ndata = (cfg.dataChunks > 0) ? cfg.dataChunks : DATA_CHUNKS;
+    if(cfg.code == RAID_CODE_PQ)
+    {
+        printf("input file was written as %d data chunks + XOR (P) + Q parity - could have been on %d devices\n", ndata, ndata + 2);
+        printf("Remove chunks %d and %d and enter g for go\n", chunkToRebuild, chunkToRebuild2);
+    }
+    else if(cfg.code == RAID_CODE_LRC)
+    {
+        printf("input file was written as %d data chunks + 2 local XOR (L1, L2) + Q parity - could have been on %d devices\n", ndata, ndata + 3);
+        printf("Remove chunks %d and %d and enter g for go\n", chunkToRebuild, chunkToRebuild2);
+    }
+    else
+    {
+        printf("input file was written as %d data chunks + 1 XOR parity - could have been on %d devices\n", ndata, ndata + 1);
+        printf("Remove chunk %d and enter g for go - could have been on %d devices\n", chunkToRebuild, ndata + 1);
+    }
+    // Wait for the user to press 'g' and then hit return to start the rebuild process;
+    // stdin and stdout are not the user's when streaming
+    if(!streamIn && !streamOut)
+    {
+        printf("Hit return to start rebuild:");
+        rc = getchar();
+    }
 
     // Start the file restoration process
     printf("working on restoring file ...\n");
 
-    // Restore the file from the available chunks and rebuild the specified chunk if needed
-    bytesRestored = restoreFile(argv[2], 0, bytesWritten, chunkToRebuild); 
+    // Rewrite the removed chunk files from the survivors, leaving nothing to rebuild on restore
+    if(rebuildFirst && ((chunkToRebuild != 0) || (chunkToRebuild2 != 0)))
+    {
+        cfg.progressArg = "rebuilt";
+        if(rebuildChunk(&cfg, chunkToRebuild, chunkToRebuild2) < 0)
+            exit(-1);
+        chunkToRebuild = chunkToRebuild2 = 0;
+    }
+
+    if((putOffset >= 0) && (writeRange(patchFileName, &cfg, putOffset) != OK))
+        exit(-1);
+
+    if(scrub)
+    {
+        cfg.progressArg = "scrubbed";
+        if((mismatches = raidScrub(&cfg, showMismatch, NULL)) < 0)
+            exit(-1);
+        printf("scrub found %lld stripes with mismatched parity\n", (long long)mismatches);
+    }
+
+    // Restore the file from the available chunks and rebuild the specified chunks if needed
+    cfg.progressArg = "restored";
+    if(getOffset >= 0)
+        bytesRestored = readRange(argv[2], &cfg, getOffset, getLength);
+    else if(streamOut)
+        bytesRestored = restoreStream(outFd, &cfg, chunkToRebuild, chunkToRebuild2);
+    else
+        bytesRestored = restoreFileCfg(argv[2], 0, RAID_LENGTH_FROM_CHUNKS, &cfg, chunkToRebuild, chunkToRebuild2);
+    if(bytesRestored < 0)
+        exit(-1);
 
     // Indicate that the restoration process is complete
     printf("FINISHED\n");